@@ -44,5 +44,8 @@ workspace "sln-nc"
 
     filter "system:windows"
       defines { "CRT_MINGW", "MINGW_HAS_SECURE_API", "_POSIX_C_SOURCE" }
-      links { "nc" }
+      links { "nc", "pthread" }
       linkoptions { "-Wall" }
+
+    filter "system:not windows"
+      links { "nc", "pthread" }
@@ -1,6 +1,23 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // mremap
+#endif
+
 #include "nc_array.h"
+#include "nc_palloc.h"
 
+#include <limits.h>
 #include <stdint.h>
+#include <string.h>  // memcpy
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#define NC_HAVE_MMAP 1
+#endif
+
+#if defined(__linux__)
+#define NC_HAVE_MREMAP 1
+#endif
 
 struct nc_array *
 nc_array_create(int n, size_t size)
@@ -25,27 +42,222 @@ nc_array_create(int n, size_t size)
 void
 nc_array_destroy(struct nc_array *a)
 {
-  if (a->elems != NULL) {
+  nc_array_deinit(a);
+
+  // The header of a nc_array_pcreate() array belongs to the pool
+  if (!(a->flags & NC_ARRAY_POOL)) {
+    nc_free(a);
+  }
+}
+
+// Arrays created from a pool take their storage from it and never call
+// malloc for buffers that fit in a pool block. The storage is released in
+// bulk by nc_pool_destroy() or nc_pool_reset(); nc_array_destroy() and
+// nc_array_deinit() give back only large (> pool->max) buffers early and
+// may be skipped. The array must not outlive the pool.
+struct nc_array *
+nc_array_pcreate(struct nc_pool *pool, int n, size_t size)
+{
+  struct nc_array *a;
+
+  a = nc_palloc(pool, sizeof(*a));
+  if (a == NULL) {
+    return NULL;
+  }
+
+  if (nc_array_pinit(a, pool, n, size) != NC_OK) {
+    return NULL;
+  }
+
+  return a;
+}
+
+int
+nc_array_pinit(struct nc_array *a, struct nc_pool *pool, int n, size_t size)
+{
+  NC_ASSERT(n != 0 && size != 0);
+
+  a->elems = nc_palloc(pool, (size_t)n * size);
+  if (a->elems == NULL) {
+    return NC_ENOMEM;
+  }
+
+  a->nelem = 0;
+  a->size = size;
+  a->nalloc = n;
+  a->flags = NC_ARRAY_POOL;
+  a->pool = pool;
+
+  return NC_OK;
+}
+
+// Pool buffers grow like ngx_array_push(): if the buffer ends where the
+// free space of its pool block starts and the block has room, the block's
+// free pointer is bumped and nothing moves. Otherwise a new buffer comes
+// from the pool and the old one is left to the pool (or freed right away
+// if it was a large allocation).
+static int
+array_resize_pool(struct nc_array *a, int nalloc)
+{
+  struct nc_pool *p;
+  u_char *end;
+  size_t grow;
+  void *new_elem;
+
+  end = (u_char *)a->elems + (size_t)a->nalloc * a->size;
+  grow = (size_t)(nalloc - a->nalloc) * a->size;
+
+  for (p = a->pool; p != NULL; p = p->d.next) {
+    if (end == p->d.last) {
+      if ((size_t)(p->d.end - end) >= grow) {
+        p->d.last += grow;
+        a->nalloc = nalloc;
+        return NC_OK;
+      }
+      break;
+    }
+  }
+
+  new_elem = nc_palloc(a->pool, (size_t)nalloc * a->size);
+  if (new_elem == NULL) {
+    return NC_ENOMEM;
+  }
+
+  memcpy(new_elem, a->elems, (size_t)a->nelem * a->size);
+  nc_pfree(a->pool, a->elems);
+
+  a->elems = new_elem;
+  a->nalloc = nalloc;
+
+  return NC_OK;
+}
+
+#if (NC_HAVE_MMAP)
+
+static size_t
+array_map_len(size_t size)
+{
+  size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+
+  return NC_ALIGN(size, pagesize);
+}
+
+#endif
+
+#if (NC_HAVE_MREMAP)
+
+// Large buffers are anonymous mappings: mremap() moves page table entries
+// instead of copying the data, and the kernel hands out fresh pages only
+// as they are touched, so growing never needs old + new size at once.
+// The mapping length is always array_map_len(nalloc * size).
+static int
+array_resize_mmap(struct nc_array *a, int nalloc)
+{
+  void *p;
+  size_t len;
+
+  len = array_map_len((size_t)nalloc * a->size);
+
+  if (a->flags & NC_ARRAY_MMAP) {
+    p = mremap(a->elems, array_map_len((size_t)a->nalloc * a->size), len,
+               MREMAP_MAYMOVE);
+    if (p == MAP_FAILED) {
+      log_error("mremap(%zu) failed", len);
+      return NC_ENOMEM;
+    }
+
+  } else {
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+    if (p == MAP_FAILED) {
+      log_error("mmap(%zu) failed", len);
+      return NC_ENOMEM;
+    }
+
+    memcpy(p, a->elems, (size_t)a->nelem * a->size);
     nc_free(a->elems);
+    a->flags |= NC_ARRAY_MMAP;
+  }
+
+  a->elems = p;
+  a->nalloc = nalloc;
+
+  return NC_OK;
+}
+
+#endif
+
+static int
+array_resize(struct nc_array *a, int nalloc)
+{
+  void *new_elem;
+
+  if (a->flags & NC_ARRAY_MAPFILE) {
+    return NC_ERROR;
   }
-  nc_free(a);
+
+  if (a->flags & NC_ARRAY_POOL) {
+    return array_resize_pool(a, nalloc);
+  }
+
+#if (NC_HAVE_MREMAP)
+  if ((a->flags & NC_ARRAY_MMAP) ||
+      (size_t)nalloc * a->size >= NC_ARRAY_MMAP_THRESHOLD) {
+    return array_resize_mmap(a, nalloc);
+  }
+#endif
+
+  new_elem = nc_realloc(a->elems, (size_t)nalloc * a->size);
+  if (new_elem == NULL) {
+    return NC_ENOMEM;
+  }
+
+  a->elems = new_elem;
+  a->nalloc = nalloc;
+
+  return NC_OK;
+}
+
+void
+nc_array_deinit(struct nc_array *a)
+{
+  if (a->elems == NULL) {
+    return;
+  }
+
+  if (a->flags & NC_ARRAY_POOL) {
+    nc_pfree(a->pool, a->elems);
+    a->elems = NULL;
+    return;
+  }
+
+#if (NC_HAVE_MMAP)
+  if (a->flags & NC_ARRAY_MMAP) {
+    munmap(a->elems, array_map_len((size_t)a->nalloc * a->size));
+    a->elems = NULL;
+    return;
+  }
+
+  if (a->flags & NC_ARRAY_MAPFILE) {
+    munmap((u_char *)a->elems - NC_ARRAY_FILE_HEADER_SIZE,
+           NC_ARRAY_FILE_HEADER_SIZE + (size_t)a->nalloc * a->size);
+    a->elems = NULL;
+    return;
+  }
+#endif
+
+  nc_free(a->elems);
 }
 
 void *
 nc_array_push(struct nc_array *a)
 {
-  void *elem, *new_elem;
-  size_t size;
+  void *elem;
 
   if (a->nelem == a->nalloc) {
-    size = a->size * a->nalloc;
-    new_elem = nc_realloc(a->elems, 2 * size);
-    if (new_elem == NULL) {
+    if (nc_array_reserve(a, 1) != NC_OK) {
       return NULL;
     }
-
-    a->elems = new_elem;
-    a->nalloc *= 2;
   }
 
   elem = (u_char *)a->elems + a->size * a->nelem;
@@ -57,19 +269,10 @@ nc_array_push(struct nc_array *a)
 void *
 nc_array_push_n(struct nc_array *a, int n)
 {
-  void *elem, *new_elem;
-  size_t size;
-  int nalloc;
+  void *elem;
 
-  if (a->nelem + n > a->nalloc) {
-    nalloc = 2 * ((n >= a->nalloc) ? n : a->nalloc);
-    new_elem = nc_realloc(a->elems, nalloc * a->size);
-    if (new_elem == NULL) {
-      return NULL;
-    }
-
-    a->elems = new_elem;
-    a->nalloc = nalloc;
+  if (nc_array_reserve(a, n) != NC_OK) {
+    return NULL;
   }
 
   elem = (u_char *)a->elems + a->size * a->nelem;
@@ -77,3 +280,57 @@ nc_array_push_n(struct nc_array *a, int n)
 
   return elem;
 }
+
+// Makes room for n more elements without changing nelem. The allocation
+// at least doubles, up to INT_MAX elements.
+//
+// Returns NC_OK, NC_ENOMEM, or NC_ERROR if nelem + n would pass INT_MAX.
+int
+nc_array_reserve(struct nc_array *a, int n)
+{
+  size_t nalloc;
+
+  if (n <= a->nalloc - a->nelem) {
+    return NC_OK;
+  }
+
+  if ((size_t)a->nelem + (size_t)n > INT_MAX) {
+    return NC_ERROR;
+  }
+
+  // In size_t: doubling an int count past 1G elements would overflow
+  nalloc = 2 * (size_t)MAX(n, a->nalloc);
+  if (nalloc > INT_MAX) {
+    nalloc = INT_MAX;
+  }
+
+  return array_resize(a, (int)nalloc);
+}
+
+void
+nc_array_sort(struct nc_array *a, nc_sort_cmp_pt cmp)
+{
+  nc_sort(a->elems, (size_t)a->nelem, a->size, cmp);
+}
+
+int
+nc_array_radix_sort(struct nc_array *a, size_t key_offset, size_t key_width)
+{
+  return nc_radix_sort(a->elems, (size_t)a->nelem, a->size, key_offset,
+                       key_width);
+}
+
+int
+nc_array_parallel_sort(struct nc_array *a, nc_sort_cmp_pt cmp, int nthreads)
+{
+  return nc_parallel_sort(a->elems, (size_t)a->nelem, a->size, cmp, nthreads);
+}
+
+// Sorts an array of sds strings, see nc_sort_sds().
+void
+nc_array_sort_sds(struct nc_array *a)
+{
+  NC_ASSERT(a->size == sizeof(sds));
+
+  nc_sort_sds(a->elems, (size_t)a->nelem);
+}
@@ -2,18 +2,68 @@
 #define LIBNC_NC_ARRAY_H_
 
 #include "nc_macros.h"
+#include "nc_sort.h"
+
+// Once an array's storage reaches this many bytes it moves to an anonymous
+// mapping that grows with mremap(2) instead of realloc(3), see
+// nc_array_push(). Only on platforms with mremap.
+#define NC_ARRAY_MMAP_THRESHOLD (1024 * 1024)
+
+// nc_array.flags
+#define NC_ARRAY_MMAP 0x0001    /* elems is an anonymous mapping */
+#define NC_ARRAY_MAPFILE 0x0002 /* elems is a read-only file mapping */
+#define NC_ARRAY_POOL 0x0004    /* elems is allocated from pool */
+
+// Elements in a file written by nc_array_save() start at this offset.
+#define NC_ARRAY_FILE_HEADER_SIZE 64
+
+struct nc_pool;
 
 struct nc_array {
   void *elems;
   int nelem;
   size_t size;
   int nalloc;
+  unsigned flags;
+  struct nc_pool *pool; /* owner of elems if NC_ARRAY_POOL */
 };
 
 struct nc_array *nc_array_create(int n, size_t size);
 void nc_array_destroy(struct nc_array *a);
+void nc_array_deinit(struct nc_array *a);
 void *nc_array_push(struct nc_array *a);
 void *nc_array_push_n(struct nc_array *a, int n);
+int nc_array_reserve(struct nc_array *a, int n);
+
+struct nc_array *nc_array_pcreate(struct nc_pool *pool, int n, size_t size);
+int nc_array_pinit(struct nc_array *a, struct nc_pool *pool, int n,
+                   size_t size);
+
+int nc_array_save(const struct nc_array *a, const char *path);
+struct nc_array *nc_array_map(const char *path);
+int nc_array_map_verify(const struct nc_array *a);
+
+void nc_array_sort(struct nc_array *a, nc_sort_cmp_pt cmp);
+int nc_array_radix_sort(struct nc_array *a, size_t key_offset,
+                        size_t key_width);
+int nc_array_parallel_sort(struct nc_array *a, nc_sort_cmp_pt cmp,
+                           int nthreads);
+void nc_array_sort_sds(struct nc_array *a);
+
+// NC_ARRAY_SORT_DEFINE(name, type, less) generates
+//
+//   static inline void nc_array_sort_<name>(struct nc_array *a);
+//
+// which sorts an array of 'type' elements with the comparison inlined, see
+// NC_SORT_DEFINE() in nc_sort.h.
+#define NC_ARRAY_SORT_DEFINE(name, type, less)                   \
+  NC_SORT_DEFINE(name, type, less)                               \
+                                                                 \
+  static inline void nc_array_sort_##name(struct nc_array *a)    \
+  {                                                              \
+    NC_ASSERT(a->size == sizeof(type));                          \
+    nc_sort_##name((type *)a->elems, (size_t)a->nelem);          \
+  }
 
 static inline int
 nc_array_init(struct nc_array *array, int n, size_t size)
@@ -28,6 +78,8 @@ nc_array_init(struct nc_array *array, int n, size_t size)
   array->nelem = 0;
   array->size = size;
   array->nalloc = n;
+  array->flags = 0;
+  array->pool = NULL;
 
   return NC_OK;
 }
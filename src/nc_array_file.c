@@ -0,0 +1,389 @@
+#include "nc_array.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>  // _commit
+#endif
+
+#if !defined(NC_HAVE_MMAP) && !defined(_WIN32)
+#define NC_HAVE_MMAP 1
+#endif
+
+#if (NC_HAVE_MMAP)
+#include <sys/mman.h>
+#endif
+
+//
+// File layout: a NC_ARRAY_FILE_HEADER_SIZE byte header followed by the raw
+// elements in native byte order. A file written on a machine with the
+// other byte order fails the magic check.
+//
+
+#define ARRAY_FILE_MAGIC 0x5241434eU /* "NCAR" */
+#define ARRAY_FILE_VERSION 1
+
+struct array_file_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;     /* element size */
+  uint64_t nelem;    /* number of elements */
+  uint64_t checksum; /* array_checksum() of the elements */
+  u_char reserved[NC_ARRAY_FILE_HEADER_SIZE - 32];
+};
+
+// FNV-1a over 64-bit words, four interleaved lanes so the multiplies
+// overlap, folded together at the end.
+static uint64_t
+array_checksum(const void *data, size_t len)
+{
+  const uint64_t prime = 0x100000001b3ULL;
+  uint64_t h[4], w;
+  const u_char *p = data;
+  size_t i;
+  int k;
+
+  for (k = 0; k < 4; k++) {
+    h[k] = 0xcbf29ce484222325ULL + (uint64_t)k;
+  }
+
+  for (i = 0; i + 32 <= len; i += 32) {
+    for (k = 0; k < 4; k++) {
+      memcpy(&w, p + i + 8 * k, 8);
+      h[k] = (h[k] ^ w) * prime;
+    }
+  }
+
+  for (; i < len; i++) {
+    h[0] = (h[0] ^ p[i]) * prime;
+  }
+
+  for (k = 1; k < 4; k++) {
+    h[0] = (h[0] ^ h[k]) * prime;
+  }
+
+  return h[0] ^ (uint64_t)len;
+}
+
+static int
+array_header_check(const struct array_file_header *hdr, size_t file_size)
+{
+  if (hdr->magic != ARRAY_FILE_MAGIC || hdr->version != ARRAY_FILE_VERSION) {
+    return NC_ERROR;
+  }
+
+  // The file holds exactly nelem elements, deinit relies on it to unmap
+  if (hdr->size == 0 || hdr->nelem > 0x7fffffff ||
+      hdr->nelem != (file_size - sizeof(*hdr)) / hdr->size ||
+      (file_size - sizeof(*hdr)) % hdr->size != 0) {
+    return NC_ERROR;
+  }
+
+  return NC_OK;
+}
+
+#if !defined(_WIN32)
+
+static pthread_once_t array_umask_once = PTHREAD_ONCE_INIT;
+static mode_t array_umask_value;
+
+// umask() can only be read by setting it, which briefly changes it for
+// every thread, so Linux's /proc copy is preferred and the result kept.
+static void
+array_umask_init(void)
+{
+  char line[64];
+  unsigned mask;
+  FILE *fp;
+
+  fp = fopen("/proc/self/status", "r");
+  if (fp != NULL) {
+    while (fgets(line, sizeof(line), fp) != NULL) {
+      if (sscanf(line, "Umask: %o", &mask) == 1) {
+        array_umask_value = (mode_t)mask;
+        fclose(fp);
+        return;
+      }
+    }
+    fclose(fp);
+  }
+
+  array_umask_value = umask(022);
+  umask(array_umask_value);
+}
+
+static mode_t
+array_umask(void)
+{
+  pthread_once(&array_umask_once, array_umask_init);
+  return array_umask_value;
+}
+
+#endif
+
+// Flushes the file's data to the disk
+static int
+array_sync(FILE *fp)
+{
+#if defined(_WIN32)
+  return _commit(_fileno(fp));
+#else
+  return fsync(fileno(fp));
+#endif
+}
+
+// Writes the array to 'path'. The data goes to a fresh temporary file next
+// to 'path', which is synced to disk and renamed over 'path', so processes
+// that have the old file mapped keep seeing consistent contents and a
+// crash leaves either the old file or the complete new one.
+//
+// Returns NC_OK, NC_ENOMEM, or NC_ERROR on I/O errors.
+int
+nc_array_save(const struct nc_array *a, const char *path)
+{
+  struct array_file_header hdr;
+  size_t len, plen;
+  char *tmp;
+  FILE *fp;
+  int status;
+#if !defined(_WIN32)
+  int fd;
+#endif
+
+  NC_ASSERT(sizeof(hdr) == NC_ARRAY_FILE_HEADER_SIZE);
+
+  len = (size_t)a->nelem * a->size;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = ARRAY_FILE_MAGIC;
+  hdr.version = ARRAY_FILE_VERSION;
+  hdr.size = a->size;
+  hdr.nelem = (uint64_t)a->nelem;
+  hdr.checksum = array_checksum(a->elems, len);
+
+  plen = strlen(path);
+  tmp = nc_alloc(plen + sizeof(".XXXXXX"));
+  if (tmp == NULL) {
+    return NC_ENOMEM;
+  }
+  memcpy(tmp, path, plen);
+  memcpy(tmp + plen, ".XXXXXX", sizeof(".XXXXXX"));
+
+#if !defined(_WIN32)
+  // A unique name, so concurrent saves to the same path can't interleave
+  fd = mkstemp(tmp);
+  if (fd < 0) {
+    log_error("mkstemp '%s' failed", tmp);
+    nc_free(tmp);
+    return NC_ERROR;
+  }
+
+  // mkstemp() creates the file 0600, give it what open() would have
+  if (fchmod(fd, 0666 & ~array_umask()) != 0) {
+    log_error("fchmod '%s' failed", tmp);
+    close(fd);
+    remove(tmp);
+    nc_free(tmp);
+    return NC_ERROR;
+  }
+
+  fp = fdopen(fd, "wb");
+  if (fp == NULL) {
+    close(fd);
+  }
+#else
+  fp = fopen(mktemp(tmp), "wb");
+#endif
+  if (fp == NULL) {
+    log_error("fopen '%s' failed", tmp);
+    remove(tmp);
+    nc_free(tmp);
+    return NC_ERROR;
+  }
+
+  status = NC_OK;
+  if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+      (len != 0 && fwrite(a->elems, len, 1, fp) != 1) || fflush(fp) != 0) {
+    log_error("write '%s' failed", tmp);
+    status = NC_ERROR;
+  }
+
+  // Without this a crash after the rename can leave 'path' empty
+  if (status == NC_OK && array_sync(fp) != 0) {
+    log_error("fsync '%s' failed", tmp);
+    status = NC_ERROR;
+  }
+
+  if (fclose(fp) != 0) {
+    status = NC_ERROR;
+  }
+
+  if (status == NC_OK) {
+#if defined(_WIN32)
+    remove(path);
+#endif
+    if (rename(tmp, path) != 0) {
+      log_error("rename '%s' failed", tmp);
+      status = NC_ERROR;
+    }
+  }
+
+  if (status != NC_OK) {
+    remove(tmp);
+  }
+
+  nc_free(tmp);
+
+  return status;
+}
+
+#if (NC_HAVE_MMAP)
+
+// Maps a file written by nc_array_save(). The returned array is backed by
+// a shared read-only mapping of the file: nothing is read or copied up
+// front, pages come from the page cache on first touch and are shared
+// between processes mapping the same file. The elements must not be
+// written and nc_array_push() on the array fails. Release it with
+// nc_array_destroy().
+//
+// The header is validated, the checksum is not, see nc_array_map_verify().
+//
+// Returns NULL if the file can't be opened or mapped or is not an array
+// file.
+struct nc_array *
+nc_array_map(const char *path)
+{
+  struct array_file_header *hdr;
+  struct nc_array *a;
+  struct stat st;
+  u_char *p;
+  size_t len;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    log_error("open '%s' failed", path);
+    return NULL;
+  }
+
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*hdr)) {
+    close(fd);
+    return NULL;
+  }
+
+  len = (size_t)st.st_size;
+  p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    log_error("mmap '%s' failed", path);
+    return NULL;
+  }
+
+  hdr = (struct array_file_header *)p;
+  if (array_header_check(hdr, len) != NC_OK) {
+    log_error("'%s' is not an array file", path);
+    munmap(p, len);
+    return NULL;
+  }
+
+  a = nc_alloc(sizeof(*a));
+  if (a == NULL) {
+    munmap(p, len);
+    return NULL;
+  }
+
+  a->elems = p + NC_ARRAY_FILE_HEADER_SIZE;
+  a->nelem = (int)hdr->nelem;
+  a->size = (size_t)hdr->size;
+  a->nalloc = a->nelem;
+  a->flags = NC_ARRAY_MAPFILE;
+  a->pool = NULL;
+
+  return a;
+}
+
+// Checks the elements of an array returned by nc_array_map() against the
+// checksum in its file header. This reads the whole file.
+//
+// Returns NC_OK if they match, NC_ERROR otherwise.
+int
+nc_array_map_verify(const struct nc_array *a)
+{
+  const struct array_file_header *hdr;
+
+  if (!(a->flags & NC_ARRAY_MAPFILE)) {
+    return NC_OK;
+  }
+
+  hdr = (const struct array_file_header *)((const u_char *)a->elems -
+                                           NC_ARRAY_FILE_HEADER_SIZE);
+
+  if (hdr->checksum != array_checksum(a->elems, (size_t)a->nelem * a->size)) {
+    return NC_ERROR;
+  }
+
+  return NC_OK;
+}
+
+#else
+
+// Without mmap the file is read into an ordinary array and checked right
+// away, nc_array_map_verify() has nothing left to do.
+struct nc_array *
+nc_array_map(const char *path)
+{
+  struct array_file_header hdr;
+  struct nc_array *a;
+  size_t len;
+  long size;
+  FILE *fp;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL) {
+    log_error("fopen '%s' failed", path);
+    return NULL;
+  }
+
+  if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+      (size_t)size < sizeof(hdr) || fseek(fp, 0, SEEK_SET) != 0 ||
+      fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+      array_header_check(&hdr, (size_t)size) != NC_OK) {
+    fclose(fp);
+    return NULL;
+  }
+
+  a = nc_array_create(hdr.nelem > 0 ? (int)hdr.nelem : 1, (size_t)hdr.size);
+  if (a == NULL) {
+    fclose(fp);
+    return NULL;
+  }
+
+  len = (size_t)hdr.nelem * hdr.size;
+  if ((len != 0 && fread(a->elems, len, 1, fp) != 1) ||
+      hdr.checksum != array_checksum(a->elems, len)) {
+    fclose(fp);
+    nc_array_destroy(a);
+    return NULL;
+  }
+
+  fclose(fp);
+  a->nelem = (int)hdr.nelem;
+
+  return a;
+}
+
+int
+nc_array_map_verify(const struct nc_array *a)
+{
+  (void)a;
+  return NC_OK;
+}
+
+#endif
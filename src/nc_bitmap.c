@@ -0,0 +1,1123 @@
+#include "nc_bitmap.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "nc_cpu.h"
+
+#if (NC_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+typedef struct nc_bitmap_container container_t;
+
+struct bitmap_run {
+  uint16_t start;
+  uint16_t len; /* number of values - 1 */
+};
+
+#define BITMAP_OP_AND 0
+#define BITMAP_OP_OR 1
+#define BITMAP_OP_ANDNOT 2
+#define BITMAP_OP_XOR 3
+
+#define BITSET_BYTES (NC_BITMAP_BITSET_WORDS * sizeof(uint64_t))
+
+#define bitmap_container(_b, _i) \
+  ((container_t *)(_b)->containers.elems + (_i))
+
+static inline int
+popcount64(uint64_t w)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll(w);
+#else
+  w = w - ((w >> 1) & 0x5555555555555555ULL);
+  w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+  w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int)((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static inline int
+ctz64(uint64_t w)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(w);
+#else
+  int n = 0;
+
+  while (!(w & 1)) {
+    w >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+//
+// Bitset kernels: dst = a op b over a whole container, returning the
+// cardinality of dst.
+//
+
+#define BITSET_OP_LOOP(_expr)                           \
+  for (i = 0; i < NC_BITMAP_BITSET_WORDS; i++) {        \
+    dst[i] = (_expr);                                   \
+    card += popcount64(dst[i]);                         \
+  }
+
+static int
+bitset_op_scalar(uint64_t *dst, const uint64_t *a, const uint64_t *b, int op)
+{
+  int i, card = 0;
+
+  switch (op) {
+  case BITMAP_OP_AND:
+    BITSET_OP_LOOP(a[i] & b[i]);
+    break;
+  case BITMAP_OP_OR:
+    BITSET_OP_LOOP(a[i] | b[i]);
+    break;
+  case BITMAP_OP_ANDNOT:
+    BITSET_OP_LOOP(a[i] & ~b[i]);
+    break;
+  default:
+    BITSET_OP_LOOP(a[i] ^ b[i]);
+    break;
+  }
+
+  return card;
+}
+
+#if (NC_HAVE_X86_SIMD)
+
+// Same loops, compiled so popcount64() becomes the popcnt instruction.
+NC_TARGET("popcnt")
+static int
+bitset_op_popcnt(uint64_t *dst, const uint64_t *a, const uint64_t *b, int op)
+{
+  int i, card = 0;
+
+  switch (op) {
+  case BITMAP_OP_AND:
+    BITSET_OP_LOOP(a[i] & b[i]);
+    break;
+  case BITMAP_OP_OR:
+    BITSET_OP_LOOP(a[i] | b[i]);
+    break;
+  case BITMAP_OP_ANDNOT:
+    BITSET_OP_LOOP(a[i] & ~b[i]);
+    break;
+  default:
+    BITSET_OP_LOOP(a[i] ^ b[i]);
+    break;
+  }
+
+  return card;
+}
+
+// Vector popcount: per-nibble lookup with vpshufb, bytes summed with
+// vpsadbw into four 64-bit counters.
+NC_TARGET("avx2")
+static inline __m256i
+bitset_popcnt256(__m256i v)
+{
+  const __m256i lookup =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1,
+                       1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i lo, hi, cnt;
+
+  lo = _mm256_and_si256(v, low);
+  hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+  cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                        _mm256_shuffle_epi8(lookup, hi));
+
+  return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+NC_TARGET("avx2")
+static inline int
+bitset_sum256(__m256i acc)
+{
+  uint64_t lanes[4];
+
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+
+  return (int)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+#define BITSET_OP_LOOP_AVX2(_expr)                                  \
+  for (i = 0; i < NC_BITMAP_BITSET_WORDS; i += 4) {                 \
+    va = _mm256_loadu_si256((const __m256i *)(a + i));              \
+    vb = _mm256_loadu_si256((const __m256i *)(b + i));              \
+    vr = (_expr);                                                   \
+    _mm256_storeu_si256((__m256i *)(dst + i), vr);                  \
+    acc = _mm256_add_epi64(acc, bitset_popcnt256(vr));              \
+  }
+
+NC_TARGET("avx2")
+static int
+bitset_op_avx2(uint64_t *dst, const uint64_t *a, const uint64_t *b, int op)
+{
+  __m256i va, vb, vr, acc;
+  int i;
+
+  acc = _mm256_setzero_si256();
+
+  switch (op) {
+  case BITMAP_OP_AND:
+    BITSET_OP_LOOP_AVX2(_mm256_and_si256(va, vb));
+    break;
+  case BITMAP_OP_OR:
+    BITSET_OP_LOOP_AVX2(_mm256_or_si256(va, vb));
+    break;
+  case BITMAP_OP_ANDNOT:
+    BITSET_OP_LOOP_AVX2(_mm256_andnot_si256(vb, va));
+    break;
+  default:
+    BITSET_OP_LOOP_AVX2(_mm256_xor_si256(va, vb));
+    break;
+  }
+
+  return bitset_sum256(acc);
+}
+
+#endif  // NC_HAVE_X86_SIMD
+
+static int (*bitset_op)(uint64_t *dst, const uint64_t *a, const uint64_t *b,
+                        int op) = bitset_op_scalar;
+
+static pthread_once_t bitmap_once = PTHREAD_ONCE_INIT;
+
+static void
+bitmap_init_kernels(void)
+{
+#if (NC_HAVE_X86_SIMD)
+  unsigned features = nc_cpu_features();
+
+  if (features & NC_CPU_POPCNT) {
+    bitset_op = bitset_op_popcnt;
+  }
+
+  if (features & NC_CPU_AVX2) {
+    bitset_op = bitset_op_avx2;
+  }
+#endif
+}
+
+//
+// Containers
+//
+
+static void
+container_free(container_t *c)
+{
+  if (c->data != NULL) {
+    nc_free(c->data);
+  }
+}
+
+static int
+container_init_array(container_t *c, uint16_t key, int cap)
+{
+  c->data = nc_alloc((size_t)cap * sizeof(uint16_t));
+  if (c->data == NULL) {
+    return NC_ENOMEM;
+  }
+
+  c->key = key;
+  c->type = NC_BITMAP_ARRAY;
+  c->card = 0;
+  c->n = 0;
+  c->cap = cap;
+
+  return NC_OK;
+}
+
+static int
+container_init_bitset(container_t *c, uint16_t key)
+{
+  c->data = nc_zalloc(BITSET_BYTES);
+  if (c->data == NULL) {
+    return NC_ENOMEM;
+  }
+
+  c->key = key;
+  c->type = NC_BITMAP_BITSET;
+  c->card = 0;
+  c->n = 0;
+  c->cap = 0;
+
+  return NC_OK;
+}
+
+static int
+container_copy(container_t *dst, const container_t *src)
+{
+  size_t len;
+
+  switch (src->type) {
+  case NC_BITMAP_ARRAY:
+    len = (size_t)src->n * sizeof(uint16_t);
+    break;
+  case NC_BITMAP_RUN:
+    len = (size_t)src->n * sizeof(struct bitmap_run);
+    break;
+  default:
+    len = BITSET_BYTES;
+    break;
+  }
+
+  *dst = *src;
+  dst->cap = src->type == NC_BITMAP_BITSET ? 0 : src->n;
+
+  dst->data = nc_alloc(len > 0 ? len : 1);
+  if (dst->data == NULL) {
+    return NC_ENOMEM;
+  }
+  memcpy(dst->data, src->data, len);
+
+  return NC_OK;
+}
+
+// Expands any container into a bitset in 'words'.
+static void
+container_fill_words(const container_t *c, uint64_t *words)
+{
+  const uint16_t *v;
+  const struct bitmap_run *r;
+  uint32_t x, end;
+  int i;
+
+  switch (c->type) {
+  case NC_BITMAP_BITSET:
+    memcpy(words, c->data, BITSET_BYTES);
+    break;
+
+  case NC_BITMAP_ARRAY:
+    memset(words, 0, BITSET_BYTES);
+    for (i = 0, v = c->data; i < c->n; i++) {
+      words[v[i] >> 6] |= (uint64_t)1 << (v[i] & 63);
+    }
+    break;
+
+  default:
+    memset(words, 0, BITSET_BYTES);
+    for (i = 0, r = c->data; i < c->n; i++) {
+      end = (uint32_t)r[i].start + r[i].len;
+      for (x = r[i].start; x <= end; x++) {
+        words[x >> 6] |= (uint64_t)1 << (x & 63);
+      }
+    }
+    break;
+  }
+}
+
+// Returns the container's values as a bitset, using 'scratch' unless the
+// container already is one.
+static const uint64_t *
+container_words(const container_t *c, uint64_t *scratch)
+{
+  if (c->type == NC_BITMAP_BITSET) {
+    return c->data;
+  }
+
+  container_fill_words(c, scratch);
+
+  return scratch;
+}
+
+// Turns a bitset container with card <= NC_BITMAP_ARRAY_MAX into an array.
+static int
+container_bitset_to_array(container_t *c)
+{
+  uint64_t *words = c->data, w;
+  uint16_t *v;
+  int i, n;
+
+  v = nc_alloc((size_t)(c->card > 0 ? c->card : 1) * sizeof(uint16_t));
+  if (v == NULL) {
+    return NC_ENOMEM;
+  }
+
+  for (i = 0, n = 0; i < NC_BITMAP_BITSET_WORDS; i++) {
+    for (w = words[i]; w != 0; w &= w - 1) {
+      v[n++] = (uint16_t)(i * 64 + ctz64(w));
+    }
+  }
+
+  nc_free(c->data);
+  c->data = v;
+  c->type = NC_BITMAP_ARRAY;
+  c->n = n;
+  c->cap = n > 0 ? n : 1;
+
+  return NC_OK;
+}
+
+// Turns any container into a bitset.
+static int
+container_to_bitset(container_t *c)
+{
+  uint64_t *words;
+
+  if (c->type == NC_BITMAP_BITSET) {
+    return NC_OK;
+  }
+
+  words = nc_alloc(BITSET_BYTES);
+  if (words == NULL) {
+    return NC_ENOMEM;
+  }
+
+  container_fill_words(c, words);
+
+  nc_free(c->data);
+  c->data = words;
+  c->type = NC_BITMAP_BITSET;
+  c->n = 0;
+  c->cap = 0;
+
+  return NC_OK;
+}
+
+// Turns a run container into whatever the set/clear paths work on.
+static int
+container_unrun(container_t *c)
+{
+  if (c->type != NC_BITMAP_RUN) {
+    return NC_OK;
+  }
+
+  if (container_to_bitset(c) != NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  if (c->card <= NC_BITMAP_ARRAY_MAX) {
+    return container_bitset_to_array(c);
+  }
+
+  return NC_OK;
+}
+
+// Index of the first array value >= x.
+static int
+array_lower_bound(const uint16_t *v, int n, uint16_t x)
+{
+  int lo = 0, hi = n, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) >> 1;
+    if (v[mid] < x) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+static int
+container_contains(const container_t *c, uint16_t x)
+{
+  const uint16_t *v;
+  const struct bitmap_run *r;
+  int lo, hi, mid;
+
+  switch (c->type) {
+  case NC_BITMAP_BITSET:
+    return (((const uint64_t *)c->data)[x >> 6] >> (x & 63)) & 1;
+
+  case NC_BITMAP_ARRAY:
+    v = c->data;
+    lo = array_lower_bound(v, c->n, x);
+    return lo < c->n && v[lo] == x;
+
+  default:
+    // Last run starting at or before x
+    r = c->data;
+    lo = 0;
+    hi = c->n;
+    while (lo < hi) {
+      mid = (lo + hi) >> 1;
+      if (r[mid].start <= x) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo > 0 && x <= (uint32_t)r[lo - 1].start + r[lo - 1].len;
+  }
+}
+
+// Returns 1 if x was added, 0 if it was there already, or NC_ENOMEM.
+static int
+container_add(container_t *c, uint16_t x)
+{
+  uint64_t *words, bit;
+  uint16_t *v;
+  int i, cap;
+
+  if (container_unrun(c) != NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  if (c->type == NC_BITMAP_ARRAY) {
+    v = c->data;
+    i = array_lower_bound(v, c->n, x);
+    if (i < c->n && v[i] == x) {
+      return 0;
+    }
+
+    if (c->n == NC_BITMAP_ARRAY_MAX) {
+      if (container_to_bitset(c) != NC_OK) {
+        return NC_ENOMEM;
+      }
+      return container_add(c, x);
+    }
+
+    if (c->n == c->cap) {
+      cap = MIN(2 * c->cap, NC_BITMAP_ARRAY_MAX);
+      v = nc_realloc(c->data, (size_t)cap * sizeof(uint16_t));
+      if (v == NULL) {
+        return NC_ENOMEM;
+      }
+      c->data = v;
+      c->cap = cap;
+    }
+
+    memmove(v + i + 1, v + i, (size_t)(c->n - i) * sizeof(uint16_t));
+    v[i] = x;
+    c->n++;
+    c->card++;
+
+    return 1;
+  }
+
+  words = c->data;
+  bit = (uint64_t)1 << (x & 63);
+  if (words[x >> 6] & bit) {
+    return 0;
+  }
+  words[x >> 6] |= bit;
+  c->card++;
+
+  return 1;
+}
+
+// Returns 1 if x was removed, 0 if it was not there, or NC_ENOMEM.
+static int
+container_remove(container_t *c, uint16_t x)
+{
+  uint64_t *words, bit;
+  uint16_t *v;
+  int i;
+
+  if (!container_contains(c, x)) {
+    return 0;
+  }
+
+  if (container_unrun(c) != NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  if (c->type == NC_BITMAP_ARRAY) {
+    v = c->data;
+    i = array_lower_bound(v, c->n, x);
+    memmove(v + i, v + i + 1, (size_t)(c->n - i - 1) * sizeof(uint16_t));
+    c->n--;
+    c->card--;
+
+    return 1;
+  }
+
+  words = c->data;
+  bit = (uint64_t)1 << (x & 63);
+  words[x >> 6] &= ~bit;
+  c->card--;
+
+  // Hysteresis: only go back to an array well below the switch point so
+  // a container hovering around it doesn't flip on every call.
+  if (c->card <= NC_BITMAP_ARRAY_MAX / 2) {
+    if (container_bitset_to_array(c) != NC_OK) {
+      return NC_ENOMEM;
+    }
+  }
+
+  return 1;
+}
+
+//
+// Bitmap
+//
+
+struct nc_bitmap *
+nc_bitmap_create(void)
+{
+  struct nc_bitmap *b;
+
+  pthread_once(&bitmap_once, bitmap_init_kernels);
+
+  b = nc_alloc(sizeof(*b));
+  if (b == NULL) {
+    return NULL;
+  }
+
+  if (nc_array_init(&b->containers, 4, sizeof(container_t)) != NC_OK) {
+    nc_free(b);
+    return NULL;
+  }
+
+  return b;
+}
+
+void
+nc_bitmap_destroy(struct nc_bitmap *b)
+{
+  int i;
+
+  for (i = 0; i < b->containers.nelem; i++) {
+    container_free(bitmap_container(b, i));
+  }
+  nc_array_deinit(&b->containers);
+  nc_free(b);
+}
+
+// Returns the index of the container with 'key', or -(insertion point) - 1.
+static int
+bitmap_find(const struct nc_bitmap *b, uint16_t key)
+{
+  const container_t *c = b->containers.elems;
+  int lo = 0, hi = b->containers.nelem, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) >> 1;
+    if (c[mid].key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo < b->containers.nelem && c[lo].key == key) {
+    return lo;
+  }
+
+  return -lo - 1;
+}
+
+// Inserts an uninitialized container slot at index i.
+static container_t *
+bitmap_insert_at(struct nc_bitmap *b, int i)
+{
+  container_t *c;
+
+  if (nc_array_push(&b->containers) == NULL) {
+    return NULL;
+  }
+
+  c = bitmap_container(b, i);
+  memmove(c + 1, c, (size_t)(b->containers.nelem - 1 - i) * sizeof(*c));
+
+  return c;
+}
+
+static void
+bitmap_remove_at(struct nc_bitmap *b, int i)
+{
+  container_t *c = bitmap_container(b, i);
+
+  container_free(c);
+  memmove(c, c + 1, (size_t)(b->containers.nelem - 1 - i) * sizeof(*c));
+  b->containers.nelem--;
+}
+
+// Returns NC_OK or NC_ENOMEM.
+int
+nc_bitmap_set(struct nc_bitmap *b, uint32_t value)
+{
+  container_t *c;
+  uint16_t key = (uint16_t)(value >> 16);
+  int i;
+
+  i = bitmap_find(b, key);
+  if (i < 0) {
+    i = -i - 1;
+    c = bitmap_insert_at(b, i);
+    if (c == NULL) {
+      return NC_ENOMEM;
+    }
+    if (container_init_array(c, key, 4) != NC_OK) {
+      c->data = NULL;
+      bitmap_remove_at(b, i);
+      return NC_ENOMEM;
+    }
+  }
+
+  c = bitmap_container(b, i);
+  if (container_add(c, (uint16_t)value) < 0) {
+    // Don't leave the container inserted above behind empty
+    if (c->card == 0) {
+      bitmap_remove_at(b, i);
+    }
+    return NC_ENOMEM;
+  }
+
+  return NC_OK;
+}
+
+// Returns NC_OK (also if the value was not set) or NC_ENOMEM.
+int
+nc_bitmap_clear(struct nc_bitmap *b, uint32_t value)
+{
+  container_t *c;
+  int i;
+
+  i = bitmap_find(b, (uint16_t)(value >> 16));
+  if (i < 0) {
+    return NC_OK;
+  }
+
+  c = bitmap_container(b, i);
+  if (container_remove(c, (uint16_t)value) < 0) {
+    return NC_ENOMEM;
+  }
+
+  if (c->card == 0) {
+    bitmap_remove_at(b, i);
+  }
+
+  return NC_OK;
+}
+
+int
+nc_bitmap_test(const struct nc_bitmap *b, uint32_t value)
+{
+  int i;
+
+  i = bitmap_find(b, (uint16_t)(value >> 16));
+  if (i < 0) {
+    return 0;
+  }
+
+  return container_contains(bitmap_container(b, i), (uint16_t)value);
+}
+
+uint64_t
+nc_bitmap_cardinality(const struct nc_bitmap *b)
+{
+  uint64_t card = 0;
+  int i;
+
+  for (i = 0; i < b->containers.nelem; i++) {
+    card += (uint64_t)bitmap_container(b, i)->card;
+  }
+
+  return card;
+}
+
+// Calls fn for every value in increasing order until it returns non-zero.
+// Returns the non-zero value that stopped the iteration, or 0.
+int
+nc_bitmap_iterate(const struct nc_bitmap *b, nc_bitmap_iter_pt fn, void *ctx)
+{
+  const container_t *c;
+  const uint16_t *v;
+  const uint64_t *words;
+  const struct bitmap_run *r;
+  uint64_t w;
+  uint32_t high, x, end;
+  int i, j, rc;
+
+  for (i = 0; i < b->containers.nelem; i++) {
+    c = bitmap_container(b, i);
+    high = (uint32_t)c->key << 16;
+
+    switch (c->type) {
+    case NC_BITMAP_ARRAY:
+      for (j = 0, v = c->data; j < c->n; j++) {
+        if ((rc = fn(high | v[j], ctx)) != 0) {
+          return rc;
+        }
+      }
+      break;
+
+    case NC_BITMAP_BITSET:
+      for (j = 0, words = c->data; j < NC_BITMAP_BITSET_WORDS; j++) {
+        for (w = words[j]; w != 0; w &= w - 1) {
+          if ((rc = fn(high | (uint32_t)(j * 64 + ctz64(w)), ctx)) != 0) {
+            return rc;
+          }
+        }
+      }
+      break;
+
+    default:
+      for (j = 0, r = c->data; j < c->n; j++) {
+        end = (uint32_t)r[j].start + r[j].len;
+        for (x = r[j].start; x <= end; x++) {
+          if ((rc = fn(high | x, ctx)) != 0) {
+            return rc;
+          }
+        }
+      }
+      break;
+    }
+  }
+
+  return 0;
+}
+
+// Counts the runs of consecutive values in a container.
+static int
+container_count_runs(const container_t *c)
+{
+  const uint16_t *v;
+  const uint64_t *words;
+  uint64_t w, next;
+  int i, runs;
+
+  switch (c->type) {
+  case NC_BITMAP_ARRAY:
+    v = c->data;
+    for (i = 0, runs = 0; i < c->n; i++) {
+      if (i == 0 || v[i] != v[i - 1] + 1) {
+        runs++;
+      }
+    }
+    return runs;
+
+  case NC_BITMAP_BITSET:
+    // A run starts at every set bit whose lower neighbour is clear
+    words = c->data;
+    for (i = 0, runs = 0; i < NC_BITMAP_BITSET_WORDS; i++) {
+      w = words[i];
+      next = (w << 1) | (i > 0 ? words[i - 1] >> 63 : 0);
+      runs += popcount64(w & ~next);
+    }
+    return runs;
+
+  default:
+    return c->n;
+  }
+}
+
+static int
+container_to_runs(container_t *c, int nruns)
+{
+  struct bitmap_run *r;
+  uint64_t *words;
+  uint32_t x;
+  int n, in;
+
+  words = nc_alloc(BITSET_BYTES);
+  if (words == NULL) {
+    return NC_ENOMEM;
+  }
+  container_fill_words(c, words);
+
+  r = nc_alloc((size_t)nruns * sizeof(*r));
+  if (r == NULL) {
+    nc_free(words);
+    return NC_ENOMEM;
+  }
+
+  for (x = 0, n = 0, in = 0; x < 65536; x++) {
+    if ((words[x >> 6] >> (x & 63)) & 1) {
+      if (!in) {
+        r[n].start = (uint16_t)x;
+        in = 1;
+      }
+      r[n].len = (uint16_t)(x - r[n].start);
+
+    } else if (in) {
+      n++;
+      in = 0;
+    }
+  }
+  n += in;
+
+  NC_ASSERT(n == nruns);
+
+  nc_free(words);
+  nc_free(c->data);
+  c->data = r;
+  c->type = NC_BITMAP_RUN;
+  c->n = n;
+  c->cap = n;
+
+  return NC_OK;
+}
+
+// Converts every container to the smallest of its three encodings. Worth
+// calling on bitmaps that are built once and then mostly read.
+int
+nc_bitmap_optimize(struct nc_bitmap *b)
+{
+  container_t *c;
+  size_t run_bytes, other_bytes;
+  int i, runs;
+
+  for (i = 0; i < b->containers.nelem; i++) {
+    c = bitmap_container(b, i);
+    if (c->type == NC_BITMAP_RUN) {
+      continue;
+    }
+
+    runs = container_count_runs(c);
+    run_bytes = (size_t)runs * sizeof(struct bitmap_run);
+    other_bytes = c->type == NC_BITMAP_ARRAY
+                      ? (size_t)c->card * sizeof(uint16_t)
+                      : BITSET_BYTES;
+
+    if (run_bytes < other_bytes) {
+      if (container_to_runs(c, runs) != NC_OK) {
+        return NC_ENOMEM;
+      }
+    }
+  }
+
+  return NC_OK;
+}
+
+//
+// Binary operations
+//
+
+// Merge of two sorted arrays into out (room for na + nb values).
+static int
+array_op(uint16_t *out, const uint16_t *a, int na, const uint16_t *b, int nb,
+         int op)
+{
+  int i = 0, j = 0, n = 0;
+
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      if (op != BITMAP_OP_AND) {
+        out[n++] = a[i];
+      }
+      i++;
+
+    } else if (a[i] > b[j]) {
+      if (op == BITMAP_OP_OR || op == BITMAP_OP_XOR) {
+        out[n++] = b[j];
+      }
+      j++;
+
+    } else {
+      if (op == BITMAP_OP_AND || op == BITMAP_OP_OR) {
+        out[n++] = a[i];
+      }
+      i++;
+      j++;
+    }
+  }
+
+  if (op != BITMAP_OP_AND) {
+    while (i < na) {
+      out[n++] = a[i++];
+    }
+  }
+
+  if (op == BITMAP_OP_OR || op == BITMAP_OP_XOR) {
+    while (j < nb) {
+      out[n++] = b[j++];
+    }
+  }
+
+  return n;
+}
+
+// Keeps the values of array 'a' whose bit in 'words' is set (keep = 1) or
+// clear (keep = 0).
+static int
+array_filter(uint16_t *out, const uint16_t *a, int na, const uint64_t *words,
+             int keep)
+{
+  int i, n;
+
+  for (i = 0, n = 0; i < na; i++) {
+    if ((int)((words[a[i] >> 6] >> (a[i] & 63)) & 1) == keep) {
+      out[n++] = a[i];
+    }
+  }
+
+  return n;
+}
+
+// Sets up dst as an array or bitset container holding the n sorted values.
+static int
+container_from_values(container_t *dst, uint16_t key, const uint16_t *v,
+                      int n)
+{
+  uint64_t *words;
+  int i;
+
+  if (n <= NC_BITMAP_ARRAY_MAX) {
+    if (container_init_array(dst, key, n > 0 ? n : 1) != NC_OK) {
+      return NC_ENOMEM;
+    }
+    memcpy(dst->data, v, (size_t)n * sizeof(uint16_t));
+    dst->n = n;
+    dst->card = n;
+    return NC_OK;
+  }
+
+  if (container_init_bitset(dst, key) != NC_OK) {
+    return NC_ENOMEM;
+  }
+  for (i = 0, words = dst->data; i < n; i++) {
+    words[v[i] >> 6] |= (uint64_t)1 << (v[i] & 63);
+  }
+  dst->card = n;
+
+  return NC_OK;
+}
+
+// dst = a op b for two containers with the same key. dst may come out
+// empty, the caller drops it then.
+static int
+container_op(container_t *dst, const container_t *a, const container_t *b,
+             int op, uint64_t *scratch)
+{
+  uint16_t out[2 * NC_BITMAP_ARRAY_MAX];
+  const uint64_t *wa, *wb;
+  int n;
+
+  if (a->type == NC_BITMAP_ARRAY && b->type == NC_BITMAP_ARRAY) {
+    n = array_op(out, a->data, a->n, b->data, b->n, op);
+    return container_from_values(dst, a->key, out, n);
+  }
+
+  // An array filtered by the other side's bits stays an array
+  if (a->type == NC_BITMAP_ARRAY &&
+      (op == BITMAP_OP_AND || op == BITMAP_OP_ANDNOT)) {
+    wb = container_words(b, scratch);
+    n = array_filter(out, a->data, a->n, wb, op == BITMAP_OP_AND);
+    return container_from_values(dst, a->key, out, n);
+  }
+
+  if (b->type == NC_BITMAP_ARRAY && op == BITMAP_OP_AND) {
+    wa = container_words(a, scratch);
+    n = array_filter(out, b->data, b->n, wa, 1);
+    return container_from_values(dst, a->key, out, n);
+  }
+
+  // Everything else runs over full bitsets
+  if (container_init_bitset(dst, a->key) != NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  wa = container_words(a, scratch);
+  wb = container_words(b, scratch + NC_BITMAP_BITSET_WORDS);
+  dst->card = bitset_op(dst->data, wa, wb, op);
+
+  if (dst->card <= NC_BITMAP_ARRAY_MAX) {
+    return container_bitset_to_array(dst);
+  }
+
+  return NC_OK;
+}
+
+static struct nc_bitmap *
+bitmap_op(const struct nc_bitmap *a, const struct nc_bitmap *b, int op)
+{
+  struct nc_bitmap *r;
+  const container_t *ca, *cb;
+  container_t c;
+  uint64_t *scratch;
+  int i, j, status;
+
+  r = nc_bitmap_create();
+  if (r == NULL) {
+    return NULL;
+  }
+
+  scratch = nc_alloc(2 * BITSET_BYTES);
+  if (scratch == NULL) {
+    nc_bitmap_destroy(r);
+    return NULL;
+  }
+
+  i = 0;
+  j = 0;
+  status = NC_OK;
+
+  while (status == NC_OK &&
+         (i < a->containers.nelem || j < b->containers.nelem)) {
+    ca = i < a->containers.nelem ? bitmap_container(a, i) : NULL;
+    cb = j < b->containers.nelem ? bitmap_container(b, j) : NULL;
+    c.data = NULL;
+
+    if (cb == NULL || (ca != NULL && ca->key < cb->key)) {
+      // Only in a
+      i++;
+      if (op == BITMAP_OP_AND) {
+        continue;
+      }
+      status = container_copy(&c, ca);
+
+    } else if (ca == NULL || cb->key < ca->key) {
+      // Only in b
+      j++;
+      if (op == BITMAP_OP_AND || op == BITMAP_OP_ANDNOT) {
+        continue;
+      }
+      status = container_copy(&c, cb);
+
+    } else {
+      i++;
+      j++;
+      status = container_op(&c, ca, cb, op, scratch);
+    }
+
+    if (status != NC_OK || c.card == 0) {
+      if (c.data != NULL) {
+        container_free(&c);
+      }
+      continue;
+    }
+
+    if (nc_array_push(&r->containers) == NULL) {
+      container_free(&c);
+      status = NC_ENOMEM;
+      break;
+    }
+    *bitmap_container(r, r->containers.nelem - 1) = c;
+  }
+
+  nc_free(scratch);
+
+  if (status != NC_OK) {
+    nc_bitmap_destroy(r);
+    return NULL;
+  }
+
+  return r;
+}
+
+struct nc_bitmap *
+nc_bitmap_and(const struct nc_bitmap *a, const struct nc_bitmap *b)
+{
+  return bitmap_op(a, b, BITMAP_OP_AND);
+}
+
+struct nc_bitmap *
+nc_bitmap_or(const struct nc_bitmap *a, const struct nc_bitmap *b)
+{
+  return bitmap_op(a, b, BITMAP_OP_OR);
+}
+
+struct nc_bitmap *
+nc_bitmap_andnot(const struct nc_bitmap *a, const struct nc_bitmap *b)
+{
+  return bitmap_op(a, b, BITMAP_OP_ANDNOT);
+}
+
+struct nc_bitmap *
+nc_bitmap_xor(const struct nc_bitmap *a, const struct nc_bitmap *b)
+{
+  return bitmap_op(a, b, BITMAP_OP_XOR);
+}
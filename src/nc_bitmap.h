@@ -0,0 +1,67 @@
+#ifndef LIBNC_NC_BITMAP_H_
+#define LIBNC_NC_BITMAP_H_
+
+#include <stdint.h>
+
+#include "nc_array.h"
+
+//
+// Compressed bitmap over 32-bit integers (roaring layout).
+//
+// The high 16 bits of a value select a container, the low 16 bits are
+// stored in it. Containers are kept sorted by key in an nc_array and come
+// in three kinds:
+//
+//   array  - sorted uint16_t values, for up to NC_BITMAP_ARRAY_MAX values
+//   bitset - 65536 bits, for dense containers
+//   run    - sorted (start, length - 1) pairs, made by nc_bitmap_optimize()
+//
+// Containers switch between array and bitset as they fill up or drain.
+// Bitset operations and cardinality counting use AVX2 or POPCNT when the
+// cpu has them; operations between two array containers are scalar merges.
+//
+
+#define NC_BITMAP_ARRAY_MAX 4096
+#define NC_BITMAP_BITSET_WORDS 1024 /* 65536 bits */
+
+#define NC_BITMAP_ARRAY 1
+#define NC_BITMAP_BITSET 2
+#define NC_BITMAP_RUN 3
+
+struct nc_bitmap_container {
+  uint16_t key;  /* high 16 bits of the values */
+  uint16_t type; /* NC_BITMAP_ARRAY, NC_BITMAP_BITSET or NC_BITMAP_RUN */
+  int card;      /* number of values */
+  int n;         /* array: values used, run: runs used */
+  int cap;       /* array: values allocated, run: runs allocated */
+  void *data;
+};
+
+struct nc_bitmap {
+  struct nc_array containers; /* struct nc_bitmap_container, by key */
+};
+
+// Return non-zero to stop the iteration.
+typedef int (*nc_bitmap_iter_pt)(uint32_t value, void *ctx);
+
+struct nc_bitmap *nc_bitmap_create(void);
+void nc_bitmap_destroy(struct nc_bitmap *b);
+
+int nc_bitmap_set(struct nc_bitmap *b, uint32_t value);
+int nc_bitmap_clear(struct nc_bitmap *b, uint32_t value);
+int nc_bitmap_test(const struct nc_bitmap *b, uint32_t value);
+uint64_t nc_bitmap_cardinality(const struct nc_bitmap *b);
+int nc_bitmap_iterate(const struct nc_bitmap *b, nc_bitmap_iter_pt fn,
+                      void *ctx);
+int nc_bitmap_optimize(struct nc_bitmap *b);
+
+struct nc_bitmap *nc_bitmap_and(const struct nc_bitmap *a,
+                                const struct nc_bitmap *b);
+struct nc_bitmap *nc_bitmap_or(const struct nc_bitmap *a,
+                               const struct nc_bitmap *b);
+struct nc_bitmap *nc_bitmap_andnot(const struct nc_bitmap *a,
+                                   const struct nc_bitmap *b);
+struct nc_bitmap *nc_bitmap_xor(const struct nc_bitmap *a,
+                                const struct nc_bitmap *b);
+
+#endif  // LIBNC_NC_BITMAP_H_
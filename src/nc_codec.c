@@ -0,0 +1,624 @@
+#include "nc_codec.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "nc_cpu.h"
+
+#if (NC_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+//
+// Layout: codec byte, element size byte, varint count, then the payload.
+//
+//   varint       count varints
+//   for          per block: varint minimum, bit width byte, bit-packed
+//                offsets from the minimum (little endian bit order, the
+//                block padded to a byte)
+//   streamvbyte  (count + 3) / 4 control bytes, 2 bits per value holding
+//                its byte length - 1, lowest bits first; then the data
+//                bytes of every value, little endian
+//
+
+#define CODEC_KIND(_c) ((_c) & 0x0f)
+#define CODEC_HEADER_MAX (2 + 10)
+#define CODEC_VARINT_MAX 10
+
+static uint8_t svb_shuffle[256][16]; /* data bytes -> 4 uint32_t */
+static uint8_t svb_len[256];         /* data bytes of 4 values */
+
+typedef const u_char *(*svb_decode_pt)(const u_char *ctrl, size_t nctrl,
+                                       const u_char *data, const u_char *end,
+                                       uint32_t *out, size_t *done,
+                                       int delta, uint32_t *prev);
+
+static svb_decode_pt svb_decode_fast;
+
+static pthread_once_t codec_once = PTHREAD_ONCE_INIT;
+
+static inline uint64_t
+codec_get(const void *elems, size_t width, size_t i)
+{
+  if (width == 4) {
+    return ((const uint32_t *)elems)[i];
+  }
+  return ((const uint64_t *)elems)[i];
+}
+
+static inline void
+codec_set(void *elems, size_t width, size_t i, uint64_t v)
+{
+  if (width == 4) {
+    ((uint32_t *)elems)[i] = (uint32_t)v;
+  } else {
+    ((uint64_t *)elems)[i] = v;
+  }
+}
+
+// Value to store for v: v itself, or the zigzag encoded difference to the
+// previous value, computed in the element width so it wraps like it.
+static inline uint64_t
+codec_forward(uint64_t v, uint64_t *prev, size_t width, int delta)
+{
+  uint64_t d;
+  uint32_t d32;
+
+  if (!delta) {
+    return v;
+  }
+
+  d = v - *prev;
+  *prev = v;
+
+  if (width == 4) {
+    d32 = (uint32_t)d;
+    return (uint32_t)((d32 << 1) ^ (uint32_t)((int32_t)d32 >> 31));
+  }
+
+  return (d << 1) ^ (uint64_t)((int64_t)d >> 63);
+}
+
+static inline uint64_t
+codec_inverse(uint64_t t, uint64_t *prev, int delta)
+{
+  if (!delta) {
+    return t;
+  }
+
+  *prev += (t >> 1) ^ (0 - (t & 1));
+
+  return *prev;
+}
+
+static inline unsigned
+codec_bits(uint64_t x)
+{
+#if defined(__GNUC__)
+  return x == 0 ? 0 : 64 - (unsigned)__builtin_clzll(x);
+#else
+  unsigned b = 0;
+
+  while (x != 0) {
+    x >>= 1;
+    b++;
+  }
+  return b;
+#endif
+}
+
+static inline u_char *
+varint_put(u_char *p, uint64_t v)
+{
+  while (v >= 0x80) {
+    *p++ = (u_char)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (u_char)v;
+
+  return p;
+}
+
+// Returns the byte after the varint, or NULL if it is truncated or too
+// long.
+static inline const u_char *
+varint_get(const u_char *p, const u_char *end, uint64_t *v)
+{
+  uint64_t r = 0;
+  unsigned shift;
+
+  for (shift = 0; p < end && shift < 64; shift += 7) {
+    r |= (uint64_t)(*p & 0x7f) << shift;
+    if (!(*p++ & 0x80)) {
+      *v = r;
+      return p;
+    }
+  }
+
+  return NULL;
+}
+
+//
+// Varint
+//
+
+static u_char *
+codec_encode_varint(const struct nc_array *a, u_char *p, int delta)
+{
+  uint64_t prev = 0;
+  size_t i;
+
+  for (i = 0; i < (size_t)a->nelem; i++) {
+    p = varint_put(p, codec_forward(codec_get(a->elems, a->size, i), &prev,
+                                    a->size, delta));
+  }
+
+  return p;
+}
+
+static const u_char *
+codec_decode_varint(struct nc_array *a, const u_char *p, const u_char *end,
+                    int delta)
+{
+  uint64_t t, prev = 0;
+  size_t i;
+
+  for (i = 0; i < (size_t)a->nelem; i++) {
+    p = varint_get(p, end, &t);
+    if (p == NULL || (a->size == 4 && t > UINT32_MAX)) {
+      return NULL;
+    }
+    codec_set(a->elems, a->size, i, codec_inverse(t, &prev, delta));
+  }
+
+  return p;
+}
+
+//
+// Frame of reference
+//
+
+// Appends the low b bits of v; fewer than 8 bits are pending in *acc
+// between calls.
+static inline u_char *
+for_put(u_char *p, uint64_t *acc, unsigned *nacc, uint64_t v, unsigned b)
+{
+  unsigned total, k;
+
+  if (b == 0) {
+    return p;
+  }
+
+  *acc |= v << *nacc;
+  total = *nacc + b;
+
+  if (total >= 64) {
+    for (k = 0; k < 8; k++) {
+      *p++ = (u_char)(*acc >> (8 * k));
+    }
+    *acc = *nacc != 0 ? v >> (64 - *nacc) : 0;
+    total -= 64;
+  }
+
+  while (total >= 8) {
+    *p++ = (u_char)*acc;
+    *acc >>= 8;
+    total -= 8;
+  }
+  *nacc = total;
+
+  return p;
+}
+
+// Reads b (1..64) bits at bit position pos of a block of 'bytes' bytes.
+static inline uint64_t
+for_get(const u_char *p, size_t bytes, size_t pos, unsigned b)
+{
+  const u_char *q = p + (pos >> 3);
+  unsigned shift = pos & 7, nbytes = (shift + b + 7) >> 3, k;
+  uint64_t v = 0;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  // One unaligned load when the 8 bytes are inside the block
+  if (nbytes <= 8 && (pos >> 3) + 8 <= bytes) {
+    memcpy(&v, q, 8);
+    v >>= shift;
+    return b == 64 ? v : v & (((uint64_t)1 << b) - 1);
+  }
+#endif
+
+  for (k = 0; k < nbytes && k < 8; k++) {
+    v |= (uint64_t)q[k] << (8 * k);
+  }
+  v >>= shift;
+  if (nbytes > 8) {
+    v |= (uint64_t)q[8] << (64 - shift);
+  }
+
+  return b == 64 ? v : v & (((uint64_t)1 << b) - 1);
+}
+
+static u_char *
+codec_encode_for(const struct nc_array *a, u_char *p, int delta)
+{
+  uint64_t t[NC_CODEC_FOR_BLOCK], min, max, prev = 0, acc;
+  size_t i, j, cnt, n = (size_t)a->nelem;
+  unsigned b, nacc;
+
+  for (i = 0; i < n; i += cnt) {
+    cnt = MIN(n - i, NC_CODEC_FOR_BLOCK);
+
+    min = UINT64_MAX;
+    max = 0;
+    for (j = 0; j < cnt; j++) {
+      t[j] = codec_forward(codec_get(a->elems, a->size, i + j), &prev,
+                           a->size, delta);
+      min = MIN(min, t[j]);
+      max = MAX(max, t[j]);
+    }
+
+    b = codec_bits(max - min);
+    p = varint_put(p, min);
+    *p++ = (u_char)b;
+
+    acc = 0;
+    nacc = 0;
+    for (j = 0; j < cnt; j++) {
+      p = for_put(p, &acc, &nacc, t[j] - min, b);
+    }
+    if (nacc > 0) {
+      *p++ = (u_char)acc;
+    }
+  }
+
+  return p;
+}
+
+static const u_char *
+codec_decode_for(struct nc_array *a, const u_char *p, const u_char *end,
+                 int delta)
+{
+  uint64_t min, t, prev = 0;
+  size_t i, j, cnt, bytes, n = (size_t)a->nelem;
+  unsigned b;
+
+  for (i = 0; i < n; i += cnt) {
+    cnt = MIN(n - i, NC_CODEC_FOR_BLOCK);
+
+    p = varint_get(p, end, &min);
+    if (p == NULL || p == end || *p > 64) {
+      return NULL;
+    }
+    b = *p++;
+
+    bytes = (cnt * b + 7) / 8;
+    if ((size_t)(end - p) < bytes) {
+      return NULL;
+    }
+
+    for (j = 0; j < cnt; j++) {
+      t = min + (b != 0 ? for_get(p, bytes, j * b, b) : 0);
+      if (a->size == 4 && t > UINT32_MAX) {
+        return NULL;
+      }
+      codec_set(a->elems, a->size, i + j, codec_inverse(t, &prev, delta));
+    }
+
+    p += bytes;
+  }
+
+  return p;
+}
+
+//
+// Stream VByte
+//
+
+static u_char *
+codec_encode_svb(const struct nc_array *a, u_char *p, int delta)
+{
+  u_char *ctrl = p, *data;
+  uint64_t prev = 0;
+  uint32_t v;
+  size_t i, n = (size_t)a->nelem;
+  unsigned len, k;
+
+  data = ctrl + (n + 3) / 4;
+  memset(ctrl, 0, (n + 3) / 4);
+
+  for (i = 0; i < n; i++) {
+    v = (uint32_t)codec_forward(codec_get(a->elems, 4, i), &prev, 4, delta);
+    len = v < (1U << 8) ? 1 : v < (1U << 16) ? 2 : v < (1U << 24) ? 3 : 4;
+
+    ctrl[i >> 2] |= (u_char)((len - 1) << ((i & 3) * 2));
+    for (k = 0; k < len; k++) {
+      *data++ = (u_char)(v >> (8 * k));
+    }
+  }
+
+  return data;
+}
+
+#if (NC_HAVE_X86_SIMD)
+
+// Decodes whole groups of 4 values while 16 bytes can be loaded: one
+// shuffle spreads a group's data bytes over 4 lanes. With delta the lanes
+// are zigzag decoded and prefix summed in the register.
+NC_TARGET("ssse3")
+static const u_char *
+svb_decode_ssse3(const u_char *ctrl, size_t nctrl, const u_char *data,
+                 const u_char *end, uint32_t *out, size_t *done, int delta,
+                 uint32_t *prev)
+{
+  __m128i v, base, one, zero;
+  size_t k;
+
+  base = _mm_set1_epi32((int)*prev);
+  one = _mm_set1_epi32(1);
+  zero = _mm_setzero_si128();
+
+  for (k = 0; k < nctrl && end - data >= 16; k++) {
+    v = _mm_shuffle_epi8(
+        _mm_loadu_si128((const __m128i *)data),
+        _mm_loadu_si128((const __m128i *)svb_shuffle[ctrl[k]]));
+
+    if (delta) {
+      v = _mm_xor_si128(_mm_srli_epi32(v, 1),
+                        _mm_sub_epi32(zero, _mm_and_si128(v, one)));
+      v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+      v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+      v = _mm_add_epi32(v, base);
+      base = _mm_shuffle_epi32(v, 0xff);
+    }
+
+    _mm_storeu_si128((__m128i *)(out + 4 * k), v);
+    data += svb_len[ctrl[k]];
+  }
+
+  *prev = (uint32_t)_mm_cvtsi128_si32(base);
+  *done = k;
+
+  return data;
+}
+
+#endif
+
+static const u_char *
+codec_decode_svb(struct nc_array *a, const u_char *p, const u_char *end,
+                 int delta)
+{
+  const u_char *ctrl = p, *data;
+  uint32_t *out = a->elems, v, prev32 = 0;
+  uint64_t prev;
+  size_t i, n = (size_t)a->nelem, nctrl = (n + 3) / 4, total, k;
+  unsigned len, j;
+
+  if ((size_t)(end - p) < nctrl) {
+    return NULL;
+  }
+  data = ctrl + nctrl;
+
+  // Check the data bytes are all there before touching them
+  for (k = 0, total = 0; k < n / 4; k++) {
+    total += svb_len[ctrl[k]];
+  }
+  for (i = k * 4; i < n; i++) {
+    total += ((ctrl[i >> 2] >> ((i & 3) * 2)) & 3) + 1;
+  }
+  if ((size_t)(end - data) < total) {
+    return NULL;
+  }
+  end = data + total;
+
+  i = 0;
+  if (svb_decode_fast != NULL) {
+    data = svb_decode_fast(ctrl, n / 4, data, end, out, &k, delta, &prev32);
+    i = 4 * k;
+  }
+
+  prev = i > 0 ? out[i - 1] : 0;
+  for (; i < n; i++) {
+    len = ((ctrl[i >> 2] >> ((i & 3) * 2)) & 3) + 1;
+    for (j = 0, v = 0; j < len; j++) {
+      v |= (uint32_t)data[j] << (8 * j);
+    }
+    data += len;
+    out[i] = (uint32_t)codec_inverse(v, &prev, delta);
+  }
+
+  return data;
+}
+
+static void
+codec_init(void)
+{
+  unsigned c, k, j, len, off;
+
+  for (c = 0; c < 256; c++) {
+    for (k = 0, off = 0; k < 4; k++) {
+      len = ((c >> (2 * k)) & 3) + 1;
+      for (j = 0; j < 4; j++) {
+        svb_shuffle[c][4 * k + j] = j < len ? (uint8_t)(off + j) : 0xff;
+      }
+      off += len;
+    }
+    svb_len[c] = (uint8_t)off;
+  }
+
+#if (NC_HAVE_X86_SIMD)
+  if (nc_cpu_features() & NC_CPU_SSSE3) {
+    svb_decode_fast = svb_decode_ssse3;
+  }
+#endif
+}
+
+// Appends the encoding of the elements of 'a' (uint32_t or uint64_t, by
+// a->size) to *out, which may be reallocated.
+//
+// Returns NC_OK, NC_ENOMEM, or NC_ERROR for an unknown codec or an element
+// size it can't handle.
+int
+nc_array_encode(const struct nc_array *a, int codec, sds *out)
+{
+  size_t n = (size_t)a->nelem, width = a->size, max;
+  int delta = (codec & NC_CODEC_DELTA) != 0;
+  u_char *start, *p;
+  sds s;
+
+  if (width != 4 && width != 8) {
+    return NC_ERROR;
+  }
+
+  switch (CODEC_KIND(codec)) {
+  case NC_CODEC_VARINT:
+    max = n * CODEC_VARINT_MAX;
+    break;
+
+  case NC_CODEC_FOR:
+    max = (n + NC_CODEC_FOR_BLOCK - 1) / NC_CODEC_FOR_BLOCK *
+              (CODEC_VARINT_MAX + 1) + n * width;
+    break;
+
+  case NC_CODEC_STREAMVBYTE:
+    if (width != 4) {
+      return NC_ERROR;
+    }
+    max = (n + 3) / 4 + n * 4;
+    break;
+
+  default:
+    return NC_ERROR;
+  }
+
+  if (codec & ~(NC_CODEC_DELTA | 0x0f)) {
+    return NC_ERROR;
+  }
+
+  max += CODEC_HEADER_MAX;
+  if (max > INT_MAX - sdslen(*out)) {
+    return NC_ERROR;
+  }
+
+  s = sdsMakeRoomFor(*out, max);
+  if (s == NULL) {
+    return NC_ENOMEM;
+  }
+  *out = s;
+
+  start = (u_char *)s + sdslen(s);
+  p = start;
+  *p++ = (u_char)codec;
+  *p++ = (u_char)width;
+  p = varint_put(p, n);
+
+  switch (CODEC_KIND(codec)) {
+  case NC_CODEC_VARINT:
+    p = codec_encode_varint(a, p, delta);
+    break;
+
+  case NC_CODEC_FOR:
+    p = codec_encode_for(a, p, delta);
+    break;
+
+  default:
+    p = codec_encode_svb(a, p, delta);
+    break;
+  }
+
+  sdsIncrLen(s, (int)(p - start));
+
+  return NC_OK;
+}
+
+// Decodes an encoding made by nc_array_encode() at the start of 'buf' into
+// a new array. If 'used' is not NULL it gets the number of bytes of 'buf'
+// the encoding took.
+//
+// Returns NULL if the encoding is malformed or truncated, or on allocation
+// failure.
+struct nc_array *
+nc_array_decode(const void *buf, size_t len, size_t *used)
+{
+  const u_char *p = buf, *end = p + len;
+  struct nc_array *a;
+  uint64_t n;
+  size_t width, min_bytes;
+  int codec, delta;
+
+  pthread_once(&codec_once, codec_init);
+
+  if (len < 2) {
+    return NULL;
+  }
+
+  codec = p[0];
+  width = p[1];
+  delta = (codec & NC_CODEC_DELTA) != 0;
+  p += 2;
+
+  if ((width != 4 && width != 8) || (codec & ~(NC_CODEC_DELTA | 0x0f))) {
+    return NULL;
+  }
+
+  p = varint_get(p, end, &n);
+  if (p == NULL || n > INT_MAX) {
+    return NULL;
+  }
+
+  // Reject counts the input can't hold before allocating for them
+  switch (CODEC_KIND(codec)) {
+  case NC_CODEC_VARINT:
+    min_bytes = (size_t)n;
+    break;
+
+  case NC_CODEC_FOR:
+    min_bytes = ((size_t)n + NC_CODEC_FOR_BLOCK - 1) / NC_CODEC_FOR_BLOCK * 2;
+    break;
+
+  case NC_CODEC_STREAMVBYTE:
+    if (width != 4) {
+      return NULL;
+    }
+    min_bytes = (size_t)n;
+    break;
+
+  default:
+    return NULL;
+  }
+
+  if ((size_t)(end - p) < min_bytes) {
+    return NULL;
+  }
+
+  a = nc_array_create(n > 0 ? (int)n : 1, width);
+  if (a == NULL) {
+    return NULL;
+  }
+  a->nelem = (int)n;
+
+  switch (CODEC_KIND(codec)) {
+  case NC_CODEC_VARINT:
+    p = codec_decode_varint(a, p, end, delta);
+    break;
+
+  case NC_CODEC_FOR:
+    p = codec_decode_for(a, p, end, delta);
+    break;
+
+  default:
+    p = codec_decode_svb(a, p, end, delta);
+    break;
+  }
+
+  if (p == NULL) {
+    nc_array_destroy(a);
+    return NULL;
+  }
+
+  if (used != NULL) {
+    *used = (size_t)(p - (const u_char *)buf);
+  }
+
+  return a;
+}
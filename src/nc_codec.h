@@ -0,0 +1,39 @@
+#ifndef LIBNC_NC_CODEC_H_
+#define LIBNC_NC_CODEC_H_
+
+#include <stdint.h>
+
+#include "nc_array.h"
+#include "nc_sds.h"
+
+//
+// Integer compression for arrays of uint32_t or uint64_t elements.
+//
+// NC_CODEC_VARINT      - LEB128 varints, 7 bits per byte
+// NC_CODEC_FOR         - frame of reference: blocks of NC_CODEC_FOR_BLOCK
+//                        values stored as block minimum plus fixed-width
+//                        bit-packed offsets
+// NC_CODEC_STREAMVBYTE - Stream VByte, uint32_t only: 2-bit lengths in a
+//                        control stream, 1-4 data bytes per value; decoded
+//                        with SSSE3 shuffles when the cpu has them
+//
+// NC_CODEC_DELTA may be or'ed into any of them to store zigzag encoded
+// differences between consecutive values instead of the values, which is
+// what makes sorted lists and timestamps small.
+//
+// An encoding is self-describing (codec, element size, count) and can be
+// appended to an sds holding other data; nc_array_decode() reports how
+// many bytes it used.
+//
+
+#define NC_CODEC_VARINT 0x01
+#define NC_CODEC_FOR 0x02
+#define NC_CODEC_STREAMVBYTE 0x03
+#define NC_CODEC_DELTA 0x10
+
+#define NC_CODEC_FOR_BLOCK 128
+
+int nc_array_encode(const struct nc_array *a, int codec, sds *out);
+struct nc_array *nc_array_decode(const void *buf, size_t len, size_t *used);
+
+#endif  // LIBNC_NC_CODEC_H_
@@ -0,0 +1,127 @@
+#include "nc_columns.h"
+
+#include <string.h>  // memcpy
+
+struct nc_columns *
+nc_columns_create(int ncols, const size_t *sizes, int n)
+{
+  struct nc_columns *c;
+  int i;
+
+  NC_ASSERT(ncols > 0 && n > 0);
+
+  c = nc_alloc(sizeof(*c));
+  if (c == NULL) {
+    return NULL;
+  }
+
+  c->cols = nc_alloc(ncols * sizeof(struct nc_array));
+  if (c->cols == NULL) {
+    nc_free(c);
+    return NULL;
+  }
+
+  c->ncols = 0;
+  c->nrows = 0;
+
+  for (i = 0; i < ncols; i++) {
+    if (nc_array_init(&c->cols[i], n, sizes[i]) != NC_OK) {
+      nc_columns_destroy(c);
+      return NULL;
+    }
+    c->ncols++;
+  }
+
+  return c;
+}
+
+void
+nc_columns_destroy(struct nc_columns *c)
+{
+  int i;
+
+  for (i = 0; i < c->ncols; i++) {
+    nc_array_deinit(&c->cols[i]);
+  }
+  nc_free(c->cols);
+  nc_free(c);
+}
+
+// Makes room for n more rows in every column. On failure the columns that
+// did grow keep their larger buffers, no row is added either way.
+int
+nc_columns_reserve(struct nc_columns *c, int n)
+{
+  int i;
+
+  for (i = 0; i < c->ncols; i++) {
+    if (nc_array_reserve(&c->cols[i], n) != NC_OK) {
+      return NC_ENOMEM;
+    }
+  }
+
+  return NC_OK;
+}
+
+// Appends a row with uninitialized fields, see nc_columns_at().
+int
+nc_columns_push(struct nc_columns *c)
+{
+  int i;
+
+  if (nc_columns_reserve(c, 1) != NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  for (i = 0; i < c->ncols; i++) {
+    c->cols[i].nelem++;
+  }
+  c->nrows++;
+
+  return NC_OK;
+}
+
+// Appends a row, fields[i] points to the value of column i.
+int
+nc_columns_append(struct nc_columns *c, const void *const *fields)
+{
+  struct nc_array *col;
+  int i;
+
+  if (nc_columns_reserve(c, 1) != NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  for (i = 0; i < c->ncols; i++) {
+    col = &c->cols[i];
+    memcpy((u_char *)col->elems + col->size * col->nelem, fields[i], col->size);
+    col->nelem++;
+  }
+  c->nrows++;
+
+  return NC_OK;
+}
+
+// Appends a row scattered from a struct, column i is taken from
+// row + offsets[i].
+int
+nc_columns_append_struct(struct nc_columns *c, const void *row,
+                         const size_t *offsets)
+{
+  struct nc_array *col;
+  int i;
+
+  if (nc_columns_reserve(c, 1) != NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  for (i = 0; i < c->ncols; i++) {
+    col = &c->cols[i];
+    memcpy((u_char *)col->elems + col->size * col->nelem,
+           (const u_char *)row + offsets[i], col->size);
+    col->nelem++;
+  }
+  c->nrows++;
+
+  return NC_OK;
+}
@@ -0,0 +1,40 @@
+#ifndef LIBNC_NC_COLUMNS_H_
+#define LIBNC_NC_COLUMNS_H_
+
+#include "nc_array.h"
+
+// Struct-of-arrays table: every field of a row lives in its own nc_array
+// column, all columns hold nrows elements and grow together.
+struct nc_columns {
+  struct nc_array *cols;
+  int ncols;
+  int nrows;
+};
+
+#define NC_COLUMNS_COL(_c, _col, _type) ((_type *)nc_columns_column(_c, _col))
+
+struct nc_columns *nc_columns_create(int ncols, const size_t *sizes, int n);
+void nc_columns_destroy(struct nc_columns *c);
+int nc_columns_reserve(struct nc_columns *c, int n);
+int nc_columns_push(struct nc_columns *c);
+int nc_columns_append(struct nc_columns *c, const void *const *fields);
+int nc_columns_append_struct(struct nc_columns *c, const void *row,
+                             const size_t *offsets);
+
+static inline void *
+nc_columns_column(struct nc_columns *c, int col)
+{
+  NC_ASSERT(col >= 0 && col < c->ncols);
+
+  return c->cols[col].elems;
+}
+
+static inline void *
+nc_columns_at(struct nc_columns *c, int col, int row)
+{
+  NC_ASSERT(row >= 0 && row < c->nrows);
+
+  return (u_char *)nc_columns_column(c, col) + c->cols[col].size * row;
+}
+
+#endif  // LIBNC_NC_COLUMNS_H_
@@ -0,0 +1,35 @@
+#include "nc_cpu.h"
+
+unsigned
+nc_cpu_features(void)
+{
+  unsigned features = 0;
+
+#if (NC_HAVE_X86_SIMD)
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("sse2")) {
+    features |= NC_CPU_SSE2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    features |= NC_CPU_SSSE3;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    features |= NC_CPU_SSE41;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    features |= NC_CPU_SSE42;
+  }
+  if (__builtin_cpu_supports("popcnt")) {
+    features |= NC_CPU_POPCNT;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    features |= NC_CPU_AVX2;
+  }
+  if (__builtin_cpu_supports("bmi2")) {
+    features |= NC_CPU_BMI2;
+  }
+#endif
+
+  return features;
+}
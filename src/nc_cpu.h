@@ -0,0 +1,27 @@
+#ifndef LIBNC_NC_CPU_H_
+#define LIBNC_NC_CPU_H_
+
+#include "nc_macros.h"
+
+// x86 SIMD kernels are compiled with per-function target attributes and
+// picked at runtime, so the library itself needs no -m flags.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NC_HAVE_X86_SIMD 1
+#define NC_TARGET(_t) __attribute__((target(_t)))
+#else
+#define NC_HAVE_X86_SIMD 0
+#define NC_TARGET(_t)
+#endif
+
+#define NC_CPU_SSE2 0x0001
+#define NC_CPU_SSSE3 0x0002
+#define NC_CPU_SSE41 0x0004
+#define NC_CPU_SSE42 0x0008
+#define NC_CPU_POPCNT 0x0010
+#define NC_CPU_AVX2 0x0020
+#define NC_CPU_BMI2 0x0040
+
+// Returns the NC_CPU_* features of the running cpu, 0 on non-x86 targets.
+unsigned nc_cpu_features(void);
+
+#endif  // LIBNC_NC_CPU_H_
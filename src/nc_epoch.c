@@ -0,0 +1,334 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // syscall
+#endif
+
+#include "nc_epoch.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "nc_macros.h"
+
+#if defined(__linux__)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__NR_membarrier)
+#define NC_HAVE_MEMBARRIER 1
+#endif
+#endif
+
+// A global epoch only ever moves forward, one step at a time, and only
+// when every thread inside a read section entered it during the current
+// epoch. Once it has moved twice past the epoch in which an object was
+// retired, every section that could have seen the object has ended.
+//
+// Entering a section must make the reader's record visible before the
+// section loads any shared pointer, which takes a full fence, and a full
+// fence on every lookup costs more than the lookup: it stops the misses of
+// consecutive lookups from overlapping. Where the kernel supports it,
+// readers only keep the compiler from reordering, and the thread that
+// advances the epoch runs membarrier(2), which executes a full fence on
+// every thread of the process, before it looks at the records.
+//
+// Reader records live in a static array so registering never allocates.
+// The array is only scanned up to the highest record ever used. Threads
+// that find it full share the overflow record, which counts the sections
+// open on it and holds the epoch back while there are any.
+
+// Retire this many objects between two attempts at freeing old ones
+#define EPOCH_RECLAIM_EVERY 64
+
+struct nc_epoch_item {
+  struct nc_epoch_item *next;
+  uint64_t epoch; /* global epoch when retired */
+  void *ptr;
+  nc_epoch_free_pt fn;
+  void *ctx;
+};
+
+struct epoch_record {
+  atomic_uint_fast64_t epoch; /* global epoch seen by the open section */
+  atomic_int active;          /* inside a section */
+  atomic_int in_use;          /* owned by a live thread */
+  u_char pad[NC_CACHELINE_SIZE - sizeof(atomic_uint_fast64_t) -
+             2 * sizeof(atomic_int)];
+};
+
+static struct epoch_record epoch_records[NC_EPOCH_MAX_THREADS]
+    __attribute__((aligned(NC_CACHELINE_SIZE)));
+static struct epoch_record epoch_overflow
+    __attribute__((aligned(NC_CACHELINE_SIZE)));
+static atomic_size_t epoch_nrecords; /* records ever handed out */
+static atomic_uint_fast64_t epoch_global;
+static int epoch_asymmetric; /* set once, before any thread registers */
+
+static pthread_once_t epoch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t epoch_key;
+
+static __thread struct epoch_record *epoch_self;
+static __thread unsigned epoch_depth;
+
+static void
+epoch_release(void *arg)
+{
+  struct epoch_record *rec = arg;
+
+  atomic_store(&rec->active, 0);
+  atomic_store(&rec->in_use, 0);
+}
+
+static void
+epoch_init(void)
+{
+  pthread_key_create(&epoch_key, epoch_release);
+
+#if (NC_HAVE_MEMBARRIER)
+  {
+    long cmds = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0);
+
+    if (cmds > 0 && (cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED,
+                0) == 0)
+      epoch_asymmetric = 1;
+  }
+#endif
+}
+
+// The writer's half of the fence pair in nc_epoch_enter()
+static void
+epoch_barrier(void)
+{
+#if (NC_HAVE_MEMBARRIER)
+  if (epoch_asymmetric &&
+      syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) == 0)
+    return;
+#endif
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+static struct epoch_record *
+epoch_register(void)
+{
+  struct epoch_record *rec;
+  size_t i, n;
+  int expected;
+
+  pthread_once(&epoch_once, epoch_init);
+
+  for (i = 0; i < NC_EPOCH_MAX_THREADS; i++) {
+    rec = &epoch_records[i];
+    expected = 0;
+    if (atomic_compare_exchange_strong(&rec->in_use, &expected, 1))
+      break;
+  }
+
+  if (i == NC_EPOCH_MAX_THREADS)
+    return &epoch_overflow;
+
+  // Make sure advancing scans this record from now on
+  n = atomic_load(&epoch_nrecords);
+  while (n <= i && !atomic_compare_exchange_weak(&epoch_nrecords, &n, i + 1)) {
+    /* void */
+  }
+
+  pthread_setspecific(epoch_key, rec);
+
+  return rec;
+}
+
+void
+nc_epoch_enter(void)
+{
+  struct epoch_record *rec;
+
+  if (epoch_depth++ > 0)
+    return;
+
+  rec = epoch_self;
+  if (rec == NULL)
+    rec = epoch_self = epoch_register();
+
+  // A full barrier by itself
+  if (rec == &epoch_overflow) {
+    atomic_fetch_add(&rec->active, 1);
+    return;
+  }
+
+  // Acquire: seeing an epoch means seeing what was unlinked before it
+  atomic_store_explicit(&rec->epoch,
+                        atomic_load_explicit(&epoch_global,
+                                             memory_order_acquire),
+                        memory_order_relaxed);
+  atomic_store_explicit(&rec->active, 1, memory_order_relaxed);
+
+  // Publish 'active' before the section loads any shared pointer
+  if (epoch_asymmetric)
+    atomic_signal_fence(memory_order_seq_cst);
+  else
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void
+nc_epoch_exit(void)
+{
+  NC_ASSERT(epoch_depth > 0);
+
+  if (--epoch_depth > 0)
+    return;
+
+  if (epoch_self == &epoch_overflow)
+    atomic_fetch_sub_explicit(&epoch_overflow.active, 1,
+                              memory_order_release);
+  else
+    atomic_store_explicit(&epoch_self->active, 0, memory_order_release);
+}
+
+// Moves the global epoch forward if every active reader has caught up
+// with it. Returns the global epoch.
+static uint64_t
+epoch_try_advance(void)
+{
+  struct epoch_record *rec;
+  uint64_t e;
+  size_t i, n;
+
+  // Threads that only retire may never have registered
+  pthread_once(&epoch_once, epoch_init);
+  epoch_barrier();
+
+  e = atomic_load(&epoch_global);
+  n = atomic_load(&epoch_nrecords);
+
+  if (atomic_load(&epoch_overflow.active))
+    return e;
+
+  for (i = 0; i < n; i++) {
+    rec = &epoch_records[i];
+    if (atomic_load(&rec->active) && atomic_load(&rec->epoch) != e)
+      return e;
+  }
+
+  // On failure someone else advanced it, and e is the new value
+  if (atomic_compare_exchange_strong(&epoch_global, &e, e + 1))
+    e++;
+
+  return e;
+}
+
+void
+nc_epoch_synchronize(void)
+{
+  uint64_t target;
+
+  NC_ASSERT(epoch_depth == 0);
+
+  target = atomic_fetch_add(&epoch_global, 0) + 2;
+
+  while (epoch_try_advance() < target) {
+    sched_yield();
+  }
+}
+
+void
+nc_epoch_limbo_init(struct nc_epoch_limbo *limbo)
+{
+  limbo->head = NULL;
+  limbo->tail = NULL;
+  limbo->count = 0;
+  limbo->spare = NULL;
+}
+
+int
+nc_epoch_reserve(struct nc_epoch_limbo *limbo)
+{
+  if (limbo->spare == NULL) {
+    limbo->spare = nc_alloc(sizeof(*limbo->spare));
+    if (limbo->spare == NULL)
+      return NC_ENOMEM;
+  }
+  return NC_OK;
+}
+
+void
+nc_epoch_retire(struct nc_epoch_limbo *limbo, void *ptr, nc_epoch_free_pt fn,
+                void *ctx)
+{
+  struct nc_epoch_item *item;
+
+  item = nc_alloc(sizeof(*item));
+  if (item == NULL) {
+    item = limbo->spare;
+    limbo->spare = NULL;
+  }
+  if (item == NULL) {
+    if (epoch_depth > 0) {
+      log_error("nc_epoch: no memory to retire %p, leaking it", ptr);
+      return;
+    }
+    nc_epoch_synchronize();
+    fn(ptr, ctx);
+    return;
+  }
+
+  // A read-modify-write, so that advancing past this epoch, and entering
+  // a section in a later one, happens after the caller unlinked ptr
+  item->next = NULL;
+  item->epoch = atomic_fetch_add(&epoch_global, 0);
+  item->ptr = ptr;
+  item->fn = fn;
+  item->ctx = ctx;
+
+  if (limbo->tail)
+    limbo->tail->next = item;
+  else
+    limbo->head = item;
+  limbo->tail = item;
+
+  if (++limbo->count % EPOCH_RECLAIM_EVERY == 0)
+    nc_epoch_reclaim(limbo);
+}
+
+size_t
+nc_epoch_reclaim(struct nc_epoch_limbo *limbo)
+{
+  struct nc_epoch_item *item;
+  uint64_t e;
+  size_t n = 0;
+
+  if (limbo->head == NULL)
+    return 0;
+
+  e = epoch_try_advance();
+
+  // Items are in retire order, so their epochs never decrease
+  while ((item = limbo->head) != NULL && item->epoch + 2 <= e) {
+    limbo->head = item->next;
+    item->fn(item->ptr, item->ctx);
+    nc_free(item);
+    n++;
+  }
+
+  if (limbo->head == NULL)
+    limbo->tail = NULL;
+  limbo->count -= n;
+
+  return n;
+}
+
+void
+nc_epoch_drain(struct nc_epoch_limbo *limbo)
+{
+  struct nc_epoch_item *item;
+
+  while ((item = limbo->head) != NULL) {
+    limbo->head = item->next;
+    item->fn(item->ptr, item->ctx);
+    nc_free(item);
+  }
+
+  if (limbo->spare != NULL)
+    nc_free(limbo->spare);
+  nc_epoch_limbo_init(limbo);
+}
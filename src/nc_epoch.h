@@ -0,0 +1,71 @@
+#ifndef LIBNC_NC_EPOCH_H_
+#define LIBNC_NC_EPOCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Epoch based reclamation, for structures that are read without locks.
+//
+// Readers bracket each traversal with nc_epoch_enter() and
+// nc_epoch_exit(). Sections nest, and entering one only writes to the
+// calling thread's own record. Writers unlink an object, then hand it to
+// nc_epoch_retire() instead of freeing it. It is freed once every thread
+// that was inside a section at the time has left it, since only those
+// threads can still hold a pointer to it.
+//
+// Retired objects wait on a limbo list. Writers must serialize their
+// calls on a given list, typically under a lock they already hold.
+//
+// Up to NC_EPOCH_MAX_THREADS threads can be registered at once. A
+// thread registers on its first nc_epoch_enter(), and its record is
+// released for reuse when the thread exits. Threads past the limit share
+// one overflow record; nothing is freed while any of them is inside a
+// section, but they work.
+//
+
+#define NC_EPOCH_MAX_THREADS 512
+
+typedef void (*nc_epoch_free_pt)(void *ptr, void *ctx);
+
+struct nc_epoch_item;
+
+struct nc_epoch_limbo {
+  struct nc_epoch_item *head; /* oldest first */
+  struct nc_epoch_item *tail;
+  size_t count;
+  struct nc_epoch_item *spare; /* see nc_epoch_reserve() */
+};
+
+void nc_epoch_enter(void);
+void nc_epoch_exit(void);
+
+// Waits until every read section open at the time of the call has ended.
+// Must not be called from inside a section.
+void nc_epoch_synchronize(void);
+
+void nc_epoch_limbo_init(struct nc_epoch_limbo *limbo);
+
+// Makes sure the next nc_epoch_retire() on the list has an entry even if
+// memory runs out. Writers that may be inside a read section call it
+// before they unlink anything, and back out on NC_ENOMEM; returns NC_OK
+// otherwise.
+int nc_epoch_reserve(struct nc_epoch_limbo *limbo);
+
+// Calls fn(ptr, ctx) once no reader can still see ptr. If no list entry
+// can be allocated, it takes the one set aside by nc_epoch_reserve().
+// Without one either, outside a read section it waits for the readers
+// with nc_epoch_synchronize() and frees ptr right away; inside one,
+// where waiting would never end, ptr is leaked.
+void nc_epoch_retire(struct nc_epoch_limbo *limbo, void *ptr,
+                     nc_epoch_free_pt fn, void *ctx);
+
+// Frees whatever is old enough. Returns the number of objects freed.
+size_t nc_epoch_reclaim(struct nc_epoch_limbo *limbo);
+
+// Frees everything on the list. Only safe when no reader can still hold
+// one of the objects, for example when the structure itself is being
+// destroyed.
+void nc_epoch_drain(struct nc_epoch_limbo *limbo);
+
+#endif  // LIBNC_NC_EPOCH_H_
@@ -0,0 +1,249 @@
+#include "nc_hash.h"
+
+#include <string.h>
+
+#include "nc_sds.h"
+
+#if defined(__GNUC__)
+#define hash_likely(x) __builtin_expect(!!(x), 1)
+#define hash_unlikely(x) __builtin_expect(!!(x), 0)
+#else
+#define hash_likely(x) (x)
+#define hash_unlikely(x) (x)
+#endif
+
+static uint8_t hash_key[16];
+static uint64_t hash_seed;
+
+void
+nc_hash_seed(const uint8_t seed[16])
+{
+  memcpy(hash_key, seed, sizeof(hash_key));
+  memcpy(&hash_seed, seed, sizeof(hash_seed));
+}
+
+// Little-endian loads, so hashes are the same on every host
+static inline uint64_t
+hash_r8(const uint8_t *p)
+{
+  uint64_t v;
+
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline uint64_t
+hash_r4(const uint8_t *p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+// 1 to 3 bytes: first, middle and last
+static inline uint64_t
+hash_r3(const uint8_t *p, size_t k)
+{
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+// 64x64 -> 128-bit multiply, low half in *a, high half in *b
+static inline void
+hash_mum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+  __uint128_t r = (__uint128_t)*a * *b;
+
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl, lo;
+
+  lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t
+hash_mix(uint64_t a, uint64_t b)
+{
+  hash_mum(&a, &b);
+  return a ^ b;
+}
+
+static const uint64_t hash_secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL,
+    0x4d5a2da51de1aa47ULL};
+
+uint64_t
+nc_hash_bytes(const void *data, size_t len, uint64_t seed)
+{
+  const uint8_t *p = data;
+  const uint64_t *s = hash_secret;
+  uint64_t a, b, see1, see2;
+  size_t i, mid;
+
+  seed ^= hash_mix(seed ^ s[0], s[1]);
+
+  if (hash_likely(len <= 16)) {
+    if (hash_likely(len >= 4)) {
+      mid = (len >> 3) << 2;
+      a = (hash_r4(p) << 32) | hash_r4(p + mid);
+      b = (hash_r4(p + len - 4) << 32) | hash_r4(p + len - 4 - mid);
+    } else if (hash_likely(len > 0)) {
+      a = hash_r3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    i = len;
+    if (hash_unlikely(i >= 48)) {
+      // Three independent multiply chains keep the multiplier busy
+      see1 = seed;
+      see2 = seed;
+      do {
+        seed = hash_mix(hash_r8(p) ^ s[1], hash_r8(p + 8) ^ seed);
+        see1 = hash_mix(hash_r8(p + 16) ^ s[2], hash_r8(p + 24) ^ see1);
+        see2 = hash_mix(hash_r8(p + 32) ^ s[3], hash_r8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (hash_likely(i >= 48));
+      seed ^= see1 ^ see2;
+    }
+    while (hash_unlikely(i > 16)) {
+      seed = hash_mix(hash_r8(p) ^ s[1], hash_r8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    // The last 16 bytes, overlapping what came before if need be
+    a = hash_r8(p + i - 16);
+    b = hash_r8(p + i - 8);
+  }
+
+  a ^= s[1];
+  b ^= seed;
+  hash_mum(&a, &b);
+
+  return hash_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+#define SIP_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0, v1, v2, v3) \
+  do {                            \
+    v0 += v1;                     \
+    v1 = SIP_ROTL(v1, 13);        \
+    v1 ^= v0;                     \
+    v0 = SIP_ROTL(v0, 32);        \
+    v2 += v3;                     \
+    v3 = SIP_ROTL(v3, 16);        \
+    v3 ^= v2;                     \
+    v0 += v3;                     \
+    v3 = SIP_ROTL(v3, 21);        \
+    v3 ^= v0;                     \
+    v2 += v1;                     \
+    v1 = SIP_ROTL(v1, 17);        \
+    v1 ^= v2;                     \
+    v2 = SIP_ROTL(v2, 32);        \
+  } while (0)
+
+uint64_t
+nc_siphash(const void *data, size_t len, const uint8_t key[16])
+{
+  const uint8_t *p = data, *end = p + (len & ~(size_t)7);
+  uint64_t k0 = hash_r8(key), k1 = hash_r8(key + 8), m, b;
+  uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+  uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+  uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+  uint64_t v3 = 0x7465646279746573ULL ^ k1;
+  size_t left;
+
+  for (; p != end; p += 8) {
+    m = hash_r8(p);
+    v3 ^= m;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= m;
+  }
+
+  // Last block: the remaining bytes and the length in the top byte
+  b = (uint64_t)len << 56;
+  for (left = len & 7; left > 0; left--) {
+    b |= (uint64_t)p[left - 1] << (8 * (left - 1));
+  }
+
+  v3 ^= b;
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+size_t
+nc_hash_sds(const void *key)
+{
+  return (size_t)nc_hash_bytes(key, sdslen((const sds)key), hash_seed);
+}
+
+size_t
+nc_hash_sds_sip(const void *key)
+{
+  return (size_t)nc_siphash(key, sdslen((const sds)key), hash_key);
+}
+
+int
+nc_hash_sds_eq(const void *key1, const void *key2)
+{
+  size_t len = sdslen((const sds)key1);
+
+  return len == sdslen((const sds)key2) && memcmp(key1, key2, len) == 0;
+}
+
+size_t
+nc_hash_str(const void *key)
+{
+  return (size_t)nc_hash_bytes(key, strlen(key), hash_seed);
+}
+
+size_t
+nc_hash_str_sip(const void *key)
+{
+  return (size_t)nc_siphash(key, strlen(key), hash_key);
+}
+
+int
+nc_hash_str_eq(const void *key1, const void *key2)
+{
+  return strcmp(key1, key2) == 0;
+}
+
+size_t
+nc_hash_int64p(const void *key)
+{
+  return (size_t)nc_hash_int64(*(const uint64_t *)key ^ hash_seed);
+}
+
+int
+nc_hash_int64p_eq(const void *key1, const void *key2)
+{
+  return *(const int64_t *)key1 == *(const int64_t *)key2;
+}
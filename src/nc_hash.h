@@ -0,0 +1,56 @@
+#ifndef LIBNC_NC_HASH_H_
+#define LIBNC_NC_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Hash functions.
+//
+// nc_hash_bytes()  - wyhash style: 64-bit multiply-fold, 48 bytes per
+//                    round in three independent lanes. Fast, well
+//                    distributed, but not meant to resist keys chosen by
+//                    an attacker.
+// nc_siphash()     - SipHash-2-4 with a 128-bit key, for keys that come
+//                    from the network or other untrusted sources.
+// nc_hash_int64()  - bijective 64-bit mixer for integer keys.
+//
+// The nc_hash_sds*(), nc_hash_str*() and nc_hash_int64p*() functions are
+// ready-made nc_hashtable hash and compare callbacks. The sds ones take
+// lengths from sdslen() instead of scanning for the NUL. The _sip
+// variants hash with SipHash. All of them use the process-wide seed set
+// with nc_hash_seed(); set it once, before creating tables, since tables
+// built with a different seed can't be searched any more.
+//
+
+void nc_hash_seed(const uint8_t seed[16]);
+
+uint64_t nc_hash_bytes(const void *p, size_t len, uint64_t seed);
+uint64_t nc_siphash(const void *p, size_t len, const uint8_t key[16]);
+
+static inline uint64_t
+nc_hash_int64(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// Keys are sds strings
+size_t nc_hash_sds(const void *key);
+size_t nc_hash_sds_sip(const void *key);
+int nc_hash_sds_eq(const void *key1, const void *key2);
+
+// Keys are NUL terminated C strings
+size_t nc_hash_str(const void *key);
+size_t nc_hash_str_sip(const void *key);
+int nc_hash_str_eq(const void *key1, const void *key2);
+
+// Keys point to int64_t values
+size_t nc_hash_int64p(const void *key);
+int nc_hash_int64p_eq(const void *key1, const void *key2);
+
+#endif  // LIBNC_NC_HASH_H_
@@ -0,0 +1,395 @@
+#ifndef LIBNC_NC_HASHMAP_H_
+#define LIBNC_NC_HASHMAP_H_
+
+#include <stdint.h>
+#include <string.h>  // memset
+
+#include "nc_macros.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NC_HASHMAP_SSE2 1
+#endif
+
+//
+// Type-specialized hash maps, generated by
+//
+//   NC_HASHMAP_DEFINE(name, key_t, val_t, hash_fn, eq_fn)
+//
+// which defines struct nc_hashmap_<name> and these static inline functions:
+//
+//   int nc_hashmap_<name>_init(struct nc_hashmap_<name> *m, size_t n);
+//   void nc_hashmap_<name>_deinit(struct nc_hashmap_<name> *m);
+//   void nc_hashmap_<name>_clear(struct nc_hashmap_<name> *m);
+//   int nc_hashmap_<name>_reserve(struct nc_hashmap_<name> *m, size_t n);
+//   val_t *nc_hashmap_<name>_get(struct nc_hashmap_<name> *m, key_t key);
+//   val_t *nc_hashmap_<name>_insert(struct nc_hashmap_<name> *m, key_t key,
+//                                   int *inserted);
+//   int nc_hashmap_<name>_put(struct nc_hashmap_<name> *m, key_t key,
+//                             val_t value);
+//   int nc_hashmap_<name>_del(struct nc_hashmap_<name> *m, key_t key);
+//   size_t nc_hashmap_<name>_next(struct nc_hashmap_<name> *m, size_t i);
+//
+// 'hash_fn(key)' and 'eq_fn(a, b)' are expression macros or inline
+// functions taking keys by value. The hash is mixed before use, so an
+// identity hash is fine for integer keys. Keys and values are stored
+// inline in one flat array, in the same SwissTable layout as
+// NC_HASHTABLE_OPEN tables, with no allocation per entry and no indirect
+// call per probe. The map never frees keys or values.
+//
+// init() sizes the map for n entries; init(), reserve() and put() return
+// NC_OK or NC_ENOMEM. get() returns a pointer to the value, or NULL.
+// insert() returns a pointer to the value of key, adding the key first
+// if needed, in which case it sets *inserted and leaves the value for the
+// caller to fill in; NULL if that needed memory that wasn't there. del()
+// returns NC_OK, or NC_ERROR if the key isn't there. Value pointers, and
+// slot indices, stay valid until the next insert or put of a new key.
+//
+// Entries are m->entries[i] for the indices i < m->capacity returned by
+// next(), which finds the first used slot at or after i:
+//
+//   for (i = nc_hashmap_x_next(m, 0); i < m->capacity;
+//        i = nc_hashmap_x_next(m, i + 1)) {
+//     use(m->entries[i].key, m->entries[i].value);
+//   }
+//
+
+#define NC_HASHMAP_GROUP 16
+#define NC_HASHMAP_MIN_CAPACITY 16
+
+#define NC_HASHMAP_EMPTY ((uint8_t)0x80)
+#define NC_HASHMAP_DELETED ((uint8_t)0xfe)
+
+#define nc_hashmap_full(_c) (((_c) & 0x80) == 0)
+
+static inline size_t
+nc_hashmap_mix(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+
+  return (size_t)x;
+}
+
+static inline uint8_t
+nc_hashmap_h2(size_t hash)
+{
+  return (uint8_t)(hash & 0x7f);
+}
+
+static inline unsigned
+nc_hashmap_ctz(uint32_t m)
+{
+#if defined(__GNUC__)
+  return (unsigned)__builtin_ctz(m);
+#else
+  unsigned n = 0;
+
+  while (!(m & 1)) {
+    m >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// Bit i set for each control byte i of the group equal to c.
+static inline uint32_t
+nc_hashmap_match(const uint8_t *g, uint8_t c)
+{
+#if (NC_HASHMAP_SSE2)
+  __m128i v = _mm_loadu_si128((const __m128i *)g);
+
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)c)));
+#else
+  uint32_t m = 0;
+  int i;
+
+  for (i = 0; i < NC_HASHMAP_GROUP; i++) {
+    m |= (uint32_t)(g[i] == c) << i;
+  }
+  return m;
+#endif
+}
+
+// Bit i set for each EMPTY or DELETED control byte of the group.
+static inline uint32_t
+nc_hashmap_match_free(const uint8_t *g)
+{
+#if (NC_HASHMAP_SSE2)
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+#else
+  uint32_t m = 0;
+  int i;
+
+  for (i = 0; i < NC_HASHMAP_GROUP; i++) {
+    m |= (uint32_t)(g[i] >> 7) << i;
+  }
+  return m;
+#endif
+}
+
+// Index of a free slot on the probe sequence of hash.
+static inline size_t
+nc_hashmap_find_free(const uint8_t *ctrl, size_t capacity, size_t hash)
+{
+  size_t g, gmask, i;
+  uint32_t m;
+
+  gmask = capacity / NC_HASHMAP_GROUP - 1;
+  g = (hash >> 7) & gmask;
+
+  for (i = 1;; i++) {
+    m = nc_hashmap_match_free(ctrl + g * NC_HASHMAP_GROUP);
+    if (m != 0) {
+      return g * NC_HASHMAP_GROUP + nc_hashmap_ctz(m);
+    }
+    g = (g + i) & gmask;
+  }
+}
+
+// Marks slot s unused. A probe only ever continued past its group if the
+// group had no EMPTY byte; if it has one, the slot can be EMPTY again.
+static inline void
+nc_hashmap_erase(uint8_t *ctrl, size_t *growth_left, size_t s)
+{
+  if (nc_hashmap_match(ctrl + s / NC_HASHMAP_GROUP * NC_HASHMAP_GROUP,
+                       NC_HASHMAP_EMPTY) != 0) {
+    ctrl[s] = NC_HASHMAP_EMPTY;
+    (*growth_left)++;
+  } else {
+    ctrl[s] = NC_HASHMAP_DELETED;
+  }
+}
+
+// Smallest capacity of at least 'capacity' that holds n entries at 7/8.
+static inline size_t
+nc_hashmap_capacity(size_t capacity, size_t n)
+{
+  if (capacity < NC_HASHMAP_MIN_CAPACITY) {
+    capacity = NC_HASHMAP_MIN_CAPACITY;
+  }
+  while (capacity - capacity / 8 < n) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+#define NC_HASHMAP_DEFINE(name, key_t, val_t, hash_fn, eq_fn)                \
+  struct nc_hashmap_##name##_entry {                                         \
+    key_t key;                                                               \
+    val_t value;                                                             \
+  };                                                                         \
+                                                                             \
+  struct nc_hashmap_##name {                                                 \
+    uint8_t *ctrl; /* one control byte per slot */                           \
+    struct nc_hashmap_##name##_entry *entries;                               \
+    size_t capacity;    /* slots, a power of two */                          \
+    size_t size;        /* entries */                                        \
+    size_t growth_left; /* inserts into empty slots before resize */         \
+  };                                                                         \
+                                                                             \
+  static inline size_t nc_hashmap_##name##_hash(key_t key)                   \
+  {                                                                          \
+    return nc_hashmap_mix((uint64_t)(hash_fn(key)));                         \
+  }                                                                          \
+                                                                             \
+  static inline int nc_hashmap_##name##_alloc(struct nc_hashmap_##name *m,   \
+                                             size_t capacity)                \
+  {                                                                          \
+    u_char *p;                                                               \
+                                                                             \
+    /* entries first keeps them aligned, control bytes follow */             \
+    p = nc_alloc(capacity *                                                  \
+                 (sizeof(struct nc_hashmap_##name##_entry) + 1));            \
+    if (p == NULL) {                                                         \
+      return NC_ENOMEM;                                                      \
+    }                                                                        \
+                                                                             \
+    m->entries = (struct nc_hashmap_##name##_entry *)p;                      \
+    m->ctrl = p + capacity * sizeof(struct nc_hashmap_##name##_entry);       \
+    m->capacity = capacity;                                                  \
+    m->growth_left = capacity - capacity / 8;                                \
+    memset(m->ctrl, NC_HASHMAP_EMPTY, capacity);                             \
+                                                                             \
+    return NC_OK;                                                            \
+  }                                                                          \
+                                                                             \
+  /* slot holding key, or m->capacity */                                     \
+  static inline size_t nc_hashmap_##name##_find(                             \
+      struct nc_hashmap_##name *m, key_t key, size_t hash)                   \
+  {                                                                          \
+    const uint8_t *g;                                                        \
+    size_t gi, gmask, i, s;                                                  \
+    uint32_t bits;                                                           \
+                                                                             \
+    gmask = m->capacity / NC_HASHMAP_GROUP - 1;                              \
+    gi = (hash >> 7) & gmask;                                                \
+                                                                             \
+    for (i = 1; i <= gmask + 1; i++) {                                       \
+      g = m->ctrl + gi * NC_HASHMAP_GROUP;                                   \
+      for (bits = nc_hashmap_match(g, nc_hashmap_h2(hash)); bits != 0;       \
+           bits &= bits - 1) {                                               \
+        s = gi * NC_HASHMAP_GROUP + nc_hashmap_ctz(bits);                    \
+        if (eq_fn(m->entries[s].key, key)) {                                 \
+          return s;                                                          \
+        }                                                                    \
+      }                                                                      \
+      if (nc_hashmap_match(g, NC_HASHMAP_EMPTY) != 0) {                      \
+        break;                                                               \
+      }                                                                      \
+      gi = (gi + i) & gmask;                                                 \
+    }                                                                        \
+                                                                             \
+    return m->capacity;                                                      \
+  }                                                                          \
+                                                                             \
+  static inline int nc_hashmap_##name##_resize(struct nc_hashmap_##name *m,  \
+                                              size_t capacity)               \
+  {                                                                          \
+    struct nc_hashmap_##name old = *m;                                       \
+    size_t i, s, hash;                                                       \
+                                                                             \
+    if (nc_hashmap_##name##_alloc(m, capacity) != NC_OK) {                   \
+      *m = old;                                                              \
+      return NC_ENOMEM;                                                      \
+    }                                                                        \
+                                                                             \
+    for (i = 0; i < old.capacity; i++) {                                     \
+      if (!nc_hashmap_full(old.ctrl[i])) {                                   \
+        continue;                                                            \
+      }                                                                      \
+      hash = nc_hashmap_##name##_hash(old.entries[i].key);                   \
+      s = nc_hashmap_find_free(m->ctrl, m->capacity, hash);                  \
+      m->ctrl[s] = nc_hashmap_h2(hash);                                      \
+      m->entries[s] = old.entries[i];                                        \
+    }                                                                        \
+    m->growth_left -= m->size;                                               \
+                                                                             \
+    nc_free(old.entries);                                                    \
+                                                                             \
+    return NC_OK;                                                            \
+  }                                                                          \
+                                                                             \
+  static inline int nc_hashmap_##name##_init(struct nc_hashmap_##name *m,    \
+                                            size_t n)                        \
+  {                                                                          \
+    m->size = 0;                                                             \
+    return nc_hashmap_##name##_alloc(m, nc_hashmap_capacity(0, n));          \
+  }                                                                          \
+                                                                             \
+  static inline void nc_hashmap_##name##_deinit(                             \
+      struct nc_hashmap_##name *m)                                           \
+  {                                                                          \
+    nc_free(m->entries);                                                     \
+    m->ctrl = NULL;                                                          \
+    m->capacity = 0;                                                         \
+    m->size = 0;                                                             \
+  }                                                                          \
+                                                                             \
+  static inline void nc_hashmap_##name##_clear(struct nc_hashmap_##name *m)  \
+  {                                                                          \
+    memset(m->ctrl, NC_HASHMAP_EMPTY, m->capacity);                          \
+    m->growth_left = m->capacity - m->capacity / 8;                          \
+    m->size = 0;                                                             \
+  }                                                                          \
+                                                                             \
+  static inline int nc_hashmap_##name##_reserve(                             \
+      struct nc_hashmap_##name *m, size_t n)                                 \
+  {                                                                          \
+    size_t capacity = nc_hashmap_capacity(m->capacity, n);                   \
+                                                                             \
+    if (capacity == m->capacity) {                                           \
+      return NC_OK;                                                          \
+    }                                                                        \
+    return nc_hashmap_##name##_resize(m, capacity);                          \
+  }                                                                          \
+                                                                             \
+  static inline val_t *nc_hashmap_##name##_get(struct nc_hashmap_##name *m,  \
+                                              key_t key)                     \
+  {                                                                          \
+    size_t hash = nc_hashmap_##name##_hash(key);                             \
+    size_t s = nc_hashmap_##name##_find(m, key, hash);                       \
+                                                                             \
+    return s == m->capacity ? NULL : &m->entries[s].value;                   \
+  }                                                                          \
+                                                                             \
+  static inline val_t *nc_hashmap_##name##_insert(                           \
+      struct nc_hashmap_##name *m, key_t key, int *inserted)                 \
+  {                                                                          \
+    size_t hash, s, capacity;                                                \
+                                                                             \
+    hash = nc_hashmap_##name##_hash(key);                                    \
+                                                                             \
+    s = nc_hashmap_##name##_find(m, key, hash);                              \
+    if (s != m->capacity) {                                                  \
+      *inserted = 0;                                                         \
+      return &m->entries[s].value;                                           \
+    }                                                                        \
+                                                                             \
+    s = nc_hashmap_find_free(m->ctrl, m->capacity, hash);                    \
+                                                                             \
+    if (m->growth_left == 0 && m->ctrl[s] == NC_HASHMAP_EMPTY) {             \
+      /* mostly DELETED slots: rehash in place, otherwise double */          \
+      capacity = m->capacity;                                                \
+      if (m->size >= (capacity - capacity / 8) / 2) {                        \
+        capacity *= 2;                                                       \
+      }                                                                      \
+      if (nc_hashmap_##name##_resize(m, capacity) != NC_OK) {                \
+        return NULL;                                                         \
+      }                                                                      \
+      s = nc_hashmap_find_free(m->ctrl, m->capacity, hash);                  \
+    }                                                                        \
+                                                                             \
+    if (m->ctrl[s] == NC_HASHMAP_EMPTY) {                                    \
+      m->growth_left--;                                                      \
+    }                                                                        \
+    m->ctrl[s] = nc_hashmap_h2(hash);                                        \
+    m->entries[s].key = key;                                                 \
+    m->size++;                                                               \
+                                                                             \
+    *inserted = 1;                                                           \
+    return &m->entries[s].value;                                             \
+  }                                                                          \
+                                                                             \
+  static inline int nc_hashmap_##name##_put(struct nc_hashmap_##name *m,     \
+                                           key_t key, val_t value)           \
+  {                                                                          \
+    val_t *v;                                                                \
+    int inserted;                                                            \
+                                                                             \
+    v = nc_hashmap_##name##_insert(m, key, &inserted);                       \
+    if (v == NULL) {                                                         \
+      return NC_ENOMEM;                                                      \
+    }                                                                        \
+    *v = value;                                                              \
+    return NC_OK;                                                            \
+  }                                                                          \
+                                                                             \
+  static inline int nc_hashmap_##name##_del(struct nc_hashmap_##name *m,     \
+                                           key_t key)                        \
+  {                                                                          \
+    size_t hash = nc_hashmap_##name##_hash(key);                             \
+    size_t s = nc_hashmap_##name##_find(m, key, hash);                       \
+                                                                             \
+    if (s == m->capacity) {                                                  \
+      return NC_ERROR;                                                       \
+    }                                                                        \
+    nc_hashmap_erase(m->ctrl, &m->growth_left, s);                           \
+    m->size--;                                                               \
+    return NC_OK;                                                            \
+  }                                                                          \
+                                                                             \
+  static inline size_t nc_hashmap_##name##_next(                             \
+      struct nc_hashmap_##name *m, size_t i)                                 \
+  {                                                                          \
+    for (; i < m->capacity; i++) {                                           \
+      if (nc_hashmap_full(m->ctrl[i])) {                                     \
+        break;                                                               \
+      }                                                                      \
+    }                                                                        \
+    return i;                                                                \
+  }
+
+#endif  // LIBNC_NC_HASHMAP_H_
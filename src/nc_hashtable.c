@@ -1,13 +1,39 @@
 #include "nc_hashtable.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "nc_hashtable_concurrent.h"
+#include "nc_hashtable_open.h"
 #include "nc_macros.h"
 
 typedef struct hashtable_list list_t;
 typedef struct hashtable_pair pair_t;
 typedef struct hashtable_bucket bucket_t;
 
+#if defined(__GNUC__)
+#define hashtable_prefetch(p) __builtin_prefetch(p)
+#else
+#define hashtable_prefetch(p)
+#endif
+
+/* Chained pairs are carved in order out of slabs of 'n' pairs of
+   pair_size bytes; deleted ones go on a free list for the next insert.
+   The slabs are only given back, all at once, by clear and deinit. */
+struct hashtable_slab {
+  struct hashtable_slab *next;
+  size_t n;
+  size_t used;
+  u_char data[];
+};
+
+#define SLAB_MIN_PAIRS 32
+#define SLAB_MAX_PAIRS 16384
+
+/* Embedded keys and values start 8-byte aligned */
+#define EMBED_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
 #define container_of(ptr_, type_, member_) \
   ((type_ *)((char *)ptr_ - offsetof(type_, member_)))
 
@@ -36,16 +62,18 @@ list_remove(list_t *list)
   list->next->prev = list->prev;
 }
 
+/* Empty buckets are all zeroes, so a bucket array comes from calloc()
+   and large ones cost nothing to clear up front. */
 static inline int
-bucket_is_empty(struct nc_hashtable *hashtable, bucket_t *bucket)
+bucket_is_empty(bucket_t *bucket)
 {
-  return bucket->first == &hashtable->list && bucket->first == bucket->last;
+  return bucket->first == NULL;
 }
 
 static void
 insert_to_bucket(struct nc_hashtable *hashtable, bucket_t *bucket, list_t *list)
 {
-  if (bucket_is_empty(hashtable, bucket)) {
+  if (bucket_is_empty(bucket)) {
     list_insert(&hashtable->list, list);
     bucket->first = bucket->last = list;
   } else {
@@ -54,6 +82,21 @@ insert_to_bucket(struct nc_hashtable *hashtable, bucket_t *bucket, list_t *list)
   }
 }
 
+static void
+remove_from_bucket(bucket_t *bucket, list_t *list)
+{
+  if (list == bucket->first && list == bucket->last)
+    bucket->first = bucket->last = NULL;
+
+  else if (list == bucket->first)
+    bucket->first = list->next;
+
+  else if (list == bucket->last)
+    bucket->last = list->prev;
+
+  list_remove(list);
+}
+
 static size_t primes[] = {5,         13,        23,        53,        97,
                           193,       389,       769,       1543,      3079,
                           6151,      12289,     24593,     49157,     98317,
@@ -61,10 +104,60 @@ static size_t primes[] = {5,         13,        23,        53,        97,
                           6291469,   12582917,  25165843,  50331653,  100663319,
                           201326611, 402653189, 805306457, 1610612741};
 
+#define POW2_MIN_SHIFT 3
+
+/* Old buckets emptied by each set while rehashing, and how many
+   empty ones it may skip per bucket. Redis moves one bucket per call; a
+   few more shorten the time every lookup has to check both arrays. */
+#define REHASH_STEP 8
+#define REHASH_EMPTY_VISITS 10
+
+/* Keys nc_hashtable_build() looks ahead to prefetch their bucket */
+#define BUILD_PREFETCH 8
+
+/* Keys nc_hashtable_get_many() has in flight at a time */
+#define GET_MANY_BATCH 16
+
+static inline size_t
+bucket_count(struct nc_hashtable *hashtable, size_t order)
+{
+  if (hashtable->flags & NC_HASHTABLE_POW2)
+    return (size_t)1 << (order + POW2_MIN_SHIFT);
+
+  return primes[order];
+}
+
 static inline size_t
 num_buckets(struct nc_hashtable *hashtable)
 {
-  return primes[hashtable->num_buckets];
+  return bucket_count(hashtable, hashtable->num_buckets);
+}
+
+/* The num_buckets value for at least n buckets, capped by the primes */
+static size_t
+bucket_order(struct nc_hashtable *hashtable, size_t n)
+{
+  size_t order = 0;
+
+  while (bucket_count(hashtable, order) < n) {
+    if (!(hashtable->flags & NC_HASHTABLE_POW2) &&
+        order + 1 == sizeof(primes) / sizeof(primes[0]))
+      break;
+    order++;
+  }
+
+  return order;
+}
+
+/* A mask only keeps the low bits of the hash, which is why the hash is
+   mixed first; with a prime bucket count every bit counts already. */
+static inline size_t
+bucket_index(struct nc_hashtable *hashtable, size_t hash, size_t n)
+{
+  if (hashtable->flags & NC_HASHTABLE_POW2)
+    return hashtable_mix(hash) & (n - 1);
+
+  return hash % n;
 }
 
 static pair_t *
@@ -74,7 +167,7 @@ hashtable_find_pair(struct nc_hashtable *hashtable, bucket_t *bucket,
   list_t *list;
   pair_t *pair;
 
-  if (bucket_is_empty(hashtable, bucket))
+  if (bucket_is_empty(bucket))
     return NULL;
 
   list = bucket->first;
@@ -92,38 +185,144 @@ hashtable_find_pair(struct nc_hashtable *hashtable, bucket_t *bucket,
   return NULL;
 }
 
-/* returns 0 on success, -1 if key was not found */
-static int
-hashtable_do_del(struct nc_hashtable *hashtable, const void *key, size_t hash)
+/* Returns the pair of key, or NULL, and in *bucketp the bucket holding it
+   or where to add it. While rehashing, pairs not moved yet are still in
+   the old buckets at or above rehash_idx. */
+static pair_t *
+hashtable_lookup(struct nc_hashtable *hashtable, const void *key, size_t hash,
+                 bucket_t **bucketp)
 {
   pair_t *pair;
   bucket_t *bucket;
   size_t index;
 
-  index = hash % num_buckets(hashtable);
+  if (hashtable->old_buckets) {
+    index = bucket_index(hashtable, hash, hashtable->old_num_buckets);
+    if (index >= hashtable->rehash_idx) {
+      bucket = &hashtable->old_buckets[index];
+      pair = hashtable_find_pair(hashtable, bucket, key, hash);
+      if (pair) {
+        if (bucketp)
+          *bucketp = bucket;
+        return pair;
+      }
+    }
+  }
+
+  index = bucket_index(hashtable, hash, num_buckets(hashtable));
   bucket = &hashtable->buckets[index];
+  if (bucketp)
+    *bucketp = bucket;
 
-  pair = hashtable_find_pair(hashtable, bucket, key, hash);
-  if (!pair)
-    return -1;
+  return hashtable_find_pair(hashtable, bucket, key, hash);
+}
+
+static inline pair_t *
+slab_pair(struct nc_hashtable *hashtable, struct hashtable_slab *slab,
+          size_t i)
+{
+  return (pair_t *)(slab->data + i * hashtable->pair_size);
+}
+
+static struct hashtable_slab *
+hashtable_new_slab(struct nc_hashtable *hashtable, size_t n)
+{
+  struct hashtable_slab *slab;
+
+  slab = nc_alloc(sizeof(struct hashtable_slab) + n * hashtable->pair_size);
+  if (!slab)
+    return NULL;
+
+  slab->n = n;
+  slab->used = 0;
+
+  return slab;
+}
+
+/* Embedded key and value bytes follow the pair */
+static inline void
+pair_init(struct nc_hashtable *hashtable, pair_t *pair)
+{
+  if (hashtable->flags & NC_HASHTABLE_EMBED) {
+    pair->key = (u_char *)pair + sizeof(pair_t);
+    pair->value = (u_char *)pair->key + EMBED_ALIGN(hashtable->key_size);
+  }
+}
+
+static inline void
+pair_set_key(struct nc_hashtable *hashtable, pair_t *pair, void *key)
+{
+  if (hashtable->flags & NC_HASHTABLE_EMBED)
+    memcpy(pair->key, key, hashtable->key_size);
+  else
+    pair->key = key;
+}
+
+static inline void
+pair_set_value(struct nc_hashtable *hashtable, struct hashtable_slot *slot,
+               void *value)
+{
+  if (hashtable->flags & NC_HASHTABLE_EMBED)
+    memcpy(slot->value, value, hashtable->value_size);
+  else
+    slot->value = value;
+}
+
+static pair_t *
+hashtable_alloc_pair(struct nc_hashtable *hashtable)
+{
+  struct hashtable_slab *slab = hashtable->slabs;
+  list_t *list = hashtable->free_pairs;
+  pair_t *pair;
+
+  if (list) {
+    hashtable->free_pairs = list->next;
+    return list_to_pair(list);
+  }
+
+  if (!slab || slab->used == slab->n) {
+    slab = hashtable_new_slab(hashtable, hashtable->slab_pairs);
+    if (!slab)
+      return NULL;
+
+    slab->next = hashtable->slabs;
+    hashtable->slabs = slab;
+    if (hashtable->slab_pairs < SLAB_MAX_PAIRS)
+      hashtable->slab_pairs *= 2;
+  }
+
+  pair = slab_pair(hashtable, slab, slab->used++);
+  pair_init(hashtable, pair);
 
-  if (&pair->list == bucket->first && &pair->list == bucket->last)
-    bucket->first = bucket->last = &hashtable->list;
+  return pair;
+}
+
+static inline void
+hashtable_free_pair(struct nc_hashtable *hashtable, pair_t *pair)
+{
+  pair->list.next = hashtable->free_pairs;
+  hashtable->free_pairs = &pair->list;
+}
 
-  else if (&pair->list == bucket->first)
-    bucket->first = pair->list.next;
+/* returns 0 on success, -1 if key was not found */
+static int
+hashtable_do_del(struct nc_hashtable *hashtable, const void *key, size_t hash)
+{
+  pair_t *pair;
+  bucket_t *bucket;
 
-  else if (&pair->list == bucket->last)
-    bucket->last = pair->list.prev;
+  pair = hashtable_lookup(hashtable, key, hash, &bucket);
+  if (!pair)
+    return -1;
 
-  list_remove(&pair->list);
+  remove_from_bucket(bucket, &pair->list);
 
   if (hashtable->free_key)
     hashtable->free_key(pair->key);
   if (hashtable->free_value)
     hashtable->free_value(pair->value);
 
-  nc_free(pair);
+  hashtable_free_pair(hashtable, pair);
   hashtable->size--;
 
   return 0;
@@ -132,39 +331,124 @@ hashtable_do_del(struct nc_hashtable *hashtable, const void *key, size_t hash)
 static void
 hashtable_do_clear(struct nc_hashtable *hashtable)
 {
+  struct hashtable_slab *slab;
   list_t *list, *next;
   pair_t *pair;
 
-  for (list = hashtable->list.next; list != &hashtable->list; list = next) {
-    next = list->next;
-    pair = list_to_pair(list);
-    if (hashtable->free_key)
-      hashtable->free_key(pair->key);
-    if (hashtable->free_value)
-      hashtable->free_value(pair->value);
-    nc_free(pair);
+  if (hashtable->free_key || hashtable->free_value) {
+    for (list = hashtable->list.next; list != &hashtable->list; list = next) {
+      next = list->next;
+      pair = list_to_pair(list);
+      if (hashtable->free_key)
+        hashtable->free_key(pair->key);
+      if (hashtable->free_value)
+        hashtable->free_value(pair->value);
+    }
   }
+
+  while (hashtable->slabs) {
+    slab = hashtable->slabs;
+    hashtable->slabs = slab->next;
+    nc_free(slab);
+  }
+
+  hashtable->free_pairs = NULL;
+  hashtable->slab_pairs = SLAB_MIN_PAIRS;
 }
 
+/* Switches to the next bucket array size. The pairs stay in the old
+   buckets and move over a few buckets at a time. */
 static int
-hashtable_do_rehash(struct nc_hashtable *hashtable)
+hashtable_rehash_start(struct nc_hashtable *hashtable)
 {
-  list_t *list, *next;
-  pair_t *pair;
-  size_t i, index, new_size;
+  bucket_t *buckets;
+  size_t n;
 
-  nc_free(hashtable->buckets);
+  if (bucket_order(hashtable, num_buckets(hashtable) + 1) ==
+      hashtable->num_buckets)
+    return 0;
+
+  n = bucket_count(hashtable, hashtable->num_buckets + 1);
+
+  buckets = nc_calloc(n, sizeof(bucket_t));
+  if (!buckets)
+    return -1;
+
+  hashtable->old_buckets = hashtable->buckets;
+  hashtable->old_num_buckets = num_buckets(hashtable);
+  hashtable->rehash_idx = 0;
 
+  hashtable->buckets = buckets;
   hashtable->num_buckets++;
-  new_size = num_buckets(hashtable);
 
-  hashtable->buckets = nc_alloc(new_size * sizeof(bucket_t));
-  if (!hashtable->buckets)
+  return 0;
+}
+
+/* Moves the pairs of up to n old buckets, skipping at most
+   n * REHASH_EMPTY_VISITS empty ones. Returns 1 while old buckets are
+   left, 0 once the rehash is done. */
+static int
+hashtable_rehash_buckets(struct nc_hashtable *hashtable, size_t n)
+{
+  size_t empty_visits = n * REHASH_EMPTY_VISITS, index;
+  bucket_t *old;
+  list_t *list;
+  pair_t *pair;
+
+  while (n > 0 && hashtable->rehash_idx < hashtable->old_num_buckets) {
+    old = &hashtable->old_buckets[hashtable->rehash_idx++];
+
+    if (bucket_is_empty(old)) {
+      if (--empty_visits == 0)
+        break;
+      continue;
+    }
+
+    while (!bucket_is_empty(old)) {
+      list = old->first;
+      remove_from_bucket(old, list);
+
+      pair = list_to_pair(list);
+      index = bucket_index(hashtable, pair->hash, num_buckets(hashtable));
+      insert_to_bucket(hashtable, &hashtable->buckets[index], list);
+    }
+    n--;
+  }
+
+  if (hashtable->rehash_idx < hashtable->old_num_buckets)
+    return 1;
+
+  nc_free(hashtable->old_buckets);
+  hashtable->old_buckets = NULL;
+  hashtable->old_num_buckets = 0;
+  hashtable->rehash_idx = 0;
+
+  return 0;
+}
+
+/* Moves every pair to 'order' buckets at once, in list order, which also
+   ends an incremental rehash: the list holds the pairs of both arrays. */
+static int
+hashtable_rehash_to(struct nc_hashtable *hashtable, size_t order)
+{
+  bucket_t *buckets;
+  list_t *list, *next;
+  pair_t *pair;
+  size_t n, index;
+
+  n = bucket_count(hashtable, order);
+  buckets = nc_calloc(n, sizeof(bucket_t));
+  if (!buckets)
     return -1;
 
-  for (i = 0; i < num_buckets(hashtable); i++) {
-    hashtable->buckets[i].first = hashtable->buckets[i].last = &hashtable->list;
+  if (hashtable->old_buckets) {
+    nc_free(hashtable->old_buckets);
+    hashtable->old_num_buckets = 0;
+    hashtable->rehash_idx = 0;
   }
+  nc_free(hashtable->buckets);
+  hashtable->buckets = buckets;
+  hashtable->num_buckets = order;
 
   list = hashtable->list.next;
   list_init(&hashtable->list);
@@ -172,8 +456,8 @@ hashtable_do_rehash(struct nc_hashtable *hashtable)
   for (; list != &hashtable->list; list = next) {
     next = list->next;
     pair = list_to_pair(list);
-    index = pair->hash % new_size;
-    insert_to_bucket(hashtable, &hashtable->buckets[index], &pair->list);
+    index = bucket_index(hashtable, pair->hash, n);
+    insert_to_bucket(hashtable, &hashtable->buckets[index], list);
   }
 
   return 0;
@@ -184,12 +468,22 @@ nc_hashtable_create(nc_hashtable_key_hash_pt hash_key,
                     nc_hashtable_key_cmp_pt cmp_keys,
                     nc_hashtable_free_pt free_key,
                     nc_hashtable_free_pt free_value)
+{
+  return nc_hashtable_create_ex(hash_key, cmp_keys, free_key, free_value, 0);
+}
+
+struct nc_hashtable *
+nc_hashtable_create_ex(nc_hashtable_key_hash_pt hash_key,
+                       nc_hashtable_key_cmp_pt cmp_keys,
+                       nc_hashtable_free_pt free_key,
+                       nc_hashtable_free_pt free_value, unsigned flags)
 {
   struct nc_hashtable *hashtable = nc_alloc(sizeof(struct nc_hashtable));
   if (!hashtable)
     return NULL;
 
-  if (nc_hashtable_init(hashtable, hash_key, cmp_keys, free_key, free_value)) {
+  if (nc_hashtable_init_capacity(hashtable, hash_key, cmp_keys, free_key,
+                                 free_value, flags, 0)) {
     nc_free(hashtable);
     return NULL;
   }
@@ -211,32 +505,126 @@ nc_hashtable_init(struct nc_hashtable *hashtable,
                   nc_hashtable_free_pt free_key,
                   nc_hashtable_free_pt free_value)
 {
-  size_t i;
+  return nc_hashtable_init_ex(hashtable, hash_key, cmp_keys, free_key,
+                              free_value, 0);
+}
+
+int
+nc_hashtable_init_ex(struct nc_hashtable *hashtable,
+                     nc_hashtable_key_hash_pt hash_key,
+                     nc_hashtable_key_cmp_pt cmp_keys,
+                     nc_hashtable_free_pt free_key,
+                     nc_hashtable_free_pt free_value, unsigned flags)
+{
+  return nc_hashtable_init_capacity(hashtable, hash_key, cmp_keys, free_key,
+                                    free_value, flags, 0);
+}
 
+int
+nc_hashtable_init_capacity(struct nc_hashtable *hashtable,
+                           nc_hashtable_key_hash_pt hash_key,
+                           nc_hashtable_key_cmp_pt cmp_keys,
+                           nc_hashtable_free_pt free_key,
+                           nc_hashtable_free_pt free_value, unsigned flags,
+                           size_t capacity)
+{
   hashtable->size = 0;
+  hashtable->hash_key = hash_key;
+  hashtable->cmp_keys = cmp_keys;
+  hashtable->free_key = free_key;
+  hashtable->free_value = free_value;
+  hashtable->flags = flags;
+
+  hashtable->ctrl = NULL;
+  hashtable->slots = NULL;
+  hashtable->capacity = 0;
+  hashtable->growth_left = 0;
+  hashtable->concurrent = NULL;
+
   hashtable->num_buckets = 0; /* index to primes[] */
-  hashtable->buckets = nc_alloc(num_buckets(hashtable) * sizeof(bucket_t));
+  hashtable->buckets = NULL;
+  hashtable->old_buckets = NULL;
+  hashtable->old_num_buckets = 0;
+  hashtable->rehash_idx = 0;
+  hashtable->slabs = NULL;
+  hashtable->free_pairs = NULL;
+  hashtable->slab_pairs = SLAB_MIN_PAIRS;
+  hashtable->pair_size = sizeof(pair_t);
+  hashtable->key_size = 0;
+  hashtable->value_size = 0;
+  list_init(&hashtable->list);
+
+  if (flags & NC_HASHTABLE_OPEN)
+    return hashtable_open_init(hashtable, capacity);
+
+  if (flags & NC_HASHTABLE_CONCURRENT) {
+    NC_ASSERT(flags == NC_HASHTABLE_CONCURRENT);
+    return hashtable_concurrent_init(hashtable, capacity);
+  }
+
+  hashtable->num_buckets = bucket_order(hashtable, capacity);
+  hashtable->buckets = nc_calloc(num_buckets(hashtable), sizeof(bucket_t));
   if (!hashtable->buckets)
     return -1;
 
-  list_init(&hashtable->list);
+  return 0;
+}
 
-  hashtable->hash_key = hash_key;
-  hashtable->cmp_keys = cmp_keys;
-  hashtable->free_key = free_key;
-  hashtable->free_value = free_value;
+struct nc_hashtable *
+nc_hashtable_create_embed(nc_hashtable_key_hash_pt hash_key,
+                          nc_hashtable_key_cmp_pt cmp_keys, size_t key_size,
+                          size_t value_size, unsigned flags)
+{
+  struct nc_hashtable *hashtable = nc_alloc(sizeof(struct nc_hashtable));
+  if (!hashtable)
+    return NULL;
 
-  for (i = 0; i < num_buckets(hashtable); i++) {
-    hashtable->buckets[i].first = hashtable->buckets[i].last = &hashtable->list;
+  if (nc_hashtable_init_embed(hashtable, hash_key, cmp_keys, key_size,
+                              value_size, flags)) {
+    nc_free(hashtable);
+    return NULL;
   }
 
+  return hashtable;
+}
+
+int
+nc_hashtable_init_embed(struct nc_hashtable *hashtable,
+                        nc_hashtable_key_hash_pt hash_key,
+                        nc_hashtable_key_cmp_pt cmp_keys, size_t key_size,
+                        size_t value_size, unsigned flags)
+{
+  NC_ASSERT(!(flags & (NC_HASHTABLE_OPEN | NC_HASHTABLE_CONCURRENT)));
+  if (flags & (NC_HASHTABLE_OPEN | NC_HASHTABLE_CONCURRENT))
+    return -1;
+
+  if (nc_hashtable_init_capacity(hashtable, hash_key, cmp_keys, NULL, NULL,
+                                 flags | NC_HASHTABLE_EMBED, 0))
+    return -1;
+
+  hashtable->key_size = key_size;
+  hashtable->value_size = value_size;
+  hashtable->pair_size =
+      sizeof(pair_t) + EMBED_ALIGN(key_size) + EMBED_ALIGN(value_size);
+
   return 0;
 }
 
 void
 nc_hashtable_deinit(struct nc_hashtable *hashtable)
 {
+  if (hashtable->flags & NC_HASHTABLE_OPEN) {
+    hashtable_open_deinit(hashtable);
+    return;
+  }
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT) {
+    hashtable_concurrent_deinit(hashtable);
+    return;
+  }
+
   hashtable_do_clear(hashtable);
+  if (hashtable->old_buckets)
+    nc_free(hashtable->old_buckets);
   nc_free(hashtable->buckets);
 }
 
@@ -245,31 +633,37 @@ nc_hashtable_set(struct nc_hashtable *hashtable, void *key, void *value)
 {
   pair_t *pair;
   bucket_t *bucket;
-  size_t hash, index;
+  size_t hash;
 
-  /* rehash if the load ratio exceeds 1 */
-  if (hashtable->size >= num_buckets(hashtable))
-    if (hashtable_do_rehash(hashtable))
+  if (hashtable->flags & NC_HASHTABLE_OPEN)
+    return hashtable_open_set(hashtable, key, value);
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_set(hashtable, key, value);
+
+  /* start a rehash if the load ratio exceeds 1, the next sets finish it
+     before the new buckets fill up */
+  if (hashtable->old_buckets)
+    hashtable_rehash_buckets(hashtable, REHASH_STEP);
+  else if (hashtable->size >= num_buckets(hashtable))
+    if (hashtable_rehash_start(hashtable))
       return -1;
 
   hash = hashtable->hash_key(key);
-  index = hash % num_buckets(hashtable);
-  bucket = &hashtable->buckets[index];
-  pair = hashtable_find_pair(hashtable, bucket, key, hash);
+  pair = hashtable_lookup(hashtable, key, hash, &bucket);
 
   if (pair) {
     if (hashtable->free_key)
       hashtable->free_key(key);
     if (hashtable->free_value)
       hashtable->free_value(pair->value);
-    pair->value = value;
+    pair_set_value(hashtable, (struct hashtable_slot *)pair, value);
   } else {
-    pair = nc_alloc(sizeof(pair_t));
+    pair = hashtable_alloc_pair(hashtable);
     if (!pair)
       return -1;
 
-    pair->key = key;
-    pair->value = value;
+    pair_set_key(hashtable, pair, key);
+    pair_set_value(hashtable, (struct hashtable_slot *)pair, value);
     pair->hash = hash;
     list_init(&pair->list);
 
@@ -283,95 +677,356 @@ nc_hashtable_set(struct nc_hashtable *hashtable, void *key, void *value)
 void *
 nc_hashtable_get(struct nc_hashtable *hashtable, const void *key)
 {
+  struct hashtable_slot *slot;
   pair_t *pair;
-  size_t hash;
-  bucket_t *bucket;
 
-  hash = hashtable->hash_key(key);
-  bucket = &hashtable->buckets[hash % num_buckets(hashtable)];
+  if (hashtable->flags & NC_HASHTABLE_OPEN) {
+    slot = hashtable_open_find(hashtable, key);
+    return slot ? slot->value : NULL;
+  }
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_get(hashtable, key);
 
-  pair = hashtable_find_pair(hashtable, bucket, key, hash);
+  pair = hashtable_lookup(hashtable, key, hashtable->hash_key(key), NULL);
   if (!pair)
     return NULL;
 
   return pair->value;
 }
 
+size_t
+nc_hashtable_get_many(struct nc_hashtable *hashtable, void **keys, size_t n,
+                      void **values)
+{
+  size_t hash[GET_MANY_BATCH], i, j, m, nb, found = 0;
+  bucket_t *bucket[GET_MANY_BATCH];
+  pair_t *pair;
+
+  if (hashtable->flags & NC_HASHTABLE_OPEN)
+    return hashtable_open_get_many(hashtable, keys, n, values);
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_get_many(hashtable, keys, n, values);
+
+  /* Each stage only touches memory the previous one prefetched, so the
+     misses of a batch overlap instead of following one another. While
+     rehashing, the old buckets are not prefetched. */
+  nb = num_buckets(hashtable);
+
+  for (i = 0; i < n; i += m) {
+    m = MIN(n - i, GET_MANY_BATCH);
+
+    for (j = 0; j < m; j++) {
+      hash[j] = hashtable->hash_key(keys[i + j]);
+      bucket[j] = &hashtable->buckets[bucket_index(hashtable, hash[j], nb)];
+      hashtable_prefetch(bucket[j]);
+    }
+
+    for (j = 0; j < m; j++) {
+      if (!bucket_is_empty(bucket[j]))
+        hashtable_prefetch(list_to_pair(bucket[j]->first));
+    }
+
+    for (j = 0; j < m; j++) {
+      pair = hashtable_lookup(hashtable, keys[i + j], hash[j], NULL);
+      if (pair) {
+        values[i + j] = pair->value;
+        found++;
+      } else {
+        values[i + j] = NULL;
+      }
+    }
+  }
+
+  return found;
+}
+
+size_t
+nc_hashtable_size(struct nc_hashtable *hashtable)
+{
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_size(hashtable);
+
+  return hashtable->size;
+}
+
 int
 nc_hashtable_del(struct nc_hashtable *hashtable, const void *key)
 {
-  size_t hash = hashtable->hash_key(key);
+  size_t hash;
+
+  if (hashtable->flags & NC_HASHTABLE_OPEN)
+    return hashtable_open_del(hashtable, key);
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_del(hashtable, key);
+
+  /* no rehash step here: moving pairs reorders the list, and deleting
+     the pair an iterator just left must not disturb the iteration */
+  hash = hashtable->hash_key(key);
   return hashtable_do_del(hashtable, key, hash);
 }
 
+int
+nc_hashtable_reserve(struct nc_hashtable *hashtable, size_t n)
+{
+  size_t order;
+
+  if (hashtable->flags & NC_HASHTABLE_OPEN)
+    return hashtable_open_reserve(hashtable, n);
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_reserve(hashtable, n);
+
+  order = bucket_order(hashtable, n);
+  if (order <= hashtable->num_buckets) {
+    if (!hashtable->old_buckets)
+      return 0;
+    order = hashtable->num_buckets;
+  }
+
+  return hashtable_rehash_to(hashtable, order);
+}
+
+int
+nc_hashtable_build(struct nc_hashtable *hashtable, void **keys, void **values,
+                   size_t n)
+{
+  struct hashtable_slab *slab;
+  pair_t *pair, *found;
+  bucket_t *bucket;
+  size_t i, index;
+
+  if (n == 0)
+    return 0;
+
+  if (nc_hashtable_reserve(hashtable, nc_hashtable_size(hashtable) + n))
+    return -1;
+
+  if (hashtable->flags & (NC_HASHTABLE_OPEN | NC_HASHTABLE_CONCURRENT)) {
+    for (i = 0; i < n; i++) {
+      if (nc_hashtable_set(hashtable, keys[i], values[i]))
+        return -1;
+    }
+    return 0;
+  }
+
+  /* One slab for all of them, behind the current one so that one's
+     remaining pairs are still handed out */
+  slab = hashtable_new_slab(hashtable, n);
+  if (!slab)
+    return -1;
+
+  slab->used = n;
+  if (hashtable->slabs) {
+    slab->next = hashtable->slabs->next;
+    hashtable->slabs->next = slab;
+  } else {
+    slab->next = NULL;
+    hashtable->slabs = slab;
+  }
+
+  /* Hash everything first, then look up buckets a few keys behind their
+     prefetches. reserve() ended any rehash, so there is one array. */
+  for (i = 0; i < n; i++) {
+    slab_pair(hashtable, slab, i)->hash = hashtable->hash_key(keys[i]);
+  }
+
+  for (i = 0; i < n; i++) {
+    if (i + BUILD_PREFETCH < n) {
+      pair = slab_pair(hashtable, slab, i + BUILD_PREFETCH);
+      index = bucket_index(hashtable, pair->hash, num_buckets(hashtable));
+      hashtable_prefetch(&hashtable->buckets[index]);
+    }
+
+    pair = slab_pair(hashtable, slab, i);
+    pair_init(hashtable, pair);
+
+    found = hashtable_lookup(hashtable, keys[i], pair->hash, &bucket);
+    if (found) {
+      if (hashtable->free_key)
+        hashtable->free_key(keys[i]);
+      if (hashtable->free_value)
+        hashtable->free_value(found->value);
+      pair_set_value(hashtable, (struct hashtable_slot *)found, values[i]);
+      hashtable_free_pair(hashtable, pair);
+      continue;
+    }
+
+    pair_set_key(hashtable, pair, keys[i]);
+    pair_set_value(hashtable, (struct hashtable_slot *)pair, values[i]);
+    insert_to_bucket(hashtable, bucket, &pair->list);
+    hashtable->size++;
+  }
+
+  return 0;
+}
+
+static long
+rehash_usec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int
+nc_hashtable_rehash_step(struct nc_hashtable *hashtable, long budget_us)
+{
+  long start;
+
+  if (!hashtable->old_buckets)
+    return 0;
+
+  start = rehash_usec();
+  while (hashtable_rehash_buckets(hashtable, 100)) {
+    if (rehash_usec() - start >= budget_us)
+      return 1;
+  }
+
+  return 0;
+}
+
 void
 nc_hashtable_clear(struct nc_hashtable *hashtable)
 {
-  size_t i;
+  if (hashtable->flags & NC_HASHTABLE_OPEN) {
+    hashtable_open_clear(hashtable);
+    return;
+  }
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT) {
+    hashtable_concurrent_clear(hashtable);
+    return;
+  }
 
   hashtable_do_clear(hashtable);
 
-  for (i = 0; i < num_buckets(hashtable); i++) {
-    hashtable->buckets[i].first = hashtable->buckets[i].last = &hashtable->list;
+  if (hashtable->old_buckets) {
+    nc_free(hashtable->old_buckets);
+    hashtable->old_buckets = NULL;
+    hashtable->old_num_buckets = 0;
+    hashtable->rehash_idx = 0;
   }
+  memset(hashtable->buckets, 0, num_buckets(hashtable) * sizeof(bucket_t));
 
   list_init(&hashtable->list);
   hashtable->size = 0;
 }
 
+/* Iterators point to the pair, or to the slot of an open table; both
+   start with the key and the value. */
 void *
 nc_hashtable_iter(struct nc_hashtable *hashtable)
 {
-  return nc_hashtable_iter_next(hashtable, &hashtable->list);
+  if (hashtable->flags & NC_HASHTABLE_OPEN)
+    return hashtable_open_next(hashtable, NULL);
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_next(hashtable, NULL);
+
+  if (hashtable->list.next == &hashtable->list)
+    return NULL;
+  return list_to_pair(hashtable->list.next);
 }
 
 void *
 nc_hashtable_iter_at(struct nc_hashtable *hashtable, const void *key)
 {
-  pair_t *pair;
-  size_t hash;
-  bucket_t *bucket;
+  if (hashtable->flags & NC_HASHTABLE_OPEN)
+    return hashtable_open_find(hashtable, key);
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_find(hashtable, key);
 
-  hash = hashtable->hash_key(key);
-  bucket = &hashtable->buckets[hash % num_buckets(hashtable)];
-
-  pair = hashtable_find_pair(hashtable, bucket, key, hash);
-  if (!pair)
-    return NULL;
-
-  return &pair->list;
+  return hashtable_lookup(hashtable, key, hashtable->hash_key(key), NULL);
 }
 
 void *
 nc_hashtable_iter_next(struct nc_hashtable *hashtable, void *iter)
 {
-  list_t *list = (list_t *)iter;
-  if (list->next == &hashtable->list)
+  list_t *list;
+
+  if (hashtable->flags & NC_HASHTABLE_OPEN)
+    return hashtable_open_next(hashtable, iter);
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_next(hashtable, iter);
+
+  list = ((pair_t *)iter)->list.next;
+  if (list == &hashtable->list)
     return NULL;
-  return list->next;
+  return list_to_pair(list);
 }
 
 void *
 nc_hashtable_iter_key(void *iter)
 {
-  pair_t *pair = list_to_pair((list_t *)iter);
-  return pair->key;
+  return ((struct hashtable_slot *)iter)->key;
 }
 
 void *
 nc_hashtable_iter_value(void *iter)
 {
-  pair_t *pair = list_to_pair((list_t *)iter);
-  return pair->value;
+  return ((struct hashtable_slot *)iter)->value;
 }
 
 void
 nc_hashtable_iter_set(struct nc_hashtable *hashtable, void *iter, void *value)
 {
-  pair_t *pair = list_to_pair((list_t *)iter);
+  struct hashtable_slot *slot = iter;
+
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT) {
+    hashtable_concurrent_iter_set(hashtable, slot, value);
+    return;
+  }
 
   if (hashtable->free_value)
-    hashtable->free_value(pair->value);
+    hashtable->free_value(slot->value);
 
-  pair->value = value;
+  pair_set_value(hashtable, slot, value);
+}
+
+size_t
+nc_hashtable_num_buckets(struct nc_hashtable *hashtable)
+{
+  if (hashtable->flags & NC_HASHTABLE_OPEN)
+    return hashtable->capacity;
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT)
+    return hashtable_concurrent_num_buckets(hashtable);
+
+  return num_buckets(hashtable) + hashtable->old_num_buckets;
+}
+
+void
+nc_hashtable_foreach_buckets(struct nc_hashtable *hashtable, size_t lo,
+                             size_t hi, nc_hashtable_pair_pt fn, void *ctx)
+{
+  bucket_t *bucket;
+  list_t *list;
+  pair_t *pair;
+  size_t i;
+
+  if (hashtable->flags & NC_HASHTABLE_OPEN) {
+    hashtable_open_foreach(hashtable, lo, hi, fn, ctx);
+    return;
+  }
+  if (hashtable->flags & NC_HASHTABLE_CONCURRENT) {
+    hashtable_concurrent_foreach(hashtable, lo, hi, fn, ctx);
+    return;
+  }
+
+  NC_ASSERT(hi <= num_buckets(hashtable) + hashtable->old_num_buckets);
+
+  // While rehashing, the old buckets follow the new ones
+  for (i = lo; i < hi; i++) {
+    if (i < num_buckets(hashtable))
+      bucket = &hashtable->buckets[i];
+    else
+      bucket = &hashtable->old_buckets[i - num_buckets(hashtable)];
+    if (bucket_is_empty(bucket))
+      continue;
+
+    // The pairs of a bucket are adjacent in the list, first to last
+    for (list = bucket->first;; list = list->next) {
+      pair = list_to_pair(list);
+      fn(pair->key, pair->value, ctx);
+      if (list == bucket->last)
+        break;
+    }
+  }
 }
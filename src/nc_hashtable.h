@@ -9,16 +9,31 @@
 #define LIBNC_NC_HASHTABLE_H_
 
 #include <stddef.h>  // size_t
+#include <stdint.h>
+
+// nc_hashtable_create_ex() flags
+#define NC_HASHTABLE_OPEN 0x0001 /* open addressing engine */
+#define NC_HASHTABLE_POW2 0x0002 /* power-of-two bucket counts */
+#define NC_HASHTABLE_EMBED 0x0004 /* set by nc_hashtable_init_embed() */
+#define NC_HASHTABLE_CONCURRENT 0x0008 /* thread safe, lock-free reads */
 
 typedef size_t (*nc_hashtable_key_hash_pt)(const void *key);
 typedef int (*nc_hashtable_key_cmp_pt)(const void *key1, const void *key2);
 typedef void (*nc_hashtable_free_pt)(void *key);
+typedef void (*nc_hashtable_pair_pt)(void *key, void *value, void *ctx);
 
 struct hashtable_list {
   struct hashtable_list *prev;
   struct hashtable_list *next;
 };
 
+/* Open addressing slot. Iterators point to a slot or to a pair, which
+   starts with the same two fields. */
+struct hashtable_slot {
+  void *key;
+  void *value;
+};
+
 struct hashtable_pair {
   void *key;
   void *value;
@@ -34,13 +49,37 @@ struct hashtable_bucket {
 struct nc_hashtable {
   size_t size;
   struct hashtable_bucket *buckets;
-  size_t num_buckets; /* index to primes[] */
+  size_t num_buckets; /* index to primes[], or log2 - 3 with POW2 */
   struct hashtable_list list;
 
+  /* incremental rehash: pairs still to move into 'buckets' */
+  struct hashtable_bucket *old_buckets;
+  size_t old_num_buckets; /* a count, not an index */
+  size_t rehash_idx;      /* old buckets below it are empty */
+
+  /* chained pairs */
+  struct hashtable_slab *slabs;      /* pair memory */
+  struct hashtable_list *free_pairs; /* deleted pairs, through list.next */
+  size_t slab_pairs;                 /* pairs in the next slab */
+  size_t pair_size;
+  size_t key_size;                   /* NC_HASHTABLE_EMBED */
+  size_t value_size;
+
   nc_hashtable_key_hash_pt hash_key;
   nc_hashtable_key_cmp_pt cmp_keys; /* returns non-zero for equal keys */
   nc_hashtable_free_pt free_key;
   nc_hashtable_free_pt free_value;
+
+  unsigned flags;
+
+  /* NC_HASHTABLE_OPEN */
+  uint8_t *ctrl;                /* one control byte per slot */
+  struct hashtable_slot *slots;
+  size_t capacity;              /* slots, a power of two */
+  size_t growth_left;           /* inserts into empty slots before resize */
+
+  /* NC_HASHTABLE_CONCURRENT */
+  struct hashtable_concurrent *concurrent;
 };
 
 /**
@@ -61,6 +100,69 @@ struct nc_hashtable *nc_hashtable_create(nc_hashtable_key_hash_pt hash_key,
                                          nc_hashtable_free_pt free_key,
                                          nc_hashtable_free_pt free_value);
 
+/**
+ * nc_hashtable_create_ex - Create a hashtable object with options
+ *
+ * @hash_key, @cmp_keys, @free_key, @free_value: See nc_hashtable_create()
+ * @flags: 0, NC_HASHTABLE_OPEN, NC_HASHTABLE_POW2 or
+ *     NC_HASHTABLE_CONCURRENT
+ *
+ * With NC_HASHTABLE_OPEN the pairs are stored in a flat slot array with
+ * open addressing (SwissTable layout): a lookup compares a 7-bit tag of
+ * the hash against 16 control bytes at once and usually touches a single
+ * slot. There is no allocation per pair. Inserting may move every pair,
+ * so unlike the chained table, adding keys invalidates iterators;
+ * deleting keys does not move other pairs.
+ *
+ * With NC_HASHTABLE_POW2 the chained table sizes its buckets in powers of
+ * two and picks a bucket with a mask of the mixed hash instead of a
+ * division by a prime. Prime bucket counts stay the default. Open tables
+ * are always power-of-two sized.
+ *
+ * With NC_HASHTABLE_CONCURRENT any number of threads may call the
+ * functions on the table at the same time, except nc_hashtable_deinit()
+ * and nc_hashtable_destroy(). Lookups take no lock and write no shared
+ * memory. Sets and deletes lock one of 64 stripes of the buckets; growing
+ * the table moves no pairs and locks nothing. Keys and values that are
+ * deleted or replaced are freed once no lookup can still be using them
+ * (see nc_epoch.h); nc_hashtable_del() and replacing sets return -1,
+ * changing nothing, if there is no memory to track that. A value
+ * returned by nc_hashtable_get() can be freed as soon as another thread
+ * replaces or deletes it. A caller that uses it afterwards, or holds an
+ * iterator, brackets the calls and the use with nc_epoch_enter() and
+ * nc_epoch_exit(); it may set and delete keys in between. Iterators and nc_hashtable_foreach_buckets() see a
+ * weakly consistent view: pairs that are there from start to end are
+ * seen, others may or may not be, and bucket ranges counted before the
+ * table grew may skip pairs. Not combinable with the other flags; the
+ * size of such a table is nc_hashtable_size(), not the size field.
+ */
+struct nc_hashtable *nc_hashtable_create_ex(nc_hashtable_key_hash_pt hash_key,
+                                            nc_hashtable_key_cmp_pt cmp_keys,
+                                            nc_hashtable_free_pt free_key,
+                                            nc_hashtable_free_pt free_value,
+                                            unsigned flags);
+
+/**
+ * nc_hashtable_create_embed - Create a hashtable that stores key and value
+ * bytes in its pairs
+ *
+ * @hash_key, @cmp_keys: See nc_hashtable_create(); both get pointers to
+ *     key bytes
+ * @key_size: Bytes per key
+ * @value_size: Bytes per value
+ * @flags: 0 or NC_HASHTABLE_POW2
+ *
+ * Keys and values passed to nc_hashtable_set() and nc_hashtable_build()
+ * point to @key_size and @value_size bytes, which are copied into the
+ * pair, so the caller keeps ownership of its own. nc_hashtable_get() and
+ * nc_hashtable_iter_value() return a pointer to the stored value bytes,
+ * valid until the pair is deleted, and nc_hashtable_iter_set() copies new
+ * ones in. Chained tables only.
+ */
+struct nc_hashtable *nc_hashtable_create_embed(
+    nc_hashtable_key_hash_pt hash_key, nc_hashtable_key_cmp_pt cmp_keys,
+    size_t key_size, size_t value_size, unsigned flags);
+
 /**
  * nc_hashtable_destroy - Destroy a hashtable object
  *
@@ -91,6 +193,41 @@ int nc_hashtable_init(struct nc_hashtable *hashtable,
                       nc_hashtable_free_pt free_key,
                       nc_hashtable_free_pt free_value);
 
+/**
+ * nc_hashtable_init_ex - Initialize a hashtable object with options
+ *
+ * Like nc_hashtable_init(), with @flags as for nc_hashtable_create_ex().
+ */
+int nc_hashtable_init_ex(struct nc_hashtable *hashtable,
+                         nc_hashtable_key_hash_pt hash_key,
+                         nc_hashtable_key_cmp_pt cmp_keys,
+                         nc_hashtable_free_pt free_key,
+                         nc_hashtable_free_pt free_value, unsigned flags);
+
+/**
+ * nc_hashtable_init_capacity - Initialize a hashtable object for n pairs
+ *
+ * Like nc_hashtable_init_ex(), but sized up front for @capacity pairs, so
+ * filling it up to that many never rehashes.
+ */
+int nc_hashtable_init_capacity(struct nc_hashtable *hashtable,
+                               nc_hashtable_key_hash_pt hash_key,
+                               nc_hashtable_key_cmp_pt cmp_keys,
+                               nc_hashtable_free_pt free_key,
+                               nc_hashtable_free_pt free_value,
+                               unsigned flags, size_t capacity);
+
+/**
+ * nc_hashtable_init_embed - Initialize a hashtable that stores key and
+ * value bytes in its pairs
+ *
+ * Like nc_hashtable_create_embed().
+ */
+int nc_hashtable_init_embed(struct nc_hashtable *hashtable,
+                            nc_hashtable_key_hash_pt hash_key,
+                            nc_hashtable_key_cmp_pt cmp_keys, size_t key_size,
+                            size_t value_size, unsigned flags);
+
 /**
  * nc_hashtable_deinit - Release all resources used by a hashtable object
  *
@@ -120,6 +257,35 @@ void nc_hashtable_deinit(struct nc_hashtable *hashtable);
  */
 int nc_hashtable_set(struct nc_hashtable *hashtable, void *key, void *value);
 
+/**
+ * nc_hashtable_reserve - Make room for a number of pairs
+ *
+ * @hashtable: The hashtable object
+ * @n: The number of pairs, counting those already in the table
+ *
+ * Grows the table in one step, if needed, so that it holds @n pairs
+ * without rehashing. Returns 0 on success and -1 on error.
+ */
+int nc_hashtable_reserve(struct nc_hashtable *hashtable, size_t n);
+
+/**
+ * nc_hashtable_build - Add many pairs at once
+ *
+ * @hashtable: The hashtable object
+ * @keys: The keys
+ * @values: The values, values[i] going with keys[i]
+ * @n: The number of pairs
+ *
+ * Same as calling nc_hashtable_set() for each pair in order, including
+ * for repeated keys, but reserves room first and, for chained tables,
+ * hashes the keys in one pass and allocates all pairs in a single block.
+ *
+ * Returns 0 on success and -1 on error, in which case some of the pairs
+ * may have been added.
+ */
+int nc_hashtable_build(struct nc_hashtable *hashtable, void **keys,
+                       void **values, size_t n);
+
 /**
  * nc_hashtable_get - Get a value associated with a key
  *
@@ -130,6 +296,35 @@ int nc_hashtable_set(struct nc_hashtable *hashtable, void *key, void *value);
  */
 void *nc_hashtable_get(struct nc_hashtable *hashtable, const void *key);
 
+/**
+ * nc_hashtable_get_many - Get the values of many keys
+ *
+ * @hashtable: The hashtable object
+ * @keys: The keys
+ * @n: The number of keys
+ * @values: Receives the value of keys[i], or NULL, in values[i]
+ *
+ * Same results as nc_hashtable_get() on each key, but the keys are looked
+ * up in small batches: all hashed and their buckets (or control bytes)
+ * prefetched, then their first pairs (or slots), and only then compared.
+ * On tables larger than the cache this overlaps the memory misses of the
+ * batch.
+ *
+ * Returns the number of keys found.
+ */
+size_t nc_hashtable_get_many(struct nc_hashtable *hashtable, void **keys,
+                             size_t n, void **values);
+
+/**
+ * nc_hashtable_size - Return the number of pairs
+ *
+ * @hashtable: The hashtable object
+ *
+ * For NC_HASHTABLE_CONCURRENT tables, a snapshot that may be off while
+ * other threads are setting or deleting keys.
+ */
+size_t nc_hashtable_size(struct nc_hashtable *hashtable);
+
 /**
  * nc_hashtable_del - Remove a value from the hashtable
  *
@@ -140,6 +335,23 @@ void *nc_hashtable_get(struct nc_hashtable *hashtable, const void *key);
  */
 int nc_hashtable_del(struct nc_hashtable *hashtable, const void *key);
 
+/**
+ * nc_hashtable_rehash_step - Advance an incremental rehash
+ *
+ * @hashtable: The hashtable object
+ * @budget_us: Time to spend, in microseconds
+ *
+ * A chained table that outgrows its buckets allocates the next size and
+ * moves the pairs over a few buckets at a time, on each set, instead of
+ * all at once; lookups meanwhile check both bucket arrays. Deleting never
+ * moves pairs. Call this from idle time to finish the move sooner; like
+ * a set, it invalidates iterators while a rehash is in progress. Open
+ * tables still resize in one go and never have a rehash in progress.
+ *
+ * Returns 1 if the rehash is still in progress, 0 otherwise.
+ */
+int nc_hashtable_rehash_step(struct nc_hashtable *hashtable, long budget_us);
+
 /**
  * nc_hashtable_clear - Clear hashtable
  *
@@ -160,9 +372,12 @@ void nc_hashtable_clear(struct nc_hashtable *hashtable);
  *
  * There's no need to free the iterator in any way. The iterator is
  * valid as long as the item that is referenced by the iterator is not
- * deleted. Other values may be added or deleted. In particular,
+ * deleted. Other values may be deleted. In particular,
  * hashtable_iter_next() may be called on an iterator, and after that
  * the key/value pair pointed by the old iterator may be deleted.
+ * Adding values, or nc_hashtable_rehash_step(), may move pairs to other
+ * buckets (a growing table does), after which an iteration may miss or
+ * repeat pairs.
  */
 void *nc_hashtable_iter(struct nc_hashtable *hashtable);
 
@@ -211,4 +426,31 @@ void *nc_hashtable_iter_value(void *iter);
 void nc_hashtable_iter_set(struct nc_hashtable *hashtable, void *iter,
                            void *value);
 
+/**
+ * nc_hashtable_num_buckets - Return the number of buckets
+ *
+ * @hashtable: The hashtable object
+ *
+ * For NC_HASHTABLE_OPEN tables every slot counts as a bucket. While a
+ * chained table is rehashing, its old buckets count too.
+ */
+size_t nc_hashtable_num_buckets(struct nc_hashtable *hashtable);
+
+/**
+ * nc_hashtable_foreach_buckets - Visit the pairs of a range of buckets
+ *
+ * @hashtable: The hashtable object
+ * @lo: First bucket
+ * @hi: One past the last bucket, at most nc_hashtable_num_buckets()
+ * @fn: Called with the key, the value and @ctx of every pair
+ * @ctx: Passed to @fn
+ *
+ * Disjoint bucket ranges hold disjoint sets of pairs, so several threads
+ * may visit different ranges at the same time as long as nobody modifies
+ * the hashtable.
+ */
+void nc_hashtable_foreach_buckets(struct nc_hashtable *hashtable, size_t lo,
+                                  size_t hi, nc_hashtable_pair_pt fn,
+                                  void *ctx);
+
 #endif  // LIBNC_NC_HASHTABLE_H_
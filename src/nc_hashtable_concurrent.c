@@ -0,0 +1,767 @@
+#include "nc_hashtable_concurrent.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "nc_epoch.h"
+#include "nc_hashtable_open.h"  // hashtable_mix()
+#include "nc_macros.h"
+
+//
+// Split-ordered lists (Shalev and Shavit), one per stripe. Writers lock
+// one of CONC_STRIPES mutexes, picked by the low bits of the mixed hash,
+// and each stripe keeps its pairs in a single linked list sorted by the
+// hash with its bits reversed. Buckets are dummy links in that list: the
+// pairs of a bucket all follow the dummy whose sort key is the bucket
+// index reversed, up to the dummy of the next bucket. Bucket counts are
+// powers of two of at least CONC_STRIPES, so a bucket, its dummy and its
+// pairs always belong to the same stripe.
+//
+// Doubling the bucket count splits every bucket in two without moving a
+// pair. The new buckets start out unlinked, and lookups start at the
+// dummy of the parent bucket (the index without its top bit) until a
+// writer links the new one in, after the parent's, the first time it needs
+// it. The dummies live in segments that double in size, so growing
+// allocates the new half and bumps the count; it takes no lock and copies
+// nothing.
+//
+// Readers take no lock: they open an nc_epoch section, load the bucket
+// count and follow the list with acquire loads. An insert fills in a node
+// and links it in with one release store. A delete points the
+// predecessor past the node and retires it. A reader standing on it can
+// still follow its next link further down the same sorted list, and it is
+// freed only after that reader has left its section.
+//
+
+#define CONC_STRIPES 64
+#define CONC_STRIPE_SHIFT 6
+
+// Segment s holds the dummies of buckets [CONC_STRIPES << s,
+// CONC_STRIPES << (s + 1)); the first CONC_STRIPES are the stripe heads.
+#define CONC_SEGMENTS (64 - CONC_STRIPE_SHIFT)
+
+#define CONC_BATCH 16
+
+#if defined(__GNUC__)
+#define conc_prefetch(p) __builtin_prefetch(p)
+#else
+#define conc_prefetch(p)
+#endif
+
+// The sort key is the reversed hash, odd for pairs, or the reversed bucket
+// index, even, for dummies. A dummy's key is stored last when it is linked
+// in, so 0 also means a dummy that isn't in its list yet; walkers step
+// over it either way.
+struct conc_link {
+  _Atomic(struct conc_link *) next;
+  _Atomic(uint64_t) so;
+};
+
+/* Starts like struct hashtable_slot, which iterators are cast to */
+struct conc_node {
+  void *key;
+  _Atomic(void *) value;
+  struct conc_link link;
+  size_t hash; /* mixed */
+};
+
+#define conc_node(_l) \
+  ((struct conc_node *)((u_char *)(_l) - offsetof(struct conc_node, link)))
+
+#define conc_so(_l) atomic_load_explicit(&(_l)->so, memory_order_relaxed)
+
+#define conc_next(_l) atomic_load_explicit(&(_l)->next, memory_order_acquire)
+
+#define CONC_STRIPE_USED                                                     \
+  (sizeof(pthread_mutex_t) + sizeof(atomic_size_t) +                         \
+   sizeof(struct nc_epoch_limbo) + sizeof(struct conc_link))
+
+/* Padded to whole cache lines rather than over-aligned, so the stripes
+   stay on lines of their own in nc_memalign() memory without asking more
+   of the allocator than the type's natural alignment */
+struct conc_stripe {
+  pthread_mutex_t lock;
+  atomic_size_t size;          /* pairs in the stripe's list */
+  struct nc_epoch_limbo limbo; /* retired under the lock */
+  struct conc_link head;       /* dummy of the bucket of the stripe index */
+  u_char pad[NC_CACHELINE_SIZE - CONC_STRIPE_USED % NC_CACHELINE_SIZE];
+};
+
+/* Stripes first, so they start at the allocation's aligned address */
+struct hashtable_concurrent {
+  struct conc_stripe stripes[CONC_STRIPES];
+  atomic_size_t nbuckets; /* a power of two */
+  _Atomic(struct conc_link *) segments[CONC_SEGMENTS];
+};
+
+static inline struct conc_stripe *
+conc_stripe(struct hashtable_concurrent *c, size_t hash)
+{
+  return &c->stripes[hash & (CONC_STRIPES - 1)];
+}
+
+static inline uint64_t
+conc_reverse(uint64_t x)
+{
+  x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+  x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+  x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+#if defined(__GNUC__)
+  return __builtin_bswap64(x);
+#else
+  x = ((x >> 8) & 0x00ff00ff00ff00ffULL) | ((x & 0x00ff00ff00ff00ffULL) << 8);
+  x = ((x >> 16) & 0x0000ffff0000ffffULL) |
+      ((x & 0x0000ffff0000ffffULL) << 16);
+  return (x >> 32) | (x << 32);
+#endif
+}
+
+static inline uint64_t
+conc_so_pair(size_t hash)
+{
+  return conc_reverse((uint64_t)hash) | 1;
+}
+
+static inline uint64_t
+conc_so_dummy(size_t bucket)
+{
+  return conc_reverse((uint64_t)bucket);
+}
+
+// Index of the highest set bit of b > 0
+static inline unsigned
+conc_log2(size_t b)
+{
+#if defined(__GNUC__)
+  return (unsigned)(63 - __builtin_clzll((unsigned long long)b));
+#else
+  unsigned n = 0;
+
+  while (b >>= 1) {
+    n++;
+  }
+  return n;
+#endif
+}
+
+// The bucket that b was split from
+static inline size_t
+conc_parent(size_t b)
+{
+  return b & ~((size_t)1 << conc_log2(b));
+}
+
+// The dummy of bucket b >= CONC_STRIPES, or NULL if its segment isn't
+// there yet
+static inline struct conc_link *
+conc_dummy(struct hashtable_concurrent *c, size_t b)
+{
+  struct conc_link *seg;
+  unsigned s = conc_log2(b) - CONC_STRIPE_SHIFT;
+
+  seg = atomic_load_explicit(&c->segments[s], memory_order_acquire);
+  if (seg == NULL)
+    return NULL;
+
+  return &seg[b - ((size_t)CONC_STRIPES << s)];
+}
+
+// The dummy of bucket b, or of its closest ancestor in the list
+static struct conc_link *
+conc_bucket(struct hashtable_concurrent *c, size_t b)
+{
+  struct conc_link *dummy;
+
+  for (; b >= CONC_STRIPES; b = conc_parent(b)) {
+    dummy = conc_dummy(c, b);
+    if (dummy != NULL &&
+        atomic_load_explicit(&dummy->so, memory_order_acquire) != 0)
+      return dummy;
+  }
+
+  return &c->stripes[b].head;
+}
+
+// The last link from start on that sorts before so. Under the stripe lock.
+static struct conc_link *
+conc_seek(struct conc_link *start, uint64_t so)
+{
+  struct conc_link *prev = start, *next;
+
+  while ((next = atomic_load_explicit(&prev->next, memory_order_relaxed)) &&
+         conc_so(next) < so) {
+    prev = next;
+  }
+  return prev;
+}
+
+// Links l in after prev, which sorts before it. Under the stripe lock.
+static void
+conc_link(struct conc_link *prev, struct conc_link *l)
+{
+  atomic_store_explicit(&l->next,
+                        atomic_load_explicit(&prev->next,
+                                             memory_order_relaxed),
+                        memory_order_relaxed);
+  atomic_store_explicit(&prev->next, l, memory_order_release);
+}
+
+// Under the lock of b's stripe: the dummy of bucket b, linked in first if
+// it isn't yet.
+static struct conc_link *
+conc_bucket_init(struct hashtable_concurrent *c, size_t b)
+{
+  struct conc_link *parent, *dummy;
+  uint64_t so;
+
+  if (b < CONC_STRIPES)
+    return &c->stripes[b].head;
+
+  dummy = conc_dummy(c, b);
+  if (dummy == NULL)
+    return conc_bucket(c, b);
+  if (conc_so(dummy) != 0)
+    return dummy;
+
+  parent = conc_bucket_init(c, conc_parent(b));
+  so = conc_so_dummy(b);
+  conc_link(conc_seek(parent, so), dummy);
+  atomic_store_explicit(&dummy->so, so, memory_order_release);
+
+  return dummy;
+}
+
+// Pairs with the same sort key sit next to each other, from start on
+static struct conc_node *
+conc_lookup(struct nc_hashtable *hashtable, struct conc_link *start,
+            const void *key, size_t hash)
+{
+  struct conc_link *l;
+  struct conc_node *node;
+  uint64_t so = conc_so_pair(hash), lso;
+
+  for (l = conc_next(start); l != NULL && (lso = conc_so(l)) <= so;
+       l = conc_next(l)) {
+    if (lso != so)
+      continue;
+    node = conc_node(l);
+    if (node->hash == hash && hashtable->cmp_keys(node->key, key))
+      return node;
+  }
+
+  return NULL;
+}
+
+static struct conc_node *
+conc_find(struct nc_hashtable *hashtable, const void *key, size_t hash)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  size_t nb;
+
+  nb = atomic_load_explicit(&c->nbuckets, memory_order_acquire);
+
+  return conc_lookup(hashtable, conc_bucket(c, hash & (nb - 1)), key, hash);
+}
+
+/* nc_epoch_free_pt callbacks, ctx is the hashtable */
+
+static void
+conc_retire_node(void *ptr, void *ctx)
+{
+  struct nc_hashtable *hashtable = ctx;
+  struct conc_node *node = ptr;
+
+  if (hashtable->free_key)
+    hashtable->free_key(node->key);
+  if (hashtable->free_value)
+    hashtable->free_value(atomic_load_explicit(&node->value,
+                                               memory_order_relaxed));
+  nc_free(node);
+}
+
+// Frees the pairs of a list of links; dummies go with their segments
+static void
+conc_retire_list(void *ptr, void *ctx)
+{
+  struct conc_link *l, *next;
+
+  for (l = ptr; l != NULL; l = next) {
+    next = atomic_load_explicit(&l->next, memory_order_relaxed);
+    if (conc_so(l) & 1)
+      conc_retire_node(conc_node(l), ctx);
+  }
+}
+
+static void
+conc_retire_value(void *ptr, void *ctx)
+{
+  ((struct nc_hashtable *)ctx)->free_value(ptr);
+}
+
+static void
+conc_lock_all(struct hashtable_concurrent *c)
+{
+  int i;
+
+  for (i = 0; i < CONC_STRIPES; i++) {
+    pthread_mutex_lock(&c->stripes[i].lock);
+  }
+}
+
+static void
+conc_unlock_all(struct hashtable_concurrent *c)
+{
+  int i;
+
+  for (i = CONC_STRIPES - 1; i >= 0; i--) {
+    pthread_mutex_unlock(&c->stripes[i].lock);
+  }
+}
+
+// Buckets for n pairs at a load of at most 1
+static size_t
+conc_nbuckets(size_t n)
+{
+  size_t nb = CONC_STRIPES;
+
+  while (nb < n) {
+    nb <<= 1;
+  }
+  return nb;
+}
+
+// Doubles the bucket count from nb, unless another thread already did.
+// The segment for the new half is published before the count, so a
+// reader that sees the count finds the segment.
+static int
+conc_grow(struct hashtable_concurrent *c, size_t nb)
+{
+  struct conc_link *seg, *expected = NULL;
+  unsigned s = conc_log2(nb) - CONC_STRIPE_SHIFT;
+
+  if (s >= CONC_SEGMENTS)
+    return -1;
+
+  if (atomic_load_explicit(&c->segments[s], memory_order_acquire) == NULL) {
+    seg = nc_calloc(nb, sizeof(seg[0]));
+    if (seg == NULL)
+      return -1;
+    if (!atomic_compare_exchange_strong_explicit(&c->segments[s], &expected,
+                                                 seg, memory_order_acq_rel,
+                                                 memory_order_acquire))
+      nc_free(seg);
+  }
+
+  atomic_compare_exchange_strong_explicit(&c->nbuckets, &nb, nb * 2,
+                                          memory_order_release,
+                                          memory_order_relaxed);
+
+  return 0;
+}
+
+int
+hashtable_concurrent_init(struct nc_hashtable *hashtable, size_t n)
+{
+  struct hashtable_concurrent *c;
+  int i;
+
+  c = nc_memalign(NC_CACHELINE_SIZE, sizeof(*c));
+  if (c == NULL)
+    return -1;
+
+  atomic_init(&c->nbuckets, CONC_STRIPES);
+  for (i = 0; i < CONC_SEGMENTS; i++) {
+    atomic_init(&c->segments[i], NULL);
+  }
+
+  for (i = 0; i < CONC_STRIPES; i++) {
+    pthread_mutex_init(&c->stripes[i].lock, NULL);
+    atomic_init(&c->stripes[i].size, 0);
+    nc_epoch_limbo_init(&c->stripes[i].limbo);
+    atomic_init(&c->stripes[i].head.next, NULL);
+    atomic_init(&c->stripes[i].head.so, conc_so_dummy((size_t)i));
+  }
+
+  hashtable->concurrent = c;
+
+  if (hashtable_concurrent_reserve(hashtable, n)) {
+    hashtable_concurrent_deinit(hashtable);
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+hashtable_concurrent_reserve(struct nc_hashtable *hashtable, size_t n)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  size_t nb, want = conc_nbuckets(n);
+
+  while ((nb = atomic_load_explicit(&c->nbuckets, memory_order_acquire)) <
+         want) {
+    if (conc_grow(c, nb))
+      return -1;
+  }
+
+  return 0;
+}
+
+void
+hashtable_concurrent_deinit(struct nc_hashtable *hashtable)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  struct conc_link *seg;
+  int i;
+
+  for (i = 0; i < CONC_STRIPES; i++) {
+    nc_epoch_drain(&c->stripes[i].limbo);
+    pthread_mutex_destroy(&c->stripes[i].lock);
+    conc_retire_list(atomic_load(&c->stripes[i].head.next), hashtable);
+  }
+
+  for (i = 0; i < CONC_SEGMENTS; i++) {
+    seg = atomic_load(&c->segments[i]);
+    if (seg != NULL)
+      nc_free(seg);
+  }
+
+  nc_free(c);
+  hashtable->concurrent = NULL;
+}
+
+// Clearing unlinks the pairs and keeps the dummies. The unlinked pairs are
+// strung into one list per stripe and retired; a reader still on one of
+// them only compares a few more nodes before it reaches the end.
+void
+hashtable_concurrent_clear(struct nc_hashtable *hashtable)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  struct conc_link *list, *prev, *l, *next;
+  int i;
+
+  conc_lock_all(c);
+
+  for (i = 0; i < CONC_STRIPES; i++) {
+    list = NULL;
+    prev = &c->stripes[i].head;
+
+    for (l = atomic_load_explicit(&prev->next, memory_order_relaxed);
+         l != NULL; l = next) {
+      next = atomic_load_explicit(&l->next, memory_order_relaxed);
+      if (conc_so(l) & 1) {
+        atomic_store_explicit(&l->next, list, memory_order_release);
+        list = l;
+      } else {
+        atomic_store_explicit(&prev->next, l, memory_order_release);
+        prev = l;
+      }
+    }
+    atomic_store_explicit(&prev->next, NULL, memory_order_release);
+
+    if (list != NULL)
+      nc_epoch_retire(&c->stripes[i].limbo, list, conc_retire_list,
+                      hashtable);
+    atomic_store_explicit(&c->stripes[i].size, 0, memory_order_relaxed);
+  }
+
+  conc_unlock_all(c);
+}
+
+int
+hashtable_concurrent_set(struct nc_hashtable *hashtable, void *key,
+                         void *value)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  struct conc_stripe *stripe;
+  struct conc_link *prev, *l;
+  struct conc_node *node;
+  size_t hash, nb, grow = 0;
+  uint64_t so;
+  void *old;
+
+  hash = hashtable_mix(hashtable->hash_key(key));
+  so = conc_so_pair(hash);
+  stripe = conc_stripe(c, hash);
+
+  pthread_mutex_lock(&stripe->lock);
+
+  nb = atomic_load_explicit(&c->nbuckets, memory_order_acquire);
+  prev = conc_seek(conc_bucket_init(c, hash & (nb - 1)), so);
+
+  for (l = atomic_load_explicit(&prev->next, memory_order_relaxed);
+       l != NULL && conc_so(l) == so;
+       l = atomic_load_explicit(&l->next, memory_order_relaxed)) {
+    node = conc_node(l);
+    if (node->hash != hash || !hashtable->cmp_keys(node->key, key))
+      continue;
+    // The old value can't be put back once readers may have seen the new
+    if (hashtable->free_value && nc_epoch_reserve(&stripe->limbo) != NC_OK) {
+      pthread_mutex_unlock(&stripe->lock);
+      return -1;
+    }
+    if (hashtable->free_key)
+      hashtable->free_key(key);
+    old = atomic_exchange_explicit(&node->value, value, memory_order_acq_rel);
+    if (hashtable->free_value)
+      nc_epoch_retire(&stripe->limbo, old, conc_retire_value, hashtable);
+    pthread_mutex_unlock(&stripe->lock);
+    return 0;
+  }
+
+  node = nc_alloc(sizeof(*node));
+  if (node == NULL) {
+    pthread_mutex_unlock(&stripe->lock);
+    return -1;
+  }
+
+  node->key = key;
+  atomic_init(&node->value, value);
+  atomic_init(&node->link.so, so);
+  node->hash = hash;
+  conc_link(prev, &node->link);
+
+  // Grow once this stripe's share of the buckets is at load 1
+  if (atomic_fetch_add_explicit(&stripe->size, 1, memory_order_relaxed) >=
+      nb / CONC_STRIPES)
+    grow = nb;
+
+  pthread_mutex_unlock(&stripe->lock);
+
+  // A failed grow leaves the table usable, only more loaded
+  if (grow != 0)
+    conc_grow(c, grow);
+
+  return 0;
+}
+
+void *
+hashtable_concurrent_get(struct nc_hashtable *hashtable, const void *key)
+{
+  struct conc_node *node;
+  void *value = NULL;
+  size_t hash;
+
+  hash = hashtable_mix(hashtable->hash_key(key));
+
+  nc_epoch_enter();
+  node = conc_find(hashtable, key, hash);
+  if (node != NULL)
+    value = atomic_load_explicit(&node->value, memory_order_acquire);
+  nc_epoch_exit();
+
+  return value;
+}
+
+// One section for all the keys, and each batch hashed and its buckets
+// prefetched before any of it is looked up.
+size_t
+hashtable_concurrent_get_many(struct nc_hashtable *hashtable, void **keys,
+                              size_t n, void **values)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  struct conc_link *start[CONC_BATCH];
+  struct conc_node *node;
+  size_t hash[CONC_BATCH], nb, i, j, m, found = 0;
+
+  nc_epoch_enter();
+
+  nb = atomic_load_explicit(&c->nbuckets, memory_order_acquire);
+
+  for (i = 0; i < n; i += m) {
+    m = MIN(n - i, CONC_BATCH);
+
+    for (j = 0; j < m; j++) {
+      hash[j] = hashtable_mix(hashtable->hash_key(keys[i + j]));
+      start[j] = conc_bucket(c, hash[j] & (nb - 1));
+      conc_prefetch(start[j]);
+    }
+
+    for (j = 0; j < m; j++) {
+      node = conc_lookup(hashtable, start[j], keys[i + j], hash[j]);
+      if (node != NULL) {
+        values[i + j] = atomic_load_explicit(&node->value,
+                                             memory_order_acquire);
+        found++;
+      } else {
+        values[i + j] = NULL;
+      }
+    }
+  }
+
+  nc_epoch_exit();
+
+  return found;
+}
+
+int
+hashtable_concurrent_del(struct nc_hashtable *hashtable, const void *key)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  struct conc_stripe *stripe;
+  struct conc_link *prev, *l;
+  struct conc_node *node = NULL;
+  size_t hash, nb;
+  uint64_t so;
+
+  hash = hashtable_mix(hashtable->hash_key(key));
+  so = conc_so_pair(hash);
+  stripe = conc_stripe(c, hash);
+
+  pthread_mutex_lock(&stripe->lock);
+
+  nb = atomic_load_explicit(&c->nbuckets, memory_order_acquire);
+  prev = conc_seek(conc_bucket(c, hash & (nb - 1)), so);
+
+  for (; (l = atomic_load_explicit(&prev->next, memory_order_relaxed)) &&
+         conc_so(l) == so;
+       prev = l) {
+    node = conc_node(l);
+    if (node->hash == hash && hashtable->cmp_keys(node->key, key))
+      break;
+    node = NULL;
+  }
+
+  if (node == NULL || nc_epoch_reserve(&stripe->limbo) != NC_OK) {
+    pthread_mutex_unlock(&stripe->lock);
+    return -1;
+  }
+
+  atomic_store_explicit(&prev->next,
+                        atomic_load_explicit(&l->next, memory_order_relaxed),
+                        memory_order_release);
+  atomic_fetch_sub_explicit(&stripe->size, 1, memory_order_relaxed);
+  nc_epoch_retire(&stripe->limbo, node, conc_retire_node, hashtable);
+
+  pthread_mutex_unlock(&stripe->lock);
+
+  return 0;
+}
+
+// A snapshot while writers are busy
+size_t
+hashtable_concurrent_size(struct nc_hashtable *hashtable)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  size_t size = 0;
+  int i;
+
+  for (i = 0; i < CONC_STRIPES; i++) {
+    size += atomic_load_explicit(&c->stripes[i].size, memory_order_relaxed);
+  }
+  return size;
+}
+
+struct hashtable_slot *
+hashtable_concurrent_find(struct nc_hashtable *hashtable, const void *key)
+{
+  return (struct hashtable_slot *)conc_find(
+      hashtable, key, hashtable_mix(hashtable->hash_key(key)));
+}
+
+// The next pair down the stripe's list, then on to the next stripe.
+// Pairs never move, so growing the table doesn't disturb an iteration.
+struct hashtable_slot *
+hashtable_concurrent_next(struct nc_hashtable *hashtable,
+                          struct hashtable_slot *slot)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  struct conc_node *node = (struct conc_node *)slot;
+  struct conc_link *l;
+  size_t i = 0;
+
+  if (node == NULL) {
+    l = &c->stripes[0].head;
+  } else {
+    l = &node->link;
+    i = node->hash & (CONC_STRIPES - 1);
+  }
+
+  for (;;) {
+    for (l = conc_next(l); l != NULL; l = conc_next(l)) {
+      if (conc_so(l) & 1)
+        return (struct hashtable_slot *)conc_node(l);
+    }
+    if (++i == CONC_STRIPES)
+      return NULL;
+    l = &c->stripes[i].head;
+  }
+}
+
+// The iterator's pair may have been deleted since, so the value goes to
+// whichever node the table has for the key now. If there is none, or no
+// memory to retire the old value, the new one is freed instead.
+void
+hashtable_concurrent_iter_set(struct nc_hashtable *hashtable,
+                              struct hashtable_slot *slot, void *value)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  struct conc_node *node = (struct conc_node *)slot;
+  struct conc_stripe *stripe;
+  void *old;
+
+  stripe = conc_stripe(c, node->hash);
+
+  pthread_mutex_lock(&stripe->lock);
+
+  node = conc_find(hashtable, node->key, node->hash);
+  if (node != NULL && hashtable->free_value &&
+      nc_epoch_reserve(&stripe->limbo) != NC_OK)
+    node = NULL;
+  if (node != NULL) {
+    old = atomic_exchange_explicit(&node->value, value, memory_order_acq_rel);
+    if (hashtable->free_value)
+      nc_epoch_retire(&stripe->limbo, old, conc_retire_value, hashtable);
+  } else if (hashtable->free_value) {
+    hashtable->free_value(value);
+  }
+
+  pthread_mutex_unlock(&stripe->lock);
+}
+
+size_t
+hashtable_concurrent_num_buckets(struct nc_hashtable *hashtable)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+
+  return atomic_load_explicit(&c->nbuckets, memory_order_acquire);
+}
+
+// Bucket i under the current count runs from its dummy, or an ancestor's,
+// to the first link past it that belongs to another bucket.
+void
+hashtable_concurrent_foreach(struct nc_hashtable *hashtable, size_t lo,
+                             size_t hi, nc_hashtable_pair_pt fn, void *ctx)
+{
+  struct hashtable_concurrent *c = hashtable->concurrent;
+  struct conc_link *l;
+  struct conc_node *node;
+  size_t i, b, mask;
+  uint64_t so, lso;
+
+  // Bucket counts only grow, so hi is still in range
+  mask = atomic_load_explicit(&c->nbuckets, memory_order_acquire) - 1;
+  NC_ASSERT(hi <= mask + 1);
+
+  nc_epoch_enter();
+
+  for (i = lo; i < hi; i++) {
+    so = conc_so_dummy(i);
+    for (l = conc_next(conc_bucket(c, i)); l != NULL; l = conc_next(l)) {
+      lso = conc_so(l);
+      node = lso & 1 ? conc_node(l) : NULL;
+      b = node != NULL ? node->hash & mask : conc_reverse(lso) & mask;
+      if (b != i) {
+        if (lso > so)
+          break;
+        continue;
+      }
+      if (node != NULL)
+        fn(node->key,
+           atomic_load_explicit(&node->value, memory_order_acquire), ctx);
+    }
+  }
+
+  nc_epoch_exit();
+}
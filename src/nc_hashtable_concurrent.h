@@ -0,0 +1,35 @@
+#ifndef LIBNC_NC_HASHTABLE_CONCURRENT_H_
+#define LIBNC_NC_HASHTABLE_CONCURRENT_H_
+
+#include "nc_hashtable.h"
+
+// Engine behind the nc_hashtable_* functions of tables created with
+// NC_HASHTABLE_CONCURRENT. Not part of the public API.
+
+int hashtable_concurrent_init(struct nc_hashtable *hashtable, size_t n);
+int hashtable_concurrent_reserve(struct nc_hashtable *hashtable, size_t n);
+void hashtable_concurrent_deinit(struct nc_hashtable *hashtable);
+void hashtable_concurrent_clear(struct nc_hashtable *hashtable);
+int hashtable_concurrent_set(struct nc_hashtable *hashtable, void *key,
+                             void *value);
+void *hashtable_concurrent_get(struct nc_hashtable *hashtable,
+                               const void *key);
+size_t hashtable_concurrent_get_many(struct nc_hashtable *hashtable,
+                                     void **keys, size_t n, void **values);
+int hashtable_concurrent_del(struct nc_hashtable *hashtable, const void *key);
+size_t hashtable_concurrent_size(struct nc_hashtable *hashtable);
+
+// Iterators; the caller stays inside an nc_epoch section while it holds one
+struct hashtable_slot *hashtable_concurrent_find(struct nc_hashtable *hashtable,
+                                                 const void *key);
+struct hashtable_slot *hashtable_concurrent_next(struct nc_hashtable *hashtable,
+                                                 struct hashtable_slot *slot);
+void hashtable_concurrent_iter_set(struct nc_hashtable *hashtable,
+                                   struct hashtable_slot *slot, void *value);
+
+size_t hashtable_concurrent_num_buckets(struct nc_hashtable *hashtable);
+void hashtable_concurrent_foreach(struct nc_hashtable *hashtable, size_t lo,
+                                  size_t hi, nc_hashtable_pair_pt fn,
+                                  void *ctx);
+
+#endif  // LIBNC_NC_HASHTABLE_CONCURRENT_H_
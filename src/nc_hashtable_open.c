@@ -0,0 +1,307 @@
+#include "nc_hashtable_open.h"
+
+#include <string.h>
+
+#include "nc_hashmap.h"
+#include "nc_macros.h"
+
+//
+// SwissTable layout: 'capacity' slots of (key, value) and one control
+// byte per slot, in aligned groups of 16. A control byte is EMPTY,
+// DELETED, or the low 7 bits of the hash (h2) of the key in the slot. The
+// remaining hash bits (h1) pick the first group to probe; probing moves
+// on to group + 1, + 3, + 6, ... (triangular numbers, which visit every
+// group of a power-of-two table) until a group with an EMPTY byte.
+//
+// At most 7/8 of the slots are used, counting DELETED ones, so every
+// probe ends. A lookup compares the 16 control bytes of a group with h2
+// in one SSE2 compare and only looks at slots whose tag matches.
+//
+// The group primitives are the ones of the typed maps in nc_hashmap.h.
+//
+
+#define OPEN_BATCH 16
+
+#if defined(__GNUC__)
+#define open_prefetch(p) __builtin_prefetch(p)
+#else
+#define open_prefetch(p)
+#endif
+
+static inline size_t
+open_group(struct nc_hashtable *hashtable, size_t hash)
+{
+  return (hash >> 7) & (hashtable->capacity / NC_HASHMAP_GROUP - 1);
+}
+
+static int
+open_alloc(struct nc_hashtable *hashtable, size_t capacity)
+{
+  u_char *m;
+
+  // Slots first keeps them pointer aligned, control bytes follow
+  m = nc_alloc(capacity * (sizeof(struct hashtable_slot) + 1));
+  if (m == NULL) {
+    return -1;
+  }
+
+  hashtable->slots = (struct hashtable_slot *)m;
+  hashtable->ctrl = m + capacity * sizeof(struct hashtable_slot);
+  hashtable->capacity = capacity;
+  hashtable->growth_left = capacity - capacity / 8;
+  memset(hashtable->ctrl, NC_HASHMAP_EMPTY, capacity);
+
+  return 0;
+}
+
+// Moves every pair to fresh arrays of 'capacity' slots, which also drops
+// the DELETED markers.
+static int
+open_resize(struct nc_hashtable *hashtable, size_t capacity)
+{
+  struct hashtable_slot *old_slots = hashtable->slots;
+  uint8_t *old_ctrl = hashtable->ctrl;
+  size_t old_capacity = hashtable->capacity, i, j, hash;
+
+  if (open_alloc(hashtable, capacity)) {
+    hashtable->slots = old_slots;
+    hashtable->ctrl = old_ctrl;
+    hashtable->capacity = old_capacity;
+    return -1;
+  }
+
+  for (i = 0; i < old_capacity; i++) {
+    if (!nc_hashmap_full(old_ctrl[i])) {
+      continue;
+    }
+    hash = hashtable_mix(hashtable->hash_key(old_slots[i].key));
+    j = nc_hashmap_find_free(hashtable->ctrl, hashtable->capacity, hash);
+    hashtable->ctrl[j] = nc_hashmap_h2(hash);
+    hashtable->slots[j] = old_slots[i];
+  }
+  hashtable->growth_left -= hashtable->size;
+
+  nc_free(old_slots);
+
+  return 0;
+}
+
+static size_t
+open_lookup(struct nc_hashtable *hashtable, const void *key, size_t hash)
+{
+  const uint8_t *g;
+  size_t gi, gmask, i, slot;
+  uint32_t m;
+  uint8_t h2 = nc_hashmap_h2(hash);
+
+  gmask = hashtable->capacity / NC_HASHMAP_GROUP - 1;
+  gi = open_group(hashtable, hash);
+
+  for (i = 1; i <= gmask + 1; i++) {
+    g = hashtable->ctrl + gi * NC_HASHMAP_GROUP;
+
+    for (m = nc_hashmap_match(g, h2); m != 0; m &= m - 1) {
+      slot = gi * NC_HASHMAP_GROUP + nc_hashmap_ctz(m);
+      if (hashtable->cmp_keys(hashtable->slots[slot].key, key)) {
+        return slot;
+      }
+    }
+
+    if (nc_hashmap_match(g, NC_HASHMAP_EMPTY) != 0) {
+      break;
+    }
+    gi = (gi + i) & gmask;
+  }
+
+  return hashtable->capacity;
+}
+
+int
+hashtable_open_init(struct nc_hashtable *hashtable, size_t n)
+{
+  return open_alloc(hashtable, nc_hashmap_capacity(0, n));
+}
+
+int
+hashtable_open_reserve(struct nc_hashtable *hashtable, size_t n)
+{
+  size_t capacity = nc_hashmap_capacity(hashtable->capacity, n);
+
+  if (capacity == hashtable->capacity)
+    return 0;
+
+  return open_resize(hashtable, capacity);
+}
+
+void
+hashtable_open_clear(struct nc_hashtable *hashtable)
+{
+  size_t i;
+
+  if (hashtable->free_key || hashtable->free_value) {
+    for (i = 0; i < hashtable->capacity; i++) {
+      if (!nc_hashmap_full(hashtable->ctrl[i])) {
+        continue;
+      }
+      if (hashtable->free_key)
+        hashtable->free_key(hashtable->slots[i].key);
+      if (hashtable->free_value)
+        hashtable->free_value(hashtable->slots[i].value);
+    }
+  }
+
+  memset(hashtable->ctrl, NC_HASHMAP_EMPTY, hashtable->capacity);
+  hashtable->growth_left = hashtable->capacity - hashtable->capacity / 8;
+  hashtable->size = 0;
+}
+
+void
+hashtable_open_deinit(struct nc_hashtable *hashtable)
+{
+  hashtable_open_clear(hashtable);
+  nc_free(hashtable->slots);
+  hashtable->ctrl = NULL;
+}
+
+int
+hashtable_open_set(struct nc_hashtable *hashtable, void *key, void *value)
+{
+  size_t hash, slot, capacity;
+
+  hash = hashtable_mix(hashtable->hash_key(key));
+
+  slot = open_lookup(hashtable, key, hash);
+  if (slot != hashtable->capacity) {
+    if (hashtable->free_key)
+      hashtable->free_key(key);
+    if (hashtable->free_value)
+      hashtable->free_value(hashtable->slots[slot].value);
+    hashtable->slots[slot].value = value;
+    return 0;
+  }
+
+  slot = nc_hashmap_find_free(hashtable->ctrl, hashtable->capacity, hash);
+
+  if (hashtable->growth_left == 0 &&
+      hashtable->ctrl[slot] == NC_HASHMAP_EMPTY) {
+    // Mostly DELETED slots: rehash in place, otherwise double
+    capacity = hashtable->capacity;
+    if (hashtable->size >= (capacity - capacity / 8) / 2)
+      capacity *= 2;
+    if (open_resize(hashtable, capacity))
+      return -1;
+    slot = nc_hashmap_find_free(hashtable->ctrl, hashtable->capacity, hash);
+  }
+
+  if (hashtable->ctrl[slot] == NC_HASHMAP_EMPTY)
+    hashtable->growth_left--;
+
+  hashtable->ctrl[slot] = nc_hashmap_h2(hash);
+  hashtable->slots[slot].key = key;
+  hashtable->slots[slot].value = value;
+  hashtable->size++;
+
+  return 0;
+}
+
+struct hashtable_slot *
+hashtable_open_find(struct nc_hashtable *hashtable, const void *key)
+{
+  size_t slot;
+
+  slot = open_lookup(hashtable, key, hashtable_mix(hashtable->hash_key(key)));
+  if (slot == hashtable->capacity)
+    return NULL;
+
+  return &hashtable->slots[slot];
+}
+
+// Same pipeline as the chained get_many: control groups first, then the
+// first slot whose tag matches, then the lookups proper.
+size_t
+hashtable_open_get_many(struct nc_hashtable *hashtable, void **keys, size_t n,
+                        void **values)
+{
+  size_t hash[OPEN_BATCH], group[OPEN_BATCH], i, j, m, slot, found = 0;
+  uint32_t match;
+
+  for (i = 0; i < n; i += m) {
+    m = n - i < OPEN_BATCH ? n - i : OPEN_BATCH;
+
+    for (j = 0; j < m; j++) {
+      hash[j] = hashtable_mix(hashtable->hash_key(keys[i + j]));
+      group[j] = open_group(hashtable, hash[j]) * NC_HASHMAP_GROUP;
+      open_prefetch(hashtable->ctrl + group[j]);
+    }
+
+    for (j = 0; j < m; j++) {
+      match = nc_hashmap_match(hashtable->ctrl + group[j],
+                               nc_hashmap_h2(hash[j]));
+      if (match)
+        open_prefetch(&hashtable->slots[group[j] + nc_hashmap_ctz(match)]);
+    }
+
+    for (j = 0; j < m; j++) {
+      slot = open_lookup(hashtable, keys[i + j], hash[j]);
+      if (slot == hashtable->capacity) {
+        values[i + j] = NULL;
+      } else {
+        values[i + j] = hashtable->slots[slot].value;
+        found++;
+      }
+    }
+  }
+
+  return found;
+}
+
+int
+hashtable_open_del(struct nc_hashtable *hashtable, const void *key)
+{
+  size_t slot;
+
+  slot = open_lookup(hashtable, key, hashtable_mix(hashtable->hash_key(key)));
+  if (slot == hashtable->capacity)
+    return -1;
+
+  if (hashtable->free_key)
+    hashtable->free_key(hashtable->slots[slot].key);
+  if (hashtable->free_value)
+    hashtable->free_value(hashtable->slots[slot].value);
+
+  nc_hashmap_erase(hashtable->ctrl, &hashtable->growth_left, slot);
+  hashtable->size--;
+
+  return 0;
+}
+
+// First used slot after 'slot', or the first one if slot is NULL.
+struct hashtable_slot *
+hashtable_open_next(struct nc_hashtable *hashtable,
+                    struct hashtable_slot *slot)
+{
+  size_t i;
+
+  i = slot == NULL ? 0 : (size_t)(slot - hashtable->slots) + 1;
+
+  for (; i < hashtable->capacity; i++) {
+    if (nc_hashmap_full(hashtable->ctrl[i]))
+      return &hashtable->slots[i];
+  }
+
+  return NULL;
+}
+
+void
+hashtable_open_foreach(struct nc_hashtable *hashtable, size_t lo, size_t hi,
+                       nc_hashtable_pair_pt fn, void *ctx)
+{
+  size_t i;
+
+  NC_ASSERT(hi <= hashtable->capacity);
+
+  for (i = lo; i < hi; i++) {
+    if (nc_hashmap_full(hashtable->ctrl[i]))
+      fn(hashtable->slots[i].key, hashtable->slots[i].value, ctx);
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef LIBNC_NC_HASHTABLE_OPEN_H_
+#define LIBNC_NC_HASHTABLE_OPEN_H_
+
+#include "nc_hashmap.h"
+#include "nc_hashtable.h"
+
+// Open addressing engine behind the nc_hashtable_* functions of tables
+// created with NC_HASHTABLE_OPEN. Not part of the public API.
+
+// Finalizer applied to user hashes before masking them to a power of two.
+// Hash functions often leave the low or high bits constant (pointers,
+// small integers); the mask, and the open tables' 7-bit tags, need all of
+// them mixed in.
+static inline size_t
+hashtable_mix(size_t hash)
+{
+  return nc_hashmap_mix((uint64_t)hash);
+}
+
+int hashtable_open_init(struct nc_hashtable *hashtable, size_t n);
+int hashtable_open_reserve(struct nc_hashtable *hashtable, size_t n);
+void hashtable_open_deinit(struct nc_hashtable *hashtable);
+void hashtable_open_clear(struct nc_hashtable *hashtable);
+int hashtable_open_set(struct nc_hashtable *hashtable, void *key,
+                       void *value);
+struct hashtable_slot *hashtable_open_find(struct nc_hashtable *hashtable,
+                                           const void *key);
+size_t hashtable_open_get_many(struct nc_hashtable *hashtable, void **keys,
+                               size_t n, void **values);
+int hashtable_open_del(struct nc_hashtable *hashtable, const void *key);
+struct hashtable_slot *hashtable_open_next(struct nc_hashtable *hashtable,
+                                           struct hashtable_slot *slot);
+void hashtable_open_foreach(struct nc_hashtable *hashtable, size_t lo,
+                            size_t hi, nc_hashtable_pair_pt fn, void *ctx);
+
+#endif  // LIBNC_NC_HASHTABLE_OPEN_H_
@@ -0,0 +1,306 @@
+#include "nc_heap.h"
+
+#include <string.h>  // memcpy
+
+#define heap_elem(_h, _pos) \
+  ((u_char *)(_h)->elems.elems + (_h)->elems.size * (_pos))
+#define heap_handle(_h, _pos) (((int *)(_h)->handles.elems)[_pos])
+#define heap_position(_h, _handle) (((int *)(_h)->positions.elems)[_handle])
+
+struct nc_heap *
+nc_heap_create(int n, size_t size, int arity, nc_sort_cmp_pt cmp)
+{
+  struct nc_heap *h;
+
+  NC_ASSERT(n > 0 && size != 0);
+  NC_ASSERT(arity == 2 || arity == 4);
+
+  h = nc_zalloc(sizeof(*h));
+  if (h == NULL) {
+    return NULL;
+  }
+
+  h->arity = arity;
+  h->cmp = cmp;
+
+  h->tmp = nc_alloc(size);
+  if (h->tmp == NULL || nc_array_init(&h->elems, n, size) != NC_OK ||
+      nc_array_init(&h->handles, n, sizeof(int)) != NC_OK ||
+      nc_array_init(&h->positions, n, sizeof(int)) != NC_OK ||
+      nc_array_init(&h->free, 4, sizeof(int)) != NC_OK) {
+    nc_heap_destroy(h);
+    return NULL;
+  }
+
+  return h;
+}
+
+void
+nc_heap_destroy(struct nc_heap *h)
+{
+  nc_array_deinit(&h->elems);
+  nc_array_deinit(&h->handles);
+  nc_array_deinit(&h->positions);
+  nc_array_deinit(&h->free);
+  if (h->tmp != NULL) {
+    nc_free(h->tmp);
+  }
+  nc_free(h);
+}
+
+// Stores the element in h->tmp at 'pos' along with its handle.
+static inline void
+heap_place(struct nc_heap *h, int pos, int handle)
+{
+  memcpy(heap_elem(h, pos), h->tmp, h->elems.size);
+  heap_handle(h, pos) = handle;
+  heap_position(h, handle) = pos;
+}
+
+// Moves the element at 'from' into the hole at 'to'.
+static inline void
+heap_move(struct nc_heap *h, int to, int from)
+{
+  memcpy(heap_elem(h, to), heap_elem(h, from), h->elems.size);
+  heap_handle(h, to) = heap_handle(h, from);
+  heap_position(h, heap_handle(h, to)) = to;
+}
+
+// The element with 'handle' is in h->tmp and belongs at or above 'pos'.
+// Returns the position it ended up at.
+static int
+heap_sift_up(struct nc_heap *h, int pos, int handle)
+{
+  int parent;
+
+  while (pos > 0) {
+    parent = (pos - 1) / h->arity;
+    if (h->cmp(h->tmp, heap_elem(h, parent)) >= 0) {
+      break;
+    }
+    heap_move(h, pos, parent);
+    pos = parent;
+  }
+
+  heap_place(h, pos, handle);
+
+  return pos;
+}
+
+// The element with 'handle' is in h->tmp and belongs at or below 'pos'.
+static void
+heap_sift_down(struct nc_heap *h, int pos, int handle)
+{
+  int n = h->elems.nelem, child, best, last;
+
+  for (;;) {
+    child = h->arity * pos + 1;
+    if (child >= n) {
+      break;
+    }
+
+    best = child;
+    last = MIN(child + h->arity, n);
+    for (child++; child < last; child++) {
+      if (h->cmp(heap_elem(h, child), heap_elem(h, best)) < 0) {
+        best = child;
+      }
+    }
+
+    if (h->cmp(heap_elem(h, best), h->tmp) >= 0) {
+      break;
+    }
+
+    heap_move(h, pos, best);
+    pos = best;
+  }
+
+  heap_place(h, pos, handle);
+}
+
+// Re-establishes heap order for the element in h->tmp placed at 'pos'.
+static void
+heap_fix(struct nc_heap *h, int pos, int handle)
+{
+  if (heap_sift_up(h, pos, handle) == pos) {
+    heap_sift_down(h, pos, handle);
+  }
+}
+
+static int
+heap_handle_alloc(struct nc_heap *h)
+{
+  int *handle;
+
+  if (h->free.nelem > 0) {
+    h->free.nelem--;
+    return ((int *)h->free.elems)[h->free.nelem];
+  }
+
+  handle = nc_array_push(&h->positions);
+  if (handle == NULL) {
+    return NC_ENOMEM;
+  }
+  *handle = -1;
+
+  return h->positions.nelem - 1;
+}
+
+static void
+heap_handle_release(struct nc_heap *h, int handle)
+{
+  int *slot;
+
+  heap_position(h, handle) = -1;
+
+  // The free stack was reserved when the handle was allocated
+  slot = nc_array_push(&h->free);
+  NC_ASSERT(slot != NULL);
+  *slot = handle;
+}
+
+// Adds a copy of elem. Returns its handle, or NC_ENOMEM.
+int
+nc_heap_push(struct nc_heap *h, const void *elem)
+{
+  int handle, pos;
+
+  // Releasing a handle must not fail later, keep room for all of them
+  if (nc_array_reserve(&h->elems, 1) != NC_OK ||
+      nc_array_reserve(&h->handles, 1) != NC_OK ||
+      nc_array_reserve(&h->free, h->positions.nelem + 1 - h->free.nelem) !=
+          NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  handle = heap_handle_alloc(h);
+  if (handle < 0) {
+    return NC_ENOMEM;
+  }
+
+  pos = h->elems.nelem++;
+  h->handles.nelem++;
+
+  memcpy(h->tmp, elem, h->elems.size);
+  heap_sift_up(h, pos, handle);
+
+  return handle;
+}
+
+// Removes the element at 'pos', copying it to elem if that is not NULL.
+static void
+heap_remove_at(struct nc_heap *h, int pos, void *elem)
+{
+  int handle, last;
+
+  handle = heap_handle(h, pos);
+  if (elem != NULL) {
+    memcpy(elem, heap_elem(h, pos), h->elems.size);
+  }
+  heap_handle_release(h, handle);
+
+  last = --h->elems.nelem;
+  h->handles.nelem--;
+
+  if (pos != last) {
+    memcpy(h->tmp, heap_elem(h, last), h->elems.size);
+    heap_fix(h, pos, heap_handle(h, last));
+  }
+}
+
+// Removes the top element, copying it to elem if that is not NULL.
+// Returns NC_ERROR if the heap is empty.
+int
+nc_heap_pop(struct nc_heap *h, void *elem)
+{
+  if (h->elems.nelem == 0) {
+    return NC_ERROR;
+  }
+
+  heap_remove_at(h, 0, elem);
+
+  return NC_OK;
+}
+
+// Returns the position of 'handle', or -1 if its element has left the
+// heap. A handle that was never issued is a caller bug.
+static int
+heap_live_position(struct nc_heap *h, int handle)
+{
+  NC_ASSERT(handle >= 0 && handle < h->positions.nelem);
+
+  if (handle < 0 || handle >= h->positions.nelem) {
+    return -1;
+  }
+
+  return heap_position(h, handle);
+}
+
+// Replaces the element of 'handle' and moves it up or down as needed.
+// Returns NC_ERROR if the handle is not live.
+int
+nc_heap_update(struct nc_heap *h, int handle, const void *elem)
+{
+  int pos = heap_live_position(h, handle);
+
+  if (pos < 0) {
+    return NC_ERROR;
+  }
+
+  memcpy(h->tmp, elem, h->elems.size);
+  heap_fix(h, pos, handle);
+
+  return NC_OK;
+}
+
+// Removes the element of 'handle', copying it to elem if that is not NULL.
+// Returns NC_ERROR if the handle is not live.
+int
+nc_heap_remove(struct nc_heap *h, int handle, void *elem)
+{
+  int pos = heap_live_position(h, handle);
+
+  if (pos < 0) {
+    return NC_ERROR;
+  }
+
+  heap_remove_at(h, pos, elem);
+
+  return NC_OK;
+}
+
+// Replaces the contents of the heap with n elements in O(n) (Floyd). The
+// element elems[i] gets handle i, previously issued handles become invalid.
+int
+nc_heap_heapify(struct nc_heap *h, const void *elems, int n)
+{
+  int i;
+
+  h->elems.nelem = 0;
+  h->handles.nelem = 0;
+  h->positions.nelem = 0;
+  h->free.nelem = 0;
+
+  if (nc_array_reserve(&h->elems, n) != NC_OK ||
+      nc_array_reserve(&h->handles, n) != NC_OK ||
+      nc_array_reserve(&h->positions, n) != NC_OK ||
+      nc_array_reserve(&h->free, n) != NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  memcpy(h->elems.elems, elems, (size_t)n * h->elems.size);
+  for (i = 0; i < n; i++) {
+    heap_handle(h, i) = i;
+    heap_position(h, i) = i;
+  }
+  h->elems.nelem = n;
+  h->handles.nelem = n;
+  h->positions.nelem = n;
+
+  for (i = (n - 2) / h->arity; i >= 0 && n > 1; i--) {
+    memcpy(h->tmp, heap_elem(h, i), h->elems.size);
+    heap_sift_down(h, i, heap_handle(h, i));
+  }
+
+  return NC_OK;
+}
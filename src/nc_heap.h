@@ -0,0 +1,60 @@
+#ifndef LIBNC_NC_HEAP_H_
+#define LIBNC_NC_HEAP_H_
+
+#include "nc_array.h"
+
+//
+// Implicit d-ary heap (d = 2 or 4) of fixed-size elements kept in one
+// contiguous nc_array. cmp has the qsort(3) contract; the element that
+// compares smallest is at the top.
+//
+// Every pushed element gets a handle that stays valid until the element
+// leaves the heap, whatever moves happen in between. A handle gives O(1)
+// access to the element and O(log n) update or removal.
+//
+struct nc_heap {
+  struct nc_array elems;     /* heap ordered elements */
+  struct nc_array handles;   /* int, handle of the element at each position */
+  struct nc_array positions; /* int, position of each handle, -1 if free */
+  struct nc_array free;      /* int, released handles for reuse */
+  int arity;
+  nc_sort_cmp_pt cmp;
+  u_char *tmp; /* one element, the hole of the sift loops */
+};
+
+struct nc_heap *nc_heap_create(int n, size_t size, int arity,
+                               nc_sort_cmp_pt cmp);
+void nc_heap_destroy(struct nc_heap *h);
+int nc_heap_push(struct nc_heap *h, const void *elem);
+int nc_heap_pop(struct nc_heap *h, void *elem);
+int nc_heap_update(struct nc_heap *h, int handle, const void *elem);
+int nc_heap_remove(struct nc_heap *h, int handle, void *elem);
+int nc_heap_heapify(struct nc_heap *h, const void *elems, int n);
+
+static inline int
+nc_heap_nelem(const struct nc_heap *h)
+{
+  return h->elems.nelem;
+}
+
+// Returns the top element, or NULL if the heap is empty.
+static inline void *
+nc_heap_peek(struct nc_heap *h)
+{
+  return h->elems.nelem > 0 ? h->elems.elems : NULL;
+}
+
+// Returns the element of a live handle.
+static inline void *
+nc_heap_get(struct nc_heap *h, int handle)
+{
+  int pos;
+
+  NC_ASSERT(handle >= 0 && handle < h->positions.nelem);
+  pos = ((int *)h->positions.elems)[handle];
+  NC_ASSERT(pos >= 0);
+
+  return (u_char *)h->elems.elems + h->elems.size * pos;
+}
+
+#endif  // LIBNC_NC_HEAP_H_
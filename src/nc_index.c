@@ -0,0 +1,183 @@
+#include "nc_index.h"
+
+#include <string.h>
+
+#if defined(__GNUC__)
+#define index_prefetch(p) __builtin_prefetch(p)
+#else
+#define index_prefetch(p)
+#endif
+
+// Keys per cache line. keys comes from nc_memalign(), so keys[0] is at the
+// start of a line and the 8 descendants three levels below node k,
+// keys[8k..8k+7], fill one line.
+#define INDEX_LINE_KEYS (NC_CACHELINE_SIZE / sizeof(uint64_t))
+
+static uint64_t
+index_key(const u_char *p, size_t width)
+{
+  uint8_t k1;
+  uint16_t k2;
+  uint32_t k4;
+  uint64_t k8;
+
+  switch (width) {
+  case 1:
+    k1 = *p;
+    return k1;
+
+  case 2:
+    memcpy(&k2, p, 2);
+    return k2;
+
+  case 4:
+    memcpy(&k4, p, 4);
+    return k4;
+
+  default:
+    memcpy(&k8, p, 8);
+    return k8;
+  }
+}
+
+static inline unsigned
+index_ctz(size_t k)
+{
+#if defined(__GNUC__)
+  return (unsigned)__builtin_ctzll((unsigned long long)k);
+#else
+  unsigned n = 0;
+
+  while (!(k & 1)) {
+    k >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+struct index_build {
+  struct nc_array_index *ix;
+  const u_char *elems;
+  size_t size;
+  size_t key_offset;
+  size_t key_width;
+  int next; /* next position in the sorted array */
+};
+
+// In-order walk of the implicit tree rooted at k hands out the sorted
+// elements in order. Recursion depth is the tree height.
+static void
+index_build(struct index_build *b, size_t k)
+{
+  if (k > (size_t)b->ix->nelem) {
+    return;
+  }
+
+  index_build(b, 2 * k);
+
+  b->ix->keys[k] = index_key(b->elems + (size_t)b->next * b->size +
+                                 b->key_offset,
+                             b->key_width);
+  b->ix->rank[k] = b->next++;
+
+  index_build(b, 2 * k + 1);
+}
+
+// Builds a search index over the keys of 'sorted', which must be sorted by
+// the unsigned, native byte order key of 'key_width' (1, 2, 4 or 8) bytes at
+// 'key_offset' in each element, as nc_array_radix_sort() leaves it.
+//
+// Returns NULL on allocation failure.
+struct nc_array_index *
+nc_array_freeze_index(const struct nc_array *sorted, size_t key_offset,
+                      size_t key_width)
+{
+  struct nc_array_index *ix;
+  struct index_build b;
+  size_t n;
+
+  NC_ASSERT(key_width == 1 || key_width == 2 || key_width == 4 ||
+            key_width == 8);
+  NC_ASSERT(key_offset + key_width <= sorted->size);
+
+  ix = nc_alloc(sizeof(*ix));
+  if (ix == NULL) {
+    return NULL;
+  }
+
+  n = (size_t)sorted->nelem;
+  ix->nelem = sorted->nelem;
+  ix->keys = nc_memalign(NC_CACHELINE_SIZE, (n + 1) * sizeof(uint64_t));
+  ix->rank = nc_alloc((n + 1) * sizeof(int));
+  if (ix->keys == NULL || ix->rank == NULL) {
+    nc_array_index_destroy(ix);
+    return NULL;
+  }
+
+  ix->keys[0] = 0;
+  ix->rank[0] = -1;
+
+  b.ix = ix;
+  b.elems = sorted->elems;
+  b.size = sorted->size;
+  b.key_offset = key_offset;
+  b.key_width = key_width;
+  b.next = 0;
+
+  index_build(&b, 1);
+
+  return ix;
+}
+
+void
+nc_array_index_destroy(struct nc_array_index *ix)
+{
+  if (ix->keys != NULL) {
+    nc_free(ix->keys);
+  }
+  if (ix->rank != NULL) {
+    nc_free(ix->rank);
+  }
+  nc_free(ix);
+}
+
+// Returns the position in the array of the first element whose key is
+// >= 'key', or nelem if there is none.
+int
+nc_array_index_lower_bound(const struct nc_array_index *ix, uint64_t key)
+{
+  const uint64_t *keys = ix->keys;
+  size_t n = (size_t)ix->nelem, k = 1;
+
+  // Go right while the node is smaller than the key; the comparison turns
+  // into a flag, not a branch. The line three levels down is requested
+  // early so it arrives by the time the search gets there.
+  while (k <= n) {
+    index_prefetch(keys + INDEX_LINE_KEYS * k);
+    k = 2 * k + (keys[k] < key);
+  }
+
+  // k went right (low bit 1) after the answer; drop those steps and the
+  // final left step. k == 0 means every key is smaller.
+  k >>= index_ctz(~k) + 1;
+
+  return k == 0 ? ix->nelem : ix->rank[k];
+}
+
+// Returns the position of the first element whose key equals 'key', or -1.
+int
+nc_array_index_find(const struct nc_array_index *ix, uint64_t key)
+{
+  const uint64_t *keys = ix->keys;
+  size_t n = (size_t)ix->nelem, k = 1;
+
+  while (k <= n) {
+    index_prefetch(keys + INDEX_LINE_KEYS * k);
+    k = 2 * k + (keys[k] < key);
+  }
+
+  k >>= index_ctz(~k) + 1;
+
+  return k != 0 && keys[k] == key ? ix->rank[k] : -1;
+}
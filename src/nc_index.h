@@ -0,0 +1,33 @@
+#ifndef LIBNC_NC_INDEX_H_
+#define LIBNC_NC_INDEX_H_
+
+#include <stdint.h>
+
+#include "nc_array.h"
+
+//
+// Read-only search index over a sorted nc_array.
+//
+// The keys are copied out of the array, widened to uint64_t and stored in
+// Eytzinger (breadth-first) order, so the first levels of every search
+// share a few hot cache lines and the nodes a search can reach next are
+// adjacent and can be prefetched. Lookups are branchless and return
+// positions in the original array, which the index does not reference:
+// it stays valid as long as the array is not modified.
+//
+
+struct nc_array_index {
+  uint64_t *keys; /* keys[1..nelem] in Eytzinger order, keys[0] unused */
+  int *rank;      /* rank[k] = position of keys[k] in the array */
+  int nelem;
+};
+
+struct nc_array_index *nc_array_freeze_index(const struct nc_array *sorted,
+                                             size_t key_offset,
+                                             size_t key_width);
+void nc_array_index_destroy(struct nc_array_index *ix);
+
+int nc_array_index_lower_bound(const struct nc_array_index *ix, uint64_t key);
+int nc_array_index_find(const struct nc_array_index *ix, uint64_t key);
+
+#endif  // LIBNC_NC_INDEX_H_
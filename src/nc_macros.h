@@ -32,6 +32,10 @@ typedef unsigned char u_char;
 #define NC_ALIGN_PTR(p, n) \
   (void *)(((uintptr_t)(p) + ((uintptr_t)n - 1)) & ~((uintptr_t)n - 1))
 
+// Assumed cache line size, used to keep data written by different threads
+// on different lines.
+#define NC_CACHELINE_SIZE 64
+
 #define NC_OK 0
 #define NC_ERROR -1
 #define NC_EAGAIN -2
@@ -61,6 +65,13 @@ void *_nc_calloc(size_t nmemb, size_t size, const char *name, int line);
 void *_nc_realloc(void *ptr, size_t size, const char *name, int line);
 void _nc_free(void *ptr, const char *name, int line);
 
+// Memory from nc_memalign() is released with nc_free(), so it needs an
+// allocator whose blocks free() accepts. Elsewhere it only gets malloc()
+// alignment, and callers must not depend on more for correctness.
+#if !defined(NC_HAVE_POSIX_MEMALIGN) && !defined(_WIN32)
+#define NC_HAVE_POSIX_MEMALIGN 1
+#endif
+
 #if (NC_HAVE_POSIX_MEMALIGN)
 
 void *nc_memalign(size_t alignment, size_t size);
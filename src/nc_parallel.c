@@ -0,0 +1,355 @@
+#include "nc_parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+// With grain 0, chunks are sized for this many per thread so uneven chunks
+// even out, but hold at least PARALLEL_MIN_GRAIN elements.
+#define PARALLEL_CHUNKS_PER_THREAD 8
+#define PARALLEL_MIN_GRAIN 1024
+
+struct parallel_job {
+  void (*run)(struct parallel_job *job, size_t lo, size_t hi, size_t chunk);
+  size_t n;       /* elements or buckets */
+  size_t chunk;   /* elements or buckets per chunk */
+  size_t nchunks;
+  atomic_size_t next; /* next chunk to hand out */
+
+  struct nc_array *a;
+  struct nc_hashtable *hashtable;
+  nc_parallel_for_pt for_fn;
+  nc_parallel_reduce_pt reduce_fn;
+  nc_hashtable_pair_pt pair_fn;
+  nc_parallel_pair_reduce_pt pair_reduce_fn;
+  void *ctx;
+  u_char *accs; /* nchunks accumulators */
+  size_t acc_size;
+};
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work;  /* a job was posted */
+  pthread_cond_t done;  /* the last worker left the job */
+  pthread_mutex_t busy; /* held while a job runs on the pool */
+  struct parallel_job *job;
+  unsigned long generation; /* bumped for every job posted */
+  int started;
+  int nworkers;
+  int active; /* workers still in the current job */
+} pool = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  NULL, 0, 0, 0, 0,
+};
+
+static void
+parallel_job_work(struct parallel_job *job)
+{
+  size_t c, lo;
+
+  while ((c = atomic_fetch_add(&job->next, 1)) < job->nchunks) {
+    lo = c * job->chunk;
+    job->run(job, lo, MIN(lo + job->chunk, job->n), c);
+  }
+}
+
+static void *
+parallel_worker(void *arg)
+{
+  struct parallel_job *job;
+  unsigned long seen = 0;
+
+  (void)arg;
+
+  pthread_mutex_lock(&pool.lock);
+
+  for (;;) {
+    while (pool.generation == seen) {
+      pthread_cond_wait(&pool.work, &pool.lock);
+    }
+    seen = pool.generation;
+    job = pool.job;
+    pthread_mutex_unlock(&pool.lock);
+
+    parallel_job_work(job);
+
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.active == 0) {
+      pthread_cond_signal(&pool.done);
+    }
+  }
+
+  return NULL;
+}
+
+// Starts the pool with 'nthreads' threads in total, the calling thread of
+// a loop included, or one per cpu if nthreads <= 0. The workers live until
+// the process exits. Has no effect once the pool is running.
+//
+// Returns NC_OK, or NC_ERROR if no worker could be started (loops then
+// run on the calling thread).
+int
+nc_parallel_init(int nthreads)
+{
+  pthread_attr_t attr;
+  pthread_t tid;
+  int i;
+
+  pthread_mutex_lock(&pool.lock);
+
+  if (pool.started) {
+    pthread_mutex_unlock(&pool.lock);
+    return NC_OK;
+  }
+  pool.started = 1;
+
+  if (nthreads <= 0) {
+#if defined(_SC_NPROCESSORS_ONLN)
+    nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (nthreads <= 0) {
+      nthreads = 1;
+    }
+  }
+  nthreads = MIN(nthreads, NC_PARALLEL_MAX_THREADS);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  for (i = 1; i < nthreads; i++) {
+    if (pthread_create(&tid, &attr, parallel_worker, NULL) != 0) {
+      log_error("pthread_create failed, %d workers", pool.nworkers);
+      break;
+    }
+    pool.nworkers++;
+  }
+
+  pthread_attr_destroy(&attr);
+  pthread_mutex_unlock(&pool.lock);
+
+  return nthreads > 1 && pool.nworkers == 0 ? NC_ERROR : NC_OK;
+}
+
+// Returns the number of threads a loop runs on, starting the pool if
+// needed.
+int
+nc_parallel_threads(void)
+{
+  nc_parallel_init(0);
+
+  return pool.nworkers + 1;
+}
+
+static void
+parallel_split(struct parallel_job *job, size_t n, int grain)
+{
+  size_t chunk, parts;
+
+  parts = (size_t)nc_parallel_threads() * PARALLEL_CHUNKS_PER_THREAD;
+
+  if (grain > 0) {
+    chunk = MAX((n + parts - 1) / parts, (size_t)grain);
+  } else {
+    chunk = MAX((n + parts - 1) / parts, PARALLEL_MIN_GRAIN);
+  }
+
+  job->n = n;
+  job->chunk = chunk;
+  job->nchunks = (n + chunk - 1) / chunk;
+  atomic_init(&job->next, 0);
+}
+
+static void
+parallel_run(struct parallel_job *job)
+{
+  if (job->nchunks < 2 || pool.nworkers == 0 ||
+      pthread_mutex_trylock(&pool.busy) != 0) {
+    parallel_job_work(job);
+    return;
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  pool.job = job;
+  pool.active = pool.nworkers;
+  pool.generation++;
+  pthread_cond_broadcast(&pool.work);
+  pthread_mutex_unlock(&pool.lock);
+
+  parallel_job_work(job);
+
+  pthread_mutex_lock(&pool.lock);
+  while (pool.active > 0) {
+    pthread_cond_wait(&pool.done, &pool.lock);
+  }
+  pool.job = NULL;
+  pthread_mutex_unlock(&pool.lock);
+
+  pthread_mutex_unlock(&pool.busy);
+}
+
+// Runs the job with a private accumulator per chunk, then combines them
+// into *acc in chunk order.
+static int
+parallel_run_reduce(struct parallel_job *job, nc_parallel_combine_pt combine,
+                    void *acc, size_t acc_size)
+{
+  size_t c;
+
+  if (job->nchunks == 0) {
+    return NC_OK;
+  }
+
+  job->acc_size = acc_size;
+  job->accs = nc_alloc(job->nchunks * acc_size);
+  if (job->accs == NULL) {
+    return NC_ENOMEM;
+  }
+
+  for (c = 0; c < job->nchunks; c++) {
+    memcpy(job->accs + c * acc_size, acc, acc_size);
+  }
+
+  parallel_run(job);
+
+  for (c = 0; c < job->nchunks; c++) {
+    combine(acc, job->accs + c * acc_size, job->ctx);
+  }
+
+  nc_free(job->accs);
+
+  return NC_OK;
+}
+
+static void
+parallel_array_for(struct parallel_job *job, size_t lo, size_t hi,
+                   size_t chunk)
+{
+  (void)chunk; /* no accumulator */
+
+  job->for_fn(job->a, (int)lo, (int)hi, job->ctx);
+}
+
+static void
+parallel_array_reduce(struct parallel_job *job, size_t lo, size_t hi,
+                      size_t chunk)
+{
+  job->reduce_fn(job->a, (int)lo, (int)hi, job->accs + chunk * job->acc_size,
+                 job->ctx);
+}
+
+static void
+parallel_hashtable_for(struct parallel_job *job, size_t lo, size_t hi,
+                       size_t chunk)
+{
+  (void)chunk; /* no accumulator */
+
+  nc_hashtable_foreach_buckets(job->hashtable, lo, hi, job->pair_fn,
+                               job->ctx);
+}
+
+struct parallel_pair_reduce {
+  struct parallel_job *job;
+  void *acc;
+};
+
+static void
+parallel_pair_reduce(void *key, void *value, void *arg)
+{
+  struct parallel_pair_reduce *r = arg;
+
+  r->job->pair_reduce_fn(key, value, r->acc, r->job->ctx);
+}
+
+static void
+parallel_hashtable_reduce(struct parallel_job *job, size_t lo, size_t hi,
+                          size_t chunk)
+{
+  struct parallel_pair_reduce r;
+
+  r.job = job;
+  r.acc = job->accs + chunk * job->acc_size;
+  nc_hashtable_foreach_buckets(job->hashtable, lo, hi, parallel_pair_reduce,
+                               &r);
+}
+
+// Calls fn on ranges of elements covering the whole array, in parallel.
+int
+nc_parallel_for(struct nc_array *a, nc_parallel_for_pt fn, void *ctx,
+                int grain)
+{
+  struct parallel_job job;
+
+  memset(&job, 0, sizeof(job));
+  job.run = parallel_array_for;
+  job.a = a;
+  job.for_fn = fn;
+  job.ctx = ctx;
+  parallel_split(&job, (size_t)a->nelem, grain);
+
+  parallel_run(&job);
+
+  return NC_OK;
+}
+
+// Folds the whole array into *acc with fn and combine, in parallel.
+//
+// Returns NC_OK, or NC_ENOMEM if the chunk accumulators can't be allocated
+// (*acc is unchanged then).
+int
+nc_parallel_reduce(struct nc_array *a, nc_parallel_reduce_pt fn,
+                   nc_parallel_combine_pt combine, void *acc, size_t acc_size,
+                   void *ctx, int grain)
+{
+  struct parallel_job job;
+
+  memset(&job, 0, sizeof(job));
+  job.run = parallel_array_reduce;
+  job.a = a;
+  job.reduce_fn = fn;
+  job.ctx = ctx;
+  parallel_split(&job, (size_t)a->nelem, grain);
+
+  return parallel_run_reduce(&job, combine, acc, acc_size);
+}
+
+// Calls fn for every pair, in parallel over ranges of at least 'grain'
+// buckets. The hashtable must not be modified meanwhile.
+int
+nc_hashtable_parallel_for(struct nc_hashtable *hashtable,
+                          nc_hashtable_pair_pt fn, void *ctx, int grain)
+{
+  struct parallel_job job;
+
+  memset(&job, 0, sizeof(job));
+  job.run = parallel_hashtable_for;
+  job.hashtable = hashtable;
+  job.pair_fn = fn;
+  job.ctx = ctx;
+  parallel_split(&job, nc_hashtable_num_buckets(hashtable), grain);
+
+  parallel_run(&job);
+
+  return NC_OK;
+}
+
+// Folds every pair into *acc, in parallel over bucket ranges, see
+// nc_parallel_reduce().
+int
+nc_hashtable_parallel_reduce(struct nc_hashtable *hashtable,
+                             nc_parallel_pair_reduce_pt fn,
+                             nc_parallel_combine_pt combine, void *acc,
+                             size_t acc_size, void *ctx, int grain)
+{
+  struct parallel_job job;
+
+  memset(&job, 0, sizeof(job));
+  job.run = parallel_hashtable_reduce;
+  job.hashtable = hashtable;
+  job.pair_reduce_fn = fn;
+  job.ctx = ctx;
+  parallel_split(&job, nc_hashtable_num_buckets(hashtable), grain);
+
+  return parallel_run_reduce(&job, combine, acc, acc_size);
+}
@@ -0,0 +1,55 @@
+#ifndef LIBNC_NC_PARALLEL_H_
+#define LIBNC_NC_PARALLEL_H_
+
+#include "nc_array.h"
+#include "nc_hashtable.h"
+
+#define NC_PARALLEL_MAX_THREADS 64
+
+//
+// Data-parallel loops on a built-in pool of worker threads.
+//
+// The work is cut into chunks of at least 'grain' elements (or buckets;
+// 0 picks a size) which the calling thread and the workers take from a
+// shared counter until none are left; the call returns when all chunks
+// are done. The pool is started on first use with one thread per cpu,
+// or with nc_parallel_init(). One loop runs on the pool at a time: a loop
+// started while another one is running, including from inside a loop
+// body, runs on the calling thread alone.
+//
+// The reduce variants give every chunk its own accumulator of 'acc_size'
+// bytes, copied from *acc, which must hold the identity of 'combine' on
+// entry (0 for a sum). The chunk accumulators are then combined into *acc
+// in chunk order, so the result does not depend on the scheduling.
+//
+
+// Processes elements [lo, hi) of a.
+typedef void (*nc_parallel_for_pt)(struct nc_array *a, int lo, int hi,
+                                   void *ctx);
+// Folds elements [lo, hi) of a into acc.
+typedef void (*nc_parallel_reduce_pt)(struct nc_array *a, int lo, int hi,
+                                      void *acc, void *ctx);
+// Folds a pair into acc.
+typedef void (*nc_parallel_pair_reduce_pt)(void *key, void *value, void *acc,
+                                           void *ctx);
+// Folds the accumulator 'other' into acc.
+typedef void (*nc_parallel_combine_pt)(void *acc, const void *other,
+                                       void *ctx);
+
+int nc_parallel_init(int nthreads);
+int nc_parallel_threads(void);
+
+int nc_parallel_for(struct nc_array *a, nc_parallel_for_pt fn, void *ctx,
+                    int grain);
+int nc_parallel_reduce(struct nc_array *a, nc_parallel_reduce_pt fn,
+                       nc_parallel_combine_pt combine, void *acc,
+                       size_t acc_size, void *ctx, int grain);
+
+int nc_hashtable_parallel_for(struct nc_hashtable *hashtable,
+                              nc_hashtable_pair_pt fn, void *ctx, int grain);
+int nc_hashtable_parallel_reduce(struct nc_hashtable *hashtable,
+                                 nc_parallel_pair_reduce_pt fn,
+                                 nc_parallel_combine_pt combine, void *acc,
+                                 size_t acc_size, void *ctx, int grain);
+
+#endif  // LIBNC_NC_PARALLEL_H_
@@ -0,0 +1,118 @@
+#include "nc_ring.h"
+
+#include <string.h>  // memcpy
+
+// nelem is rounded up to a power of two.
+struct nc_ring *
+nc_ring_create(size_t nelem, size_t size)
+{
+  struct nc_ring *r;
+  size_t n;
+
+  NC_ASSERT(nelem != 0 && size != 0);
+
+  for (n = 1; n < nelem; n <<= 1) {
+    /* void */
+  }
+
+  r = nc_memalign(NC_CACHELINE_SIZE, sizeof(*r));
+  if (r == NULL) {
+    return NULL;
+  }
+
+  r->elems = nc_memalign(NC_CACHELINE_SIZE, n * size);
+  if (r->elems == NULL) {
+    nc_free(r);
+    return NULL;
+  }
+
+  r->size = size;
+  r->mask = n - 1;
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+  r->tail_cache = 0;
+  r->head_cache = 0;
+
+  return r;
+}
+
+void
+nc_ring_destroy(struct nc_ring *r)
+{
+  nc_free(r->elems);
+  nc_free(r);
+}
+
+// Copies n elements between a buffer and the ring starting at slot index
+// 'pos', wrapping around the end of the ring.
+static inline void
+ring_copy_in(struct nc_ring *r, size_t pos, const u_char *src, size_t n)
+{
+  size_t i = pos & r->mask, first = MIN(n, r->mask + 1 - i);
+
+  memcpy(r->elems + i * r->size, src, first * r->size);
+  if (first < n) {
+    memcpy(r->elems, src + first * r->size, (n - first) * r->size);
+  }
+}
+
+static inline void
+ring_copy_out(struct nc_ring *r, size_t pos, u_char *dst, size_t n)
+{
+  size_t i = pos & r->mask, first = MIN(n, r->mask + 1 - i);
+
+  memcpy(dst, r->elems + i * r->size, first * r->size);
+  if (first < n) {
+    memcpy(dst + first * r->size, r->elems, (n - first) * r->size);
+  }
+}
+
+// Producer side. Pushes up to n elements and returns how many were pushed.
+size_t
+nc_ring_push_n(struct nc_ring *r, const void *elems, size_t n)
+{
+  size_t tail, room;
+
+  tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+  room = r->mask + 1 - (tail - r->head_cache);
+  if (room < n) {
+    r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+    room = r->mask + 1 - (tail - r->head_cache);
+  }
+
+  n = MIN(n, room);
+  if (n == 0) {
+    return 0;
+  }
+
+  ring_copy_in(r, tail, elems, n);
+  atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+
+  return n;
+}
+
+// Consumer side. Pops up to n elements and returns how many were popped.
+size_t
+nc_ring_pop_n(struct nc_ring *r, void *elems, size_t n)
+{
+  size_t head, avail;
+
+  head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+  avail = r->tail_cache - head;
+  if (avail < n) {
+    r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    avail = r->tail_cache - head;
+  }
+
+  n = MIN(n, avail);
+  if (n == 0) {
+    return 0;
+  }
+
+  ring_copy_out(r, head, elems, n);
+  atomic_store_explicit(&r->head, head + n, memory_order_release);
+
+  return n;
+}
@@ -0,0 +1,64 @@
+#ifndef LIBNC_NC_RING_H_
+#define LIBNC_NC_RING_H_
+
+#include <stdatomic.h>
+
+#include "nc_macros.h"
+
+//
+// Bounded single-producer/single-consumer queue of fixed-size elements.
+//
+// Exactly one thread may push and exactly one thread may pop; neither side
+// takes a lock or waits on the other. The producer's and the consumer's
+// indices live on separate cache lines, and each side keeps a cached copy
+// of the other side's index so it only touches the shared line when the
+// cached value says the ring looks full (or empty). The batch calls move
+// up to n elements and publish the new index once.
+//
+struct nc_ring {
+  u_char *elems;
+  size_t size; /* element size */
+  size_t mask; /* number of slots - 1 */
+  u_char pad0[NC_CACHELINE_SIZE - sizeof(u_char *) - 2 * sizeof(size_t)];
+
+  /* consumer */
+  atomic_size_t head; /* next slot to pop */
+  size_t tail_cache;  /* last tail seen by the consumer */
+  u_char pad1[NC_CACHELINE_SIZE - sizeof(atomic_size_t) - sizeof(size_t)];
+
+  /* producer */
+  atomic_size_t tail; /* next slot to push */
+  size_t head_cache;  /* last head seen by the producer */
+  u_char pad2[NC_CACHELINE_SIZE - sizeof(atomic_size_t) - sizeof(size_t)];
+};
+
+struct nc_ring *nc_ring_create(size_t nelem, size_t size);
+void nc_ring_destroy(struct nc_ring *r);
+
+size_t nc_ring_push_n(struct nc_ring *r, const void *elems, size_t n);
+size_t nc_ring_pop_n(struct nc_ring *r, void *elems, size_t n);
+
+// Returns NC_OK, or NC_EAGAIN if the ring is full.
+static inline int
+nc_ring_push(struct nc_ring *r, const void *elem)
+{
+  return nc_ring_push_n(r, elem, 1) == 1 ? NC_OK : NC_EAGAIN;
+}
+
+// Returns NC_OK, or NC_EAGAIN if the ring is empty.
+static inline int
+nc_ring_pop(struct nc_ring *r, void *elem)
+{
+  return nc_ring_pop_n(r, elem, 1) == 1 ? NC_OK : NC_EAGAIN;
+}
+
+// Number of queued elements. Exact only when called from the producer or
+// the consumer with the other side idle, a snapshot otherwise.
+static inline size_t
+nc_ring_count(struct nc_ring *r)
+{
+  return atomic_load_explicit(&r->tail, memory_order_acquire) -
+         atomic_load_explicit(&r->head, memory_order_acquire);
+}
+
+#endif  // LIBNC_NC_RING_H_
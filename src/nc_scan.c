@@ -0,0 +1,764 @@
+#include "nc_scan.h"
+
+#include <stdatomic.h>
+
+#include "nc_cpu.h"
+
+#if (NC_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+//
+// The kernels work on the raw bits of the elements. Ordered comparisons are
+// signed comparisons of (element ^ bias): a bias of 0 gives signed order, a
+// bias of the sign bit gives unsigned order, and flipping all bits of the
+// bias reverses the order, which turns a min kernel into a max kernel.
+//
+
+#define SCAN_BIAS32_SIGNED 0U
+#define SCAN_BIAS32_UNSIGNED 0x80000000U
+#define SCAN_BIAS64_SIGNED 0ULL
+#define SCAN_BIAS64_UNSIGNED 0x8000000000000000ULL
+
+struct scan_ops {
+  size_t (*find32)(const uint32_t *p, size_t n, uint32_t x);
+  size_t (*count32)(const uint32_t *p, size_t n, uint32_t x);
+  size_t (*min32)(const uint32_t *p, size_t n, uint32_t bias);
+  uint64_t (*sum32)(const uint32_t *p, size_t n, int sign);
+  int (*all_lt32)(const uint32_t *p, size_t n, uint32_t x, uint32_t bias);
+
+  size_t (*find64)(const uint64_t *p, size_t n, uint64_t x);
+  size_t (*count64)(const uint64_t *p, size_t n, uint64_t x);
+  size_t (*min64)(const uint64_t *p, size_t n, uint64_t bias);
+  uint64_t (*sum64)(const uint64_t *p, size_t n, int sign);
+  int (*all_lt64)(const uint64_t *p, size_t n, uint64_t x, uint64_t bias);
+};
+
+//
+// Scalar kernels
+//
+
+static size_t
+scan_find32_scalar(const uint32_t *p, size_t n, uint32_t x)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if (p[i] == x) {
+      return i;
+    }
+  }
+
+  return n;
+}
+
+static size_t
+scan_count32_scalar(const uint32_t *p, size_t n, uint32_t x)
+{
+  size_t i, c = 0;
+
+  for (i = 0; i < n; i++) {
+    c += p[i] == x;
+  }
+
+  return c;
+}
+
+static size_t
+scan_min32_scalar(const uint32_t *p, size_t n, uint32_t bias)
+{
+  size_t i, m = 0;
+
+  for (i = 1; i < n; i++) {
+    if ((int32_t)(p[i] ^ bias) < (int32_t)(p[m] ^ bias)) {
+      m = i;
+    }
+  }
+
+  return m;
+}
+
+static uint64_t
+scan_sum32_scalar(const uint32_t *p, size_t n, int sign)
+{
+  uint64_t s = 0;
+  size_t i;
+
+  if (sign) {
+    for (i = 0; i < n; i++) {
+      s += (uint64_t)(int64_t)(int32_t)p[i];
+    }
+
+  } else {
+    for (i = 0; i < n; i++) {
+      s += p[i];
+    }
+  }
+
+  return s;
+}
+
+static int
+scan_all_lt32_scalar(const uint32_t *p, size_t n, uint32_t x, uint32_t bias)
+{
+  int32_t bx = (int32_t)(x ^ bias);
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if ((int32_t)(p[i] ^ bias) >= bx) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static size_t
+scan_find64_scalar(const uint64_t *p, size_t n, uint64_t x)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if (p[i] == x) {
+      return i;
+    }
+  }
+
+  return n;
+}
+
+static size_t
+scan_count64_scalar(const uint64_t *p, size_t n, uint64_t x)
+{
+  size_t i, c = 0;
+
+  for (i = 0; i < n; i++) {
+    c += p[i] == x;
+  }
+
+  return c;
+}
+
+static size_t
+scan_min64_scalar(const uint64_t *p, size_t n, uint64_t bias)
+{
+  size_t i, m = 0;
+
+  for (i = 1; i < n; i++) {
+    if ((int64_t)(p[i] ^ bias) < (int64_t)(p[m] ^ bias)) {
+      m = i;
+    }
+  }
+
+  return m;
+}
+
+static uint64_t
+scan_sum64_scalar(const uint64_t *p, size_t n, int sign)
+{
+  uint64_t s = 0;
+  size_t i;
+
+  (void)sign; /* 64-bit sums wrap the same either way */
+
+  for (i = 0; i < n; i++) {
+    s += p[i];
+  }
+
+  return s;
+}
+
+static int
+scan_all_lt64_scalar(const uint64_t *p, size_t n, uint64_t x, uint64_t bias)
+{
+  int64_t bx = (int64_t)(x ^ bias);
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if ((int64_t)(p[i] ^ bias) >= bx) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+#if (NC_HAVE_X86_SIMD)
+
+//
+// SSE2 kernels. SSE2 has no 64-bit ordered compare, so min64 and all_lt64
+// stay scalar there.
+//
+
+NC_TARGET("sse2")
+static size_t
+scan_find32_sse2(const uint32_t *p, size_t n, uint32_t x)
+{
+  __m128i vx, v;
+  size_t i;
+  int m;
+
+  vx = _mm_set1_epi32((int)x);
+  for (i = 0; i + 4 <= n; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(p + i));
+    m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, vx)));
+    if (m) {
+      return i + __builtin_ctz(m);
+    }
+  }
+
+  return i + scan_find32_scalar(p + i, n - i, x);
+}
+
+NC_TARGET("sse2")
+static size_t
+scan_count32_sse2(const uint32_t *p, size_t n, uint32_t x)
+{
+  __m128i vx, v, acc;
+  uint32_t lanes[4];
+  size_t i, c;
+
+  vx = _mm_set1_epi32((int)x);
+  acc = _mm_setzero_si128();
+  for (i = 0; i + 4 <= n; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(p + i));
+    acc = _mm_sub_epi32(acc, _mm_cmpeq_epi32(v, vx));
+  }
+
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  c = (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+  return c + scan_count32_scalar(p + i, n - i, x);
+}
+
+NC_TARGET("sse2")
+static size_t
+scan_min32_sse2(const uint32_t *p, size_t n, uint32_t bias)
+{
+  __m128i vb, vm, v, gt;
+  int32_t lanes[4], m;
+  size_t i;
+  int k;
+
+  if (n < 4) {
+    return scan_min32_scalar(p, n, bias);
+  }
+
+  vb = _mm_set1_epi32((int)bias);
+  vm = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p), vb);
+  for (i = 4; i + 4 <= n; i += 4) {
+    v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)), vb);
+    gt = _mm_cmpgt_epi32(vm, v);
+    vm = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vm));
+  }
+
+  _mm_storeu_si128((__m128i *)lanes, vm);
+  m = lanes[0];
+  for (k = 1; k < 4; k++) {
+    m = MIN(m, lanes[k]);
+  }
+  for (; i < n; i++) {
+    m = MIN(m, (int32_t)(p[i] ^ bias));
+  }
+
+  return scan_find32_sse2(p, n, (uint32_t)m ^ bias);
+}
+
+NC_TARGET("sse2")
+static uint64_t
+scan_sum32_sse2(const uint32_t *p, size_t n, int sign)
+{
+  __m128i acc, sm, v, hi;
+  uint64_t lanes[2];
+  size_t i;
+
+  acc = _mm_setzero_si128();
+  sm = sign ? _mm_set1_epi32(-1) : _mm_setzero_si128();
+  for (i = 0; i + 4 <= n; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(p + i));
+    hi = _mm_and_si128(_mm_srai_epi32(v, 31), sm);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, hi));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, hi));
+  }
+
+  _mm_storeu_si128((__m128i *)lanes, acc);
+
+  return lanes[0] + lanes[1] + scan_sum32_scalar(p + i, n - i, sign);
+}
+
+NC_TARGET("sse2")
+static int
+scan_all_lt32_sse2(const uint32_t *p, size_t n, uint32_t x, uint32_t bias)
+{
+  __m128i vb, vx, v;
+  size_t i;
+
+  vb = _mm_set1_epi32((int)bias);
+  vx = _mm_set1_epi32((int)(x ^ bias));
+  for (i = 0; i + 4 <= n; i += 4) {
+    v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)), vb);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi32(vx, v)) != 0xffff) {
+      return 0;
+    }
+  }
+
+  return scan_all_lt32_scalar(p + i, n - i, x, bias);
+}
+
+// 64-bit equality from 32-bit compares: both halves must match
+NC_TARGET("sse2")
+static inline __m128i
+scan_cmpeq64_sse2(__m128i a, __m128i b)
+{
+  __m128i e = _mm_cmpeq_epi32(a, b);
+
+  return _mm_and_si128(e, _mm_shuffle_epi32(e, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+NC_TARGET("sse2")
+static size_t
+scan_find64_sse2(const uint64_t *p, size_t n, uint64_t x)
+{
+  __m128i vx, v;
+  size_t i;
+  int m;
+
+  vx = _mm_set1_epi64x((long long)x);
+  for (i = 0; i + 2 <= n; i += 2) {
+    v = _mm_loadu_si128((const __m128i *)(p + i));
+    m = _mm_movemask_pd(_mm_castsi128_pd(scan_cmpeq64_sse2(v, vx)));
+    if (m) {
+      return i + __builtin_ctz(m);
+    }
+  }
+
+  return i + scan_find64_scalar(p + i, n - i, x);
+}
+
+NC_TARGET("sse2")
+static size_t
+scan_count64_sse2(const uint64_t *p, size_t n, uint64_t x)
+{
+  __m128i vx, v, acc;
+  uint64_t lanes[2];
+  size_t i;
+
+  vx = _mm_set1_epi64x((long long)x);
+  acc = _mm_setzero_si128();
+  for (i = 0; i + 2 <= n; i += 2) {
+    v = _mm_loadu_si128((const __m128i *)(p + i));
+    acc = _mm_sub_epi64(acc, scan_cmpeq64_sse2(v, vx));
+  }
+
+  _mm_storeu_si128((__m128i *)lanes, acc);
+
+  return (size_t)(lanes[0] + lanes[1]) +
+         scan_count64_scalar(p + i, n - i, x);
+}
+
+NC_TARGET("sse2")
+static uint64_t
+scan_sum64_sse2(const uint64_t *p, size_t n, int sign)
+{
+  __m128i acc;
+  uint64_t lanes[2];
+  size_t i;
+
+  acc = _mm_setzero_si128();
+  for (i = 0; i + 2 <= n; i += 2) {
+    acc = _mm_add_epi64(acc, _mm_loadu_si128((const __m128i *)(p + i)));
+  }
+
+  _mm_storeu_si128((__m128i *)lanes, acc);
+
+  return lanes[0] + lanes[1] + scan_sum64_scalar(p + i, n - i, sign);
+}
+
+//
+// AVX2 kernels
+//
+
+NC_TARGET("avx2")
+static size_t
+scan_find32_avx2(const uint32_t *p, size_t n, uint32_t x)
+{
+  __m256i vx, v;
+  size_t i;
+  int m;
+
+  vx = _mm256_set1_epi32((int)x);
+  for (i = 0; i + 8 <= n; i += 8) {
+    v = _mm256_loadu_si256((const __m256i *)(p + i));
+    m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, vx)));
+    if (m) {
+      return i + __builtin_ctz(m);
+    }
+  }
+
+  return i + scan_find32_scalar(p + i, n - i, x);
+}
+
+NC_TARGET("avx2")
+static size_t
+scan_count32_avx2(const uint32_t *p, size_t n, uint32_t x)
+{
+  __m256i vx, v, acc;
+  uint32_t lanes[8];
+  size_t i, c;
+  int k;
+
+  vx = _mm256_set1_epi32((int)x);
+  acc = _mm256_setzero_si256();
+  for (i = 0; i + 8 <= n; i += 8) {
+    v = _mm256_loadu_si256((const __m256i *)(p + i));
+    acc = _mm256_sub_epi32(acc, _mm256_cmpeq_epi32(v, vx));
+  }
+
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+  for (k = 0, c = 0; k < 8; k++) {
+    c += lanes[k];
+  }
+
+  return c + scan_count32_scalar(p + i, n - i, x);
+}
+
+NC_TARGET("avx2")
+static size_t
+scan_min32_avx2(const uint32_t *p, size_t n, uint32_t bias)
+{
+  __m256i vb, vm, v;
+  int32_t lanes[8], m;
+  size_t i;
+  int k;
+
+  if (n < 8) {
+    return scan_min32_scalar(p, n, bias);
+  }
+
+  vb = _mm256_set1_epi32((int)bias);
+  vm = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)p), vb);
+  for (i = 8; i + 8 <= n; i += 8) {
+    v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i)), vb);
+    vm = _mm256_min_epi32(vm, v);
+  }
+
+  _mm256_storeu_si256((__m256i *)lanes, vm);
+  m = lanes[0];
+  for (k = 1; k < 8; k++) {
+    m = MIN(m, lanes[k]);
+  }
+  for (; i < n; i++) {
+    m = MIN(m, (int32_t)(p[i] ^ bias));
+  }
+
+  return scan_find32_avx2(p, n, (uint32_t)m ^ bias);
+}
+
+NC_TARGET("avx2")
+static uint64_t
+scan_sum32_avx2(const uint32_t *p, size_t n, int sign)
+{
+  __m256i acc;
+  __m128i lo, hi;
+  uint64_t lanes[4];
+  size_t i;
+
+  acc = _mm256_setzero_si256();
+  if (sign) {
+    for (i = 0; i + 8 <= n; i += 8) {
+      lo = _mm_loadu_si128((const __m128i *)(p + i));
+      hi = _mm_loadu_si128((const __m128i *)(p + i + 4));
+      acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(lo));
+      acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(hi));
+    }
+
+  } else {
+    for (i = 0; i + 8 <= n; i += 8) {
+      lo = _mm_loadu_si128((const __m128i *)(p + i));
+      hi = _mm_loadu_si128((const __m128i *)(p + i + 4));
+      acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(lo));
+      acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(hi));
+    }
+  }
+
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         scan_sum32_scalar(p + i, n - i, sign);
+}
+
+NC_TARGET("avx2")
+static int
+scan_all_lt32_avx2(const uint32_t *p, size_t n, uint32_t x, uint32_t bias)
+{
+  __m256i vb, vx, v;
+  size_t i;
+
+  vb = _mm256_set1_epi32((int)bias);
+  vx = _mm256_set1_epi32((int)(x ^ bias));
+  for (i = 0; i + 8 <= n; i += 8) {
+    v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i)), vb);
+    if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(vx, v)) != -1) {
+      return 0;
+    }
+  }
+
+  return scan_all_lt32_scalar(p + i, n - i, x, bias);
+}
+
+NC_TARGET("avx2")
+static size_t
+scan_find64_avx2(const uint64_t *p, size_t n, uint64_t x)
+{
+  __m256i vx, v;
+  size_t i;
+  int m;
+
+  vx = _mm256_set1_epi64x((long long)x);
+  for (i = 0; i + 4 <= n; i += 4) {
+    v = _mm256_loadu_si256((const __m256i *)(p + i));
+    m = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, vx)));
+    if (m) {
+      return i + __builtin_ctz(m);
+    }
+  }
+
+  return i + scan_find64_scalar(p + i, n - i, x);
+}
+
+NC_TARGET("avx2")
+static size_t
+scan_count64_avx2(const uint64_t *p, size_t n, uint64_t x)
+{
+  __m256i vx, v, acc;
+  uint64_t lanes[4];
+  size_t i;
+
+  vx = _mm256_set1_epi64x((long long)x);
+  acc = _mm256_setzero_si256();
+  for (i = 0; i + 4 <= n; i += 4) {
+    v = _mm256_loadu_si256((const __m256i *)(p + i));
+    acc = _mm256_sub_epi64(acc, _mm256_cmpeq_epi64(v, vx));
+  }
+
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+
+  return (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+         scan_count64_scalar(p + i, n - i, x);
+}
+
+NC_TARGET("avx2")
+static size_t
+scan_min64_avx2(const uint64_t *p, size_t n, uint64_t bias)
+{
+  __m256i vb, vm, v;
+  int64_t lanes[4], m;
+  size_t i;
+  int k;
+
+  if (n < 4) {
+    return scan_min64_scalar(p, n, bias);
+  }
+
+  vb = _mm256_set1_epi64x((long long)bias);
+  vm = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)p), vb);
+  for (i = 4; i + 4 <= n; i += 4) {
+    v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i)), vb);
+    vm = _mm256_blendv_epi8(vm, v, _mm256_cmpgt_epi64(vm, v));
+  }
+
+  _mm256_storeu_si256((__m256i *)lanes, vm);
+  m = lanes[0];
+  for (k = 1; k < 4; k++) {
+    m = MIN(m, lanes[k]);
+  }
+  for (; i < n; i++) {
+    m = MIN(m, (int64_t)(p[i] ^ bias));
+  }
+
+  return scan_find64_avx2(p, n, (uint64_t)m ^ bias);
+}
+
+NC_TARGET("avx2")
+static uint64_t
+scan_sum64_avx2(const uint64_t *p, size_t n, int sign)
+{
+  __m256i acc;
+  uint64_t lanes[4];
+  size_t i;
+
+  acc = _mm256_setzero_si256();
+  for (i = 0; i + 4 <= n; i += 4) {
+    acc = _mm256_add_epi64(acc,
+                           _mm256_loadu_si256((const __m256i *)(p + i)));
+  }
+
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         scan_sum64_scalar(p + i, n - i, sign);
+}
+
+NC_TARGET("avx2")
+static int
+scan_all_lt64_avx2(const uint64_t *p, size_t n, uint64_t x, uint64_t bias)
+{
+  __m256i vb, vx, v;
+  size_t i;
+
+  vb = _mm256_set1_epi64x((long long)bias);
+  vx = _mm256_set1_epi64x((long long)(x ^ bias));
+  for (i = 0; i + 4 <= n; i += 4) {
+    v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i)), vb);
+    if (_mm256_movemask_epi8(_mm256_cmpgt_epi64(vx, v)) != -1) {
+      return 0;
+    }
+  }
+
+  return scan_all_lt64_scalar(p + i, n - i, x, bias);
+}
+
+#endif  // NC_HAVE_X86_SIMD
+
+static const struct scan_ops scan_scalar = {
+    scan_find32_scalar,  scan_count32_scalar, scan_min32_scalar,
+    scan_sum32_scalar,   scan_all_lt32_scalar, scan_find64_scalar,
+    scan_count64_scalar, scan_min64_scalar,   scan_sum64_scalar,
+    scan_all_lt64_scalar,
+};
+
+#if (NC_HAVE_X86_SIMD)
+
+static const struct scan_ops scan_sse2 = {
+    scan_find32_sse2,  scan_count32_sse2, scan_min32_sse2,
+    scan_sum32_sse2,   scan_all_lt32_sse2, scan_find64_sse2,
+    scan_count64_sse2, scan_min64_scalar, scan_sum64_sse2,
+    scan_all_lt64_scalar,
+};
+
+static const struct scan_ops scan_avx2 = {
+    scan_find32_avx2,  scan_count32_avx2, scan_min32_avx2,
+    scan_sum32_avx2,   scan_all_lt32_avx2, scan_find64_avx2,
+    scan_count64_avx2, scan_min64_avx2,   scan_sum64_avx2,
+    scan_all_lt64_avx2,
+};
+
+#endif
+
+// The kernel table, picked on first use. The tables are constant, so
+// threads that race to pick one store the same pointer and a relaxed load
+// is enough.
+static _Atomic(const struct scan_ops *) scan_cur;
+
+static const struct scan_ops *
+scan_pick(unsigned features)
+{
+#if (NC_HAVE_X86_SIMD)
+  if (features & NC_CPU_AVX2) {
+    return &scan_avx2;
+  }
+  if (features & NC_CPU_SSE2) {
+    return &scan_sse2;
+  }
+#else
+  (void)features;
+#endif
+  return &scan_scalar;
+}
+
+static inline const struct scan_ops *
+scan_get(void)
+{
+  const struct scan_ops *ops;
+
+  ops = atomic_load_explicit(&scan_cur, memory_order_relaxed);
+  if (ops == NULL) {
+    ops = scan_pick(nc_cpu_features());
+    atomic_store_explicit(&scan_cur, ops, memory_order_relaxed);
+  }
+
+  return ops;
+}
+
+void
+nc_scan_use_features(unsigned features)
+{
+  atomic_store_explicit(&scan_cur, scan_pick(features & nc_cpu_features()),
+                        memory_order_relaxed);
+}
+
+//
+// SCAN_DEFINE(name, type, bits, bias, sum_type, sign) defines the
+// nc_array_*_<name> functions on top of the <bits>-wide kernels.
+//
+#define SCAN_DEFINE(_name, _type, _bits, _bias, _sum_type, _sign)            \
+  int nc_array_find_##_name(const struct nc_array *a, _type x)               \
+  {                                                                          \
+    size_t i;                                                                \
+                                                                             \
+    NC_ASSERT(a->size == sizeof(_type));                                     \
+                                                                             \
+    i = scan_get()->find##_bits(a->elems, (size_t)a->nelem,                  \
+                                (uint##_bits##_t)x);                         \
+    return i == (size_t)a->nelem ? -1 : (int)i;                              \
+  }                                                                          \
+                                                                             \
+  int nc_array_count_##_name(const struct nc_array *a, _type x)              \
+  {                                                                          \
+    NC_ASSERT(a->size == sizeof(_type));                                     \
+                                                                             \
+    return (int)scan_get()->count##_bits(a->elems, (size_t)a->nelem,         \
+                                         (uint##_bits##_t)x);                \
+  }                                                                          \
+                                                                             \
+  int nc_array_min_##_name(const struct nc_array *a, _type *min)             \
+  {                                                                          \
+    size_t i;                                                                \
+                                                                             \
+    NC_ASSERT(a->size == sizeof(_type));                                     \
+                                                                             \
+    if (a->nelem == 0) {                                                     \
+      return -1;                                                             \
+    }                                                                        \
+                                                                             \
+    i = scan_get()->min##_bits(a->elems, (size_t)a->nelem, (_bias));         \
+    *min = ((const _type *)a->elems)[i];                                     \
+    return (int)i;                                                           \
+  }                                                                          \
+                                                                             \
+  int nc_array_max_##_name(const struct nc_array *a, _type *max)             \
+  {                                                                          \
+    size_t i;                                                                \
+                                                                             \
+    NC_ASSERT(a->size == sizeof(_type));                                     \
+                                                                             \
+    if (a->nelem == 0) {                                                     \
+      return -1;                                                             \
+    }                                                                        \
+                                                                             \
+    i = scan_get()->min##_bits(a->elems, (size_t)a->nelem,                   \
+                               (uint##_bits##_t) ~(_bias));                  \
+    *max = ((const _type *)a->elems)[i];                                     \
+    return (int)i;                                                           \
+  }                                                                          \
+                                                                             \
+  _sum_type nc_array_sum_##_name(const struct nc_array *a)                   \
+  {                                                                          \
+    NC_ASSERT(a->size == sizeof(_type));                                     \
+                                                                             \
+    return (_sum_type)scan_get()->sum##_bits(a->elems, (size_t)a->nelem,     \
+                                             (_sign));                       \
+  }                                                                          \
+                                                                             \
+  int nc_array_all_lt_##_name(const struct nc_array *a, _type x)             \
+  {                                                                          \
+    NC_ASSERT(a->size == sizeof(_type));                                     \
+                                                                             \
+    return scan_get()->all_lt##_bits(a->elems, (size_t)a->nelem,             \
+                                     (uint##_bits##_t)x, (_bias));           \
+  }
+
+SCAN_DEFINE(i32, int32_t, 32, SCAN_BIAS32_SIGNED, int64_t, 1)
+SCAN_DEFINE(u32, uint32_t, 32, SCAN_BIAS32_UNSIGNED, uint64_t, 0)
+SCAN_DEFINE(i64, int64_t, 64, SCAN_BIAS64_SIGNED, int64_t, 1)
+SCAN_DEFINE(u64, uint64_t, 64, SCAN_BIAS64_UNSIGNED, uint64_t, 0)
@@ -0,0 +1,56 @@
+#ifndef LIBNC_NC_SCAN_H_
+#define LIBNC_NC_SCAN_H_
+
+#include <stdint.h>
+
+#include "nc_array.h"
+
+//
+// Scans over arrays of int32_t, uint32_t, int64_t or uint64_t elements.
+// The kernels use AVX2 or SSE2 when the cpu has them (picked once at
+// runtime) and plain loops otherwise.
+//
+// nc_array_find_*    - index of the first element equal to x, or -1
+// nc_array_count_*   - number of elements equal to x
+// nc_array_min_*     - index of the first smallest element, or -1 if the
+//                      array is empty; the element is stored in *min
+// nc_array_max_*     - same for the largest element
+// nc_array_sum_*     - sum of all elements (64-bit, wraps on overflow)
+// nc_array_all_lt_*  - non-zero if every element is less than x (or the
+//                      array is empty)
+//
+
+int nc_array_find_i32(const struct nc_array *a, int32_t x);
+int nc_array_count_i32(const struct nc_array *a, int32_t x);
+int nc_array_min_i32(const struct nc_array *a, int32_t *min);
+int nc_array_max_i32(const struct nc_array *a, int32_t *max);
+int64_t nc_array_sum_i32(const struct nc_array *a);
+int nc_array_all_lt_i32(const struct nc_array *a, int32_t x);
+
+int nc_array_find_u32(const struct nc_array *a, uint32_t x);
+int nc_array_count_u32(const struct nc_array *a, uint32_t x);
+int nc_array_min_u32(const struct nc_array *a, uint32_t *min);
+int nc_array_max_u32(const struct nc_array *a, uint32_t *max);
+uint64_t nc_array_sum_u32(const struct nc_array *a);
+int nc_array_all_lt_u32(const struct nc_array *a, uint32_t x);
+
+int nc_array_find_i64(const struct nc_array *a, int64_t x);
+int nc_array_count_i64(const struct nc_array *a, int64_t x);
+int nc_array_min_i64(const struct nc_array *a, int64_t *min);
+int nc_array_max_i64(const struct nc_array *a, int64_t *max);
+int64_t nc_array_sum_i64(const struct nc_array *a);
+int nc_array_all_lt_i64(const struct nc_array *a, int64_t x);
+
+int nc_array_find_u64(const struct nc_array *a, uint64_t x);
+int nc_array_count_u64(const struct nc_array *a, uint64_t x);
+int nc_array_min_u64(const struct nc_array *a, uint64_t *min);
+int nc_array_max_u64(const struct nc_array *a, uint64_t *max);
+uint64_t nc_array_sum_u64(const struct nc_array *a);
+int nc_array_all_lt_u64(const struct nc_array *a, uint64_t x);
+
+// Makes the scans use the kernels for the NC_CPU_* 'features', as far as
+// the cpu has them, instead of the best ones. For tests; ~0U restores the
+// default.
+void nc_scan_use_features(unsigned features);
+
+#endif  // LIBNC_NC_SCAN_H_
@@ -0,0 +1,233 @@
+#include "nc_segarray.h"
+
+#include <string.h>  // memcpy, memmove
+
+#define SEGARRAY_MIN_DIR 8
+
+struct nc_segarray *
+nc_segarray_create(size_t size, size_t chunk_nelem)
+{
+  struct nc_segarray *s;
+  unsigned shift;
+
+  NC_ASSERT(size != 0);
+
+  if (chunk_nelem == 0) {
+    chunk_nelem = NC_SEGARRAY_CHUNK_SIZE / size;
+  }
+
+  // Round down to a power of two, at least one element per chunk
+  for (shift = 0; ((size_t)2 << shift) <= chunk_nelem; shift++) {
+    /* void */
+  }
+
+  s = nc_alloc(sizeof(*s));
+  if (s == NULL) {
+    return NULL;
+  }
+
+  s->dir = nc_alloc(SEGARRAY_MIN_DIR * sizeof(void *));
+  if (s->dir == NULL) {
+    nc_free(s);
+    return NULL;
+  }
+
+  s->ndir = SEGARRAY_MIN_DIR;
+  s->first = SEGARRAY_MIN_DIR / 2;
+  s->nchunk = 0;
+  s->head = 0;
+  s->nelem = 0;
+  s->size = size;
+  s->shift = shift;
+  s->mask = ((size_t)1 << shift) - 1;
+  s->spare = NULL;
+
+  return s;
+}
+
+void
+nc_segarray_destroy(struct nc_segarray *s)
+{
+  size_t i;
+
+  for (i = 0; i < s->nchunk; i++) {
+    nc_free(s->dir[s->first + i]);
+  }
+  if (s->spare != NULL) {
+    nc_free(s->spare);
+  }
+  nc_free(s->dir);
+  nc_free(s);
+}
+
+static void *
+segarray_chunk_alloc(struct nc_segarray *s)
+{
+  void *chunk;
+
+  if (s->spare != NULL) {
+    chunk = s->spare;
+    s->spare = NULL;
+    return chunk;
+  }
+
+  return nc_alloc(s->size << s->shift);
+}
+
+static void
+segarray_chunk_release(struct nc_segarray *s, void *chunk)
+{
+  if (s->spare == NULL) {
+    s->spare = chunk;
+  } else {
+    nc_free(chunk);
+  }
+}
+
+// Makes sure the directory has a free slot before (front != 0) or after the
+// chunks in use. Only chunk pointers move, never the chunks themselves.
+static int
+segarray_dir_make_room(struct nc_segarray *s, int front)
+{
+  void **dir;
+  size_t ndir, first;
+
+  if (front ? s->first > 0 : s->first + s->nchunk < s->ndir) {
+    return NC_OK;
+  }
+
+  if (2 * (s->nchunk + 1) <= s->ndir) {
+    // Plenty of room on the other side, re-center in place
+    first = (s->ndir - s->nchunk) / 2;
+    memmove(s->dir + first, s->dir + s->first, s->nchunk * sizeof(void *));
+    s->first = first;
+    return NC_OK;
+  }
+
+  ndir = 2 * s->ndir;
+  dir = nc_alloc(ndir * sizeof(void *));
+  if (dir == NULL) {
+    return NC_ENOMEM;
+  }
+
+  first = (ndir - s->nchunk) / 2;
+  memcpy(dir + first, s->dir + s->first, s->nchunk * sizeof(void *));
+  nc_free(s->dir);
+
+  s->dir = dir;
+  s->ndir = ndir;
+  s->first = first;
+
+  return NC_OK;
+}
+
+void *
+nc_segarray_push(struct nc_segarray *s)
+{
+  void *chunk;
+  size_t pos;
+
+  pos = s->head + s->nelem;
+
+  if ((pos >> s->shift) == s->nchunk) {
+    if (segarray_dir_make_room(s, 0) != NC_OK) {
+      return NULL;
+    }
+
+    chunk = segarray_chunk_alloc(s);
+    if (chunk == NULL) {
+      return NULL;
+    }
+
+    s->dir[s->first + s->nchunk] = chunk;
+    s->nchunk++;
+  }
+
+  s->nelem++;
+
+  return (u_char *)s->dir[s->first + (pos >> s->shift)] +
+         (pos & s->mask) * s->size;
+}
+
+void *
+nc_segarray_push_front(struct nc_segarray *s)
+{
+  void *chunk;
+
+  if (s->head == 0) {
+    if (segarray_dir_make_room(s, 1) != NC_OK) {
+      return NULL;
+    }
+
+    chunk = segarray_chunk_alloc(s);
+    if (chunk == NULL) {
+      return NULL;
+    }
+
+    s->first--;
+    s->dir[s->first] = chunk;
+    s->nchunk++;
+    s->head = s->mask + 1;
+  }
+
+  s->head--;
+  s->nelem++;
+
+  return (u_char *)s->dir[s->first] + s->head * s->size;
+}
+
+// Removes the last element, copying it to elem if that is not NULL.
+// Returns NC_ERROR if the array is empty.
+int
+nc_segarray_pop(struct nc_segarray *s, void *elem)
+{
+  size_t need;
+
+  if (s->nelem == 0) {
+    return NC_ERROR;
+  }
+
+  if (elem != NULL) {
+    memcpy(elem, nc_segarray_get(s, s->nelem - 1), s->size);
+  }
+
+  s->nelem--;
+
+  // Chunks past the one holding the new end are no longer needed
+  need = (s->head + s->nelem + s->mask) >> s->shift;
+  if (need == 0 && s->nchunk > 0) {
+    need = 1;
+  }
+  while (s->nchunk > need) {
+    s->nchunk--;
+    segarray_chunk_release(s, s->dir[s->first + s->nchunk]);
+  }
+
+  return NC_OK;
+}
+
+// Removes the first element, copying it to elem if that is not NULL.
+// Returns NC_ERROR if the array is empty.
+int
+nc_segarray_pop_front(struct nc_segarray *s, void *elem)
+{
+  if (s->nelem == 0) {
+    return NC_ERROR;
+  }
+
+  if (elem != NULL) {
+    memcpy(elem, nc_segarray_get(s, 0), s->size);
+  }
+
+  s->head++;
+  s->nelem--;
+
+  if (s->head > s->mask) {
+    segarray_chunk_release(s, s->dir[s->first]);
+    s->first++;
+    s->nchunk--;
+    s->head = 0;
+  }
+
+  return NC_OK;
+}
@@ -0,0 +1,46 @@
+#ifndef LIBNC_NC_SEGARRAY_H_
+#define LIBNC_NC_SEGARRAY_H_
+
+#include "nc_macros.h"
+
+// Default chunk size in bytes when nc_segarray_create() gets chunk_nelem 0.
+#define NC_SEGARRAY_CHUNK_SIZE 4096
+
+// Segmented array: elements live in fixed-size chunks of a power-of-two
+// number of elements, reached through a directory of chunk pointers.
+// Growing at either end adds a chunk and never moves elements, so element
+// addresses stay valid until that element is popped.
+struct nc_segarray {
+  void **dir;     /* chunk directory */
+  size_t ndir;    /* slots in dir */
+  size_t first;   /* dir slot of the chunk holding element 0 */
+  size_t nchunk;  /* chunks in use, dir[first .. first + nchunk) */
+  size_t head;    /* offset of element 0 in its chunk */
+  size_t nelem;
+  size_t size;    /* element size */
+  unsigned shift; /* log2 of elements per chunk */
+  size_t mask;
+  void *spare;    /* one released chunk kept to avoid alloc/free churn */
+};
+
+struct nc_segarray *nc_segarray_create(size_t size, size_t chunk_nelem);
+void nc_segarray_destroy(struct nc_segarray *s);
+void *nc_segarray_push(struct nc_segarray *s);
+void *nc_segarray_push_front(struct nc_segarray *s);
+int nc_segarray_pop(struct nc_segarray *s, void *elem);
+int nc_segarray_pop_front(struct nc_segarray *s, void *elem);
+
+static inline void *
+nc_segarray_get(struct nc_segarray *s, size_t i)
+{
+  size_t pos;
+
+  NC_ASSERT(i < s->nelem);
+
+  pos = s->head + i;
+
+  return (u_char *)s->dir[s->first + (pos >> s->shift)] +
+         (pos & s->mask) * s->size;
+}
+
+#endif  // LIBNC_NC_SEGARRAY_H_
@@ -0,0 +1,689 @@
+#include "nc_sort.h"
+
+#include <pthread.h>
+#include <string.h>  // memcpy
+
+// How elements are swapped, picked once per sort from the element size.
+#define SORT_SWAP_4 0
+#define SORT_SWAP_8 1
+#define SORT_SWAP_16 2
+#define SORT_SWAP_8N 3
+#define SORT_SWAP_BYTES 4
+
+static inline int
+sort_swap_kind(size_t size)
+{
+  if (size == 4) {
+    return SORT_SWAP_4;
+  }
+  if (size == 8) {
+    return SORT_SWAP_8;
+  }
+  if (size == 16) {
+    return SORT_SWAP_16;
+  }
+  if (size % 8 == 0) {
+    return SORT_SWAP_8N;
+  }
+  return SORT_SWAP_BYTES;
+}
+
+// memcpy() with a constant size compiles down to a plain (unaligned) load
+// and store, the switch is perfectly predicted within one sort.
+static inline void
+sort_swap(u_char *a, u_char *b, size_t size, int kind)
+{
+  uint32_t t4;
+  uint64_t t8, u8;
+  u_char t;
+  size_t i;
+
+  switch (kind) {
+  case SORT_SWAP_4:
+    memcpy(&t4, a, 4);
+    memcpy(a, b, 4);
+    memcpy(b, &t4, 4);
+    break;
+
+  case SORT_SWAP_8:
+    memcpy(&t8, a, 8);
+    memcpy(a, b, 8);
+    memcpy(b, &t8, 8);
+    break;
+
+  case SORT_SWAP_16:
+    memcpy(&t8, a, 8);
+    memcpy(&u8, a + 8, 8);
+    memcpy(a, b, 16);
+    memcpy(b, &t8, 8);
+    memcpy(b + 8, &u8, 8);
+    break;
+
+  case SORT_SWAP_8N:
+    for (i = 0; i < size; i += 8) {
+      memcpy(&t8, a + i, 8);
+      memcpy(a + i, b + i, 8);
+      memcpy(b + i, &t8, 8);
+    }
+    break;
+
+  default:
+    for (i = 0; i < size; i++) {
+      t = a[i];
+      a[i] = b[i];
+      b[i] = t;
+    }
+    break;
+  }
+}
+
+static void
+sort_insertion(u_char *base, size_t n, size_t size, nc_sort_cmp_pt cmp,
+               int kind)
+{
+  u_char *p, *q, *end;
+
+  end = base + n * size;
+  for (p = base + size; p < end; p += size) {
+    for (q = p; q > base && cmp(q - size, q) > 0; q -= size) {
+      sort_swap(q - size, q, size, kind);
+    }
+  }
+}
+
+static void
+sort_sift(u_char *base, size_t i, size_t n, size_t size, nc_sort_cmp_pt cmp,
+          int kind)
+{
+  size_t c;
+
+  while ((c = 2 * i + 1) < n) {
+    if (c + 1 < n && cmp(base + c * size, base + (c + 1) * size) < 0) {
+      c++;
+    }
+    if (cmp(base + i * size, base + c * size) >= 0) {
+      break;
+    }
+    sort_swap(base + i * size, base + c * size, size, kind);
+    i = c;
+  }
+}
+
+static void
+sort_heap(u_char *base, size_t n, size_t size, nc_sort_cmp_pt cmp, int kind)
+{
+  size_t i;
+
+  for (i = n / 2; i > 0; i--) {
+    sort_sift(base, i - 1, n, size, cmp, kind);
+  }
+
+  for (i = n - 1; i > 0; i--) {
+    sort_swap(base, base + i * size, size, kind);
+    sort_sift(base, 0, i, size, cmp, kind);
+  }
+}
+
+static void
+sort_intro(u_char *base, size_t n, size_t size, nc_sort_cmp_pt cmp, int kind,
+           int depth)
+{
+  u_char *lo, *mid, *hi, *i, *j;
+  size_t left;
+
+  while (n > NC_SORT_INSERTION_THRESHOLD) {
+    if (depth-- == 0) {
+      sort_heap(base, n, size, cmp, kind);
+      return;
+    }
+
+    // Median of three, ends up with *lo <= *mid <= *hi, then the median is
+    // moved to *lo. *hi stops the left scan and *lo the right one.
+    lo = base;
+    mid = base + (n / 2) * size;
+    hi = base + (n - 1) * size;
+
+    if (cmp(mid, lo) < 0) {
+      sort_swap(mid, lo, size, kind);
+    }
+    if (cmp(hi, mid) < 0) {
+      sort_swap(hi, mid, size, kind);
+      if (cmp(mid, lo) < 0) {
+        sort_swap(mid, lo, size, kind);
+      }
+    }
+    sort_swap(mid, lo, size, kind);
+
+    i = lo;
+    j = base + n * size;
+    for (;;) {
+      do {
+        i += size;
+      } while (cmp(i, lo) < 0);
+
+      do {
+        j -= size;
+      } while (cmp(lo, j) < 0);
+
+      if (i >= j) {
+        break;
+      }
+
+      sort_swap(i, j, size, kind);
+    }
+    sort_swap(lo, j, size, kind);
+
+    // Recurse into the smaller part so the stack stays O(log n)
+    left = (size_t)(j - base) / size;
+    if (left < n - left - 1) {
+      sort_intro(base, left, size, cmp, kind, depth);
+      base = j + size;
+      n = n - left - 1;
+
+    } else {
+      sort_intro(j + size, n - left - 1, size, cmp, kind, depth);
+      n = left;
+    }
+  }
+
+  sort_insertion(base, n, size, cmp, kind);
+}
+
+void
+nc_sort(void *base, size_t n, size_t size, nc_sort_cmp_pt cmp)
+{
+  int depth;
+  size_t k;
+
+  NC_ASSERT(size != 0);
+
+  if (n < 2) {
+    return;
+  }
+
+  for (depth = 0, k = n; k > 1; k >>= 1) {
+    depth += 2;
+  }
+
+  sort_intro(base, n, size, cmp, sort_swap_kind(size), depth);
+}
+
+static inline uint64_t
+radix_key(const u_char *p, size_t width)
+{
+  uint8_t k1;
+  uint16_t k2;
+  uint32_t k4;
+  uint64_t k8;
+
+  switch (width) {
+  case 1:
+    k1 = *p;
+    return k1;
+
+  case 2:
+    memcpy(&k2, p, 2);
+    return k2;
+
+  case 4:
+    memcpy(&k4, p, 4);
+    return k4;
+
+  default:
+    memcpy(&k8, p, 8);
+    return k8;
+  }
+}
+
+static inline void
+radix_copy(u_char *dst, const u_char *src, size_t size)
+{
+  switch (size) {
+  case 4:
+    memcpy(dst, src, 4);
+    break;
+
+  case 8:
+    memcpy(dst, src, 8);
+    break;
+
+  case 16:
+    memcpy(dst, src, 16);
+    break;
+
+  default:
+    memcpy(dst, src, size);
+    break;
+  }
+}
+
+int
+nc_radix_sort(void *base, size_t n, size_t size, size_t key_offset,
+              size_t key_width)
+{
+  size_t counts[8][256];
+  size_t i, b, sum, c;
+  u_char *scratch, *src, *dst, *p, *t;
+  uint64_t key;
+  unsigned shift;
+
+  NC_ASSERT(key_width == 1 || key_width == 2 || key_width == 4 ||
+            key_width == 8);
+  NC_ASSERT(key_offset + key_width <= size);
+
+  if (n < 2) {
+    return NC_OK;
+  }
+
+  scratch = nc_alloc(n * size);
+  if (scratch == NULL) {
+    return NC_ENOMEM;
+  }
+
+  // One read pass builds the histograms of every key byte
+  memset(counts, 0, sizeof(counts[0]) * key_width);
+  for (i = 0, p = base; i < n; i++, p += size) {
+    key = radix_key(p + key_offset, key_width);
+    for (b = 0; b < key_width; b++) {
+      counts[b][(key >> (8 * b)) & 0xff]++;
+    }
+  }
+
+  src = base;
+  dst = scratch;
+
+  for (b = 0; b < key_width; b++) {
+    shift = (unsigned)(8 * b);
+
+    // All keys share this byte, the pass would be an identity permutation
+    key = radix_key(src + key_offset, key_width);
+    if (counts[b][(key >> shift) & 0xff] == n) {
+      continue;
+    }
+
+    for (i = 0, sum = 0; i < 256; i++) {
+      c = counts[b][i];
+      counts[b][i] = sum;
+      sum += c;
+    }
+
+    for (i = 0, p = src; i < n; i++, p += size) {
+      key = radix_key(p + key_offset, key_width);
+      radix_copy(dst + counts[b][(key >> shift) & 0xff]++ * size, p, size);
+    }
+
+    t = src;
+    src = dst;
+    dst = t;
+  }
+
+  if (src != base) {
+    memcpy(base, src, n * size);
+  }
+
+  nc_free(scratch);
+
+  return NC_OK;
+}
+
+#define PSORT_PHASE_SORT 0
+#define PSORT_PHASE_MERGE 1
+#define PSORT_PHASE_COPY 2
+
+struct psort {
+  u_char *base;
+  u_char *scratch;
+  size_t n;
+  size_t size;
+  nc_sort_cmp_pt cmp;
+  int nruns;
+  size_t *bounds;  /* nruns x (nruns + 1), run r's split points */
+  size_t *offsets; /* nruns + 1, output offset of each merge partition */
+};
+
+struct psort_task {
+  struct psort *ps;
+  int id;
+  int phase;
+};
+
+#define psort_bound(_ps, _r, _j) \
+  ((_ps)->bounds[(_r) * ((_ps)->nruns + 1) + (_j)])
+
+static inline int
+psort_less(struct psort *ps, u_char **cur, int a, int b)
+{
+  int r = ps->cmp(cur[a], cur[b]);
+
+  // Ties go to the lower run, which keeps the merge deterministic
+  return r < 0 || (r == 0 && a < b);
+}
+
+static void
+psort_merge(struct psort *ps, int j)
+{
+  u_char *cur[NC_PARALLEL_SORT_MAX_THREADS];
+  u_char *end[NC_PARALLEL_SORT_MAX_THREADS];
+  int heap[NC_PARALLEL_SORT_MAX_THREADS];
+  u_char *out;
+  size_t size = ps->size;
+  int r, k, i, c, top;
+
+  k = 0;
+  for (r = 0; r < ps->nruns; r++) {
+    cur[r] = ps->base + psort_bound(ps, r, j) * size;
+    end[r] = ps->base + psort_bound(ps, r, j + 1) * size;
+    if (cur[r] < end[r]) {
+      heap[k++] = r;
+    }
+  }
+
+  out = ps->scratch + ps->offsets[j] * size;
+
+  // Binary min-heap of run ids keyed by their current element
+  for (i = k / 2 - 1; i >= 0; i--) {
+    for (c = i; 2 * c + 1 < k; c = top) {
+      top = 2 * c + 1;
+      if (top + 1 < k && psort_less(ps, cur, heap[top + 1], heap[top])) {
+        top++;
+      }
+      if (!psort_less(ps, cur, heap[top], heap[c])) {
+        break;
+      }
+      r = heap[c], heap[c] = heap[top], heap[top] = r;
+    }
+  }
+
+  while (k > 1) {
+    r = heap[0];
+    memcpy(out, cur[r], size);
+    out += size;
+    cur[r] += size;
+
+    if (cur[r] == end[r]) {
+      heap[0] = heap[--k];
+    }
+
+    for (c = 0; 2 * c + 1 < k; c = top) {
+      top = 2 * c + 1;
+      if (top + 1 < k && psort_less(ps, cur, heap[top + 1], heap[top])) {
+        top++;
+      }
+      if (!psort_less(ps, cur, heap[top], heap[c])) {
+        break;
+      }
+      r = heap[c], heap[c] = heap[top], heap[top] = r;
+    }
+  }
+
+  if (k == 1) {
+    r = heap[0];
+    memcpy(out, cur[r], (size_t)(end[r] - cur[r]));
+  }
+}
+
+static void *
+psort_task_run(void *arg)
+{
+  struct psort_task *task = arg;
+  struct psort *ps = task->ps;
+  size_t lo, hi;
+
+  switch (task->phase) {
+  case PSORT_PHASE_SORT:
+    lo = psort_bound(ps, task->id, 0);
+    hi = psort_bound(ps, task->id, ps->nruns);
+    nc_sort(ps->base + lo * ps->size, hi - lo, ps->size, ps->cmp);
+    break;
+
+  case PSORT_PHASE_MERGE:
+    psort_merge(ps, task->id);
+    break;
+
+  default:
+    lo = ps->offsets[task->id];
+    hi = ps->offsets[task->id + 1];
+    memcpy(ps->base + lo * ps->size, ps->scratch + lo * ps->size,
+           (hi - lo) * ps->size);
+    break;
+  }
+
+  return NULL;
+}
+
+// Runs one phase on nruns threads, the calling thread takes task 0. If a
+// thread can't be started its task is run inline.
+static void
+psort_run_phase(struct psort *ps, int phase)
+{
+  struct psort_task tasks[NC_PARALLEL_SORT_MAX_THREADS];
+  pthread_t tids[NC_PARALLEL_SORT_MAX_THREADS];
+  int started[NC_PARALLEL_SORT_MAX_THREADS];
+  int i;
+
+  for (i = 0; i < ps->nruns; i++) {
+    tasks[i].ps = ps;
+    tasks[i].id = i;
+    tasks[i].phase = phase;
+  }
+
+  for (i = 1; i < ps->nruns; i++) {
+    started[i] = pthread_create(&tids[i], NULL, psort_task_run, &tasks[i]) == 0;
+  }
+
+  psort_task_run(&tasks[0]);
+
+  for (i = 1; i < ps->nruns; i++) {
+    if (started[i]) {
+      pthread_join(tids[i], NULL);
+    } else {
+      psort_task_run(&tasks[i]);
+    }
+  }
+}
+
+static size_t
+psort_lower_bound(struct psort *ps, size_t lo, size_t hi, const void *key)
+{
+  size_t mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (ps->cmp(ps->base + mid * ps->size, key) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+static size_t
+psort_upper_bound(struct psort *ps, size_t lo, size_t hi, const void *key)
+{
+  size_t mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (ps->cmp(ps->base + mid * ps->size, key) <= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+// Regular sampling: nruns samples from every sorted run, the samples are
+// sorted and nruns - 1 evenly spaced ones become the splitters of the output
+// partitions. Partition j should start at output rank n * j / nruns; the
+// elements below splitter j go before it, and the ones equal to it are
+// handed out run by run until the rank is reached. Without that, keys with
+// many duplicates would put every cut at the start of an equal range and
+// leave one partition with most of the input.
+static int
+psort_split(struct psort *ps)
+{
+  u_char *samples, *key;
+  size_t lo, hi, less, equal, want, take, size = ps->size;
+  size_t *cut;
+  int p = ps->nruns, r, i, j;
+
+  cut = nc_alloc(2 * (size_t)p * sizeof(size_t) + (size_t)p * p * size);
+  if (cut == NULL) {
+    return NC_ENOMEM;
+  }
+  samples = (u_char *)(cut + 2 * p);
+
+  for (r = 0; r < p; r++) {
+    lo = psort_bound(ps, r, 0);
+    hi = psort_bound(ps, r, p);
+    for (i = 0; i < p; i++) {
+      memcpy(samples + ((size_t)r * p + i) * size,
+             ps->base + (lo + (hi - lo) * i / p) * size, size);
+    }
+  }
+
+  nc_sort(samples, (size_t)p * p, size, ps->cmp);
+
+  for (j = 1; j < p; j++) {
+    key = samples + ((size_t)j * p + p / 2) * size;
+
+    // cut[r] and cut[p + r] are the equal range of the splitter in run r
+    less = 0;
+    for (r = 0; r < p; r++) {
+      lo = psort_bound(ps, r, 0);
+      hi = psort_bound(ps, r, p);
+      cut[r] = psort_lower_bound(ps, lo, hi, key);
+      cut[p + r] = psort_upper_bound(ps, cut[r], hi, key);
+      less += cut[r] - lo;
+    }
+
+    want = ps->n * j / p;
+    want = want > less ? want - less : 0;
+
+    // Equal splitters hand out a growing prefix of the same ranges, so no
+    // cut moves back
+    for (r = 0; r < p; r++) {
+      equal = cut[p + r] - cut[r];
+      take = want < equal ? want : equal;
+      psort_bound(ps, r, j) = cut[r] + take;
+      want -= take;
+    }
+  }
+
+  nc_free(cut);
+
+  ps->offsets[0] = 0;
+  for (j = 1; j <= p; j++) {
+    ps->offsets[j] = ps->offsets[j - 1];
+    for (r = 0; r < p; r++) {
+      NC_ASSERT(psort_bound(ps, r, j) >= psort_bound(ps, r, j - 1));
+      ps->offsets[j] += psort_bound(ps, r, j) - psort_bound(ps, r, j - 1);
+    }
+  }
+
+  NC_ASSERT(ps->offsets[p] == ps->n);
+
+  return NC_OK;
+}
+
+// Allocates the split points of nruns equal runs of base
+static int
+psort_init(struct psort *ps, void *base, size_t n, size_t size,
+           nc_sort_cmp_pt cmp, int nruns)
+{
+  int r;
+
+  ps->bounds = nc_alloc(((size_t)nruns * (nruns + 1) + nruns + 1) *
+                        sizeof(size_t));
+  if (ps->bounds == NULL) {
+    return NC_ENOMEM;
+  }
+
+  ps->base = base;
+  ps->scratch = NULL;
+  ps->n = n;
+  ps->size = size;
+  ps->cmp = cmp;
+  ps->nruns = nruns;
+  ps->offsets = ps->bounds + (size_t)nruns * (nruns + 1);
+
+  for (r = 0; r < nruns; r++) {
+    psort_bound(ps, r, 0) = n * r / nruns;
+    psort_bound(ps, r, nruns) = n * (r + 1) / nruns;
+  }
+
+  return NC_OK;
+}
+
+int
+nc_parallel_sort(void *base, size_t n, size_t size, nc_sort_cmp_pt cmp,
+                 int nthreads)
+{
+  struct psort ps;
+
+  NC_ASSERT(size != 0);
+
+  if (nthreads > NC_PARALLEL_SORT_MAX_THREADS) {
+    nthreads = NC_PARALLEL_SORT_MAX_THREADS;
+  }
+  if ((size_t)nthreads > n / NC_PARALLEL_SORT_MIN_CHUNK) {
+    nthreads = (int)(n / NC_PARALLEL_SORT_MIN_CHUNK);
+  }
+  if (nthreads <= 1 || psort_init(&ps, base, n, size, cmp, nthreads) != NC_OK) {
+    nc_sort(base, n, size, cmp);
+    return NC_OK;
+  }
+
+  ps.scratch = nc_alloc(n * size);
+  if (ps.scratch == NULL) {
+    nc_free(ps.bounds);
+    nc_sort(base, n, size, cmp);
+    return NC_OK;
+  }
+
+  psort_run_phase(&ps, PSORT_PHASE_SORT);
+
+  if (psort_split(&ps) == NC_OK) {
+    psort_run_phase(&ps, PSORT_PHASE_MERGE);
+    psort_run_phase(&ps, PSORT_PHASE_COPY);
+  } else {
+    // The runs are sorted but can't be merged; finish serially rather than
+    // leave them that way
+    nc_sort(base, n, size, cmp);
+  }
+
+  nc_free(ps.scratch);
+  nc_free(ps.bounds);
+
+  return NC_OK;
+}
+
+int
+nc_parallel_sort_split(void *base, size_t n, size_t size, nc_sort_cmp_pt cmp,
+                       int nruns, size_t *sizes)
+{
+  struct psort ps;
+  int j, status;
+
+  NC_ASSERT(nruns >= 1 && nruns <= NC_PARALLEL_SORT_MAX_THREADS);
+
+  status = psort_init(&ps, base, n, size, cmp, nruns);
+  if (status != NC_OK) {
+    return status;
+  }
+
+  status = psort_split(&ps);
+  if (status == NC_OK) {
+    for (j = 0; j < nruns; j++) {
+      sizes[j] = ps.offsets[j + 1] - ps.offsets[j];
+    }
+  }
+
+  nc_free(ps.bounds);
+
+  return status;
+}
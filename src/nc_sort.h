@@ -0,0 +1,181 @@
+#ifndef LIBNC_NC_SORT_H_
+#define LIBNC_NC_SORT_H_
+
+#include <stdint.h>
+
+#include "nc_macros.h"
+#include "nc_sds.h"
+
+// Below this many elements sorting switches to insertion sort.
+#define NC_SORT_INSERTION_THRESHOLD 16
+
+// Below this many elements per thread nc_parallel_sort() sorts serially.
+#define NC_PARALLEL_SORT_MIN_CHUNK 16384
+
+// Upper bound for the nthreads argument of nc_parallel_sort().
+#define NC_PARALLEL_SORT_MAX_THREADS 64
+
+// Same contract as the qsort(3) comparator.
+typedef int (*nc_sort_cmp_pt)(const void *a, const void *b);
+
+// Introsort (quicksort + heapsort fallback + insertion sort for short
+// ranges). Not stable. Swaps are specialized for 4, 8, 16 byte elements and
+// for sizes that are multiples of 8.
+void nc_sort(void *base, size_t n, size_t size, nc_sort_cmp_pt cmp);
+
+// LSD radix sort of fixed-size records by an unsigned integer key of
+// 'key_width' bytes (1, 2, 4 or 8) stored at 'key_offset' in native byte
+// order. Stable. Needs a scratch buffer of n * size bytes.
+//
+// Returns NC_OK, or NC_ENOMEM if the scratch buffer can't be allocated.
+int nc_radix_sort(void *base, size_t n, size_t size, size_t key_offset,
+                  size_t key_width);
+
+// Sorts 'nthreads' chunks concurrently with nc_sort(), then merges them with
+// a parallel multiway merge (each thread merges one splitter-delimited output
+// range) into a scratch buffer of n * size bytes that is copied back.
+// With a total order the result is the same as nc_sort()'s; the relative
+// order of elements that compare equal is unspecified, as with nc_sort().
+// Falls back to nc_sort() for small inputs, nthreads <= 1, or when the
+// scratch buffers can't be allocated.
+//
+// Returns NC_OK.
+int nc_parallel_sort(void *base, size_t n, size_t size, nc_sort_cmp_pt cmp,
+                     int nthreads);
+
+// The merge partition sizes nc_parallel_sort() picks for base cut into
+// 'nruns' equal runs, each already sorted, stored in sizes[0..nruns).
+// Exposed for tests.
+//
+// Returns NC_OK, or NC_ENOMEM.
+int nc_parallel_sort_split(void *base, size_t n, size_t size,
+                           nc_sort_cmp_pt cmp, int nruns, size_t *sizes);
+
+// Sorts sds strings in byte order, see nc_sort_sds.c.
+void nc_sort_sds(sds *base, size_t n);
+
+//
+// NC_SORT_DEFINE(name, type, less) generates
+//
+//   static inline void nc_sort_<name>(type *base, size_t n);
+//
+// an introsort over an array of 'type' where 'less(a, b)' is an expression
+// macro (or inline function) taking two 'type *' and returning non-zero if
+// *a orders before *b. The comparison and the element moves are inlined,
+// so there is no indirect call per comparison as with nc_sort().
+//
+#define NC_SORT_DEFINE(name, type, less)                                     \
+  static inline void nc_sort_##name##_insertion(type *a, size_t n)           \
+  {                                                                          \
+    size_t i, j;                                                             \
+    type t;                                                                  \
+                                                                             \
+    for (i = 1; i < n; i++) {                                                \
+      t = a[i];                                                              \
+      for (j = i; j > 0 && less((&t), (&a[j - 1])); j--) {                   \
+        a[j] = a[j - 1];                                                     \
+      }                                                                      \
+      a[j] = t;                                                              \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  static inline void nc_sort_##name##_sift(type *a, size_t i, size_t n)      \
+  {                                                                          \
+    size_t c;                                                                \
+    type t = a[i];                                                           \
+                                                                             \
+    while ((c = 2 * i + 1) < n) {                                            \
+      if (c + 1 < n && less((&a[c]), (&a[c + 1]))) {                         \
+        c++;                                                                 \
+      }                                                                      \
+      if (!less((&t), (&a[c]))) {                                            \
+        break;                                                               \
+      }                                                                      \
+      a[i] = a[c];                                                           \
+      i = c;                                                                 \
+    }                                                                        \
+    a[i] = t;                                                                \
+  }                                                                          \
+                                                                             \
+  static inline void nc_sort_##name##_heap(type *a, size_t n)                \
+  {                                                                          \
+    size_t i;                                                                \
+    type t;                                                                  \
+                                                                             \
+    for (i = n / 2; i > 0; i--) {                                            \
+      nc_sort_##name##_sift(a, i - 1, n);                                    \
+    }                                                                        \
+    for (i = n - 1; i > 0; i--) {                                            \
+      t = a[0];                                                              \
+      a[0] = a[i];                                                           \
+      a[i] = t;                                                              \
+      nc_sort_##name##_sift(a, 0, i);                                        \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  static inline void nc_sort_##name##_intro(type *a, size_t n, int depth)    \
+  {                                                                          \
+    size_t i, j, m;                                                          \
+    type t;                                                                  \
+                                                                             \
+    while (n > NC_SORT_INSERTION_THRESHOLD) {                                \
+      if (depth-- == 0) {                                                    \
+        nc_sort_##name##_heap(a, n);                                         \
+        return;                                                              \
+      }                                                                      \
+                                                                             \
+      /* median of three: a[0] <= a[m] <= a[n - 1], then pivot to a[0] */   \
+      m = n / 2;                                                             \
+      if (less((&a[m]), (&a[0]))) {                                          \
+        t = a[m], a[m] = a[0], a[0] = t;                                     \
+      }                                                                      \
+      if (less((&a[n - 1]), (&a[m]))) {                                      \
+        t = a[n - 1], a[n - 1] = a[m], a[m] = t;                             \
+        if (less((&a[m]), (&a[0]))) {                                        \
+          t = a[m], a[m] = a[0], a[0] = t;                                   \
+        }                                                                    \
+      }                                                                      \
+      t = a[m], a[m] = a[0], a[0] = t;                                       \
+                                                                             \
+      i = 0;                                                                 \
+      j = n;                                                                 \
+      for (;;) {                                                             \
+        do {                                                                 \
+          i++;                                                               \
+        } while (less((&a[i]), (&a[0])));                                    \
+        do {                                                                 \
+          j--;                                                               \
+        } while (less((&a[0]), (&a[j])));                                    \
+        if (i >= j) {                                                        \
+          break;                                                             \
+        }                                                                    \
+        t = a[i], a[i] = a[j], a[j] = t;                                     \
+      }                                                                      \
+      t = a[0], a[0] = a[j], a[j] = t;                                       \
+                                                                             \
+      /* recurse into the smaller part, loop on the larger one */           \
+      if (j < n - j - 1) {                                                   \
+        nc_sort_##name##_intro(a, j, depth);                                 \
+        a += j + 1;                                                          \
+        n -= j + 1;                                                          \
+      } else {                                                               \
+        nc_sort_##name##_intro(a + j + 1, n - j - 1, depth);                 \
+        n = j;                                                               \
+      }                                                                      \
+    }                                                                        \
+                                                                             \
+    nc_sort_##name##_insertion(a, n);                                        \
+  }                                                                          \
+                                                                             \
+  static inline void nc_sort_##name(type *base, size_t n)                    \
+  {                                                                          \
+    int depth;                                                               \
+    size_t k;                                                                \
+                                                                             \
+    for (depth = 0, k = n; k > 1; k >>= 1) {                                 \
+      depth += 2;                                                            \
+    }                                                                        \
+    nc_sort_##name##_intro(base, n, depth);                                  \
+  }
+
+#endif  // LIBNC_NC_SORT_H_
@@ -0,0 +1,202 @@
+#include "nc_sort.h"
+
+#include <string.h>  // memcpy, memset
+
+// Below this many strings MSD radix sort hands over to multikey quicksort,
+// and multikey quicksort to insertion sort.
+#define SDS_MSD_THRESHOLD 64
+#define SDS_INSERTION_THRESHOLD 8
+
+// Byte 'depth' of s as 1..256, or 0 past the end of the string, so shorter
+// strings order first.
+static inline unsigned
+sds_char(const sds s, size_t depth)
+{
+  return depth < sdslen(s) ? (unsigned)(u_char)s[depth] + 1 : 0;
+}
+
+// Compares a and b knowing their first 'depth' bytes are equal.
+static inline int
+sds_less(const sds a, const sds b, size_t depth)
+{
+  size_t la = sdslen(a), lb = sdslen(b), n = MIN(la, lb), i;
+
+  for (i = depth; i < n; i++) {
+    if (a[i] != b[i]) {
+      return (u_char)a[i] < (u_char)b[i];
+    }
+  }
+
+  return la < lb;
+}
+
+static void
+sds_insertion(sds *a, size_t n, size_t depth)
+{
+  size_t i, j;
+  sds t;
+
+  for (i = 1; i < n; i++) {
+    t = a[i];
+    for (j = i; j > 0 && sds_less(t, a[j - 1], depth); j--) {
+      a[j] = a[j - 1];
+    }
+    a[j] = t;
+  }
+}
+
+static inline unsigned
+sds_median3(unsigned a, unsigned b, unsigned c)
+{
+  if (a < b) {
+    return b < c ? b : (a < c ? c : a);
+  }
+  return a < c ? a : (b < c ? c : b);
+}
+
+// Multikey quicksort (Bentley & Sedgewick): three-way partition on the
+// byte at 'depth', only the equal part moves on to the next byte. The
+// largest part is handled by the loop, so recursion stays O(log n) deep.
+static void
+sds_mkqs(sds *a, size_t n, size_t depth)
+{
+  size_t lt, gt, i, part[3], off[3], big, k;
+  unsigned v, c;
+  sds t;
+
+  for (;;) {
+    if (n < SDS_INSERTION_THRESHOLD) {
+      sds_insertion(a, n, depth);
+      return;
+    }
+
+    v = sds_median3(sds_char(a[0], depth), sds_char(a[n / 2], depth),
+                    sds_char(a[n - 1], depth));
+
+    // [0, lt) < v, [lt, i) == v, [gt, n) > v
+    lt = 0;
+    i = 0;
+    gt = n;
+    while (i < gt) {
+      c = sds_char(a[i], depth);
+      if (c < v) {
+        t = a[lt], a[lt] = a[i], a[i] = t;
+        lt++;
+        i++;
+      } else if (c > v) {
+        gt--;
+        t = a[gt], a[gt] = a[i], a[i] = t;
+      } else {
+        i++;
+      }
+    }
+
+    off[0] = 0;
+    part[0] = lt;
+    off[1] = lt;
+    part[1] = v != 0 ? gt - lt : 0; /* strings that ended are all equal */
+    off[2] = gt;
+    part[2] = n - gt;
+
+    for (big = 0, k = 1; k < 3; k++) {
+      if (part[k] > part[big]) {
+        big = k;
+      }
+    }
+
+    for (k = 0; k < 3; k++) {
+      if (k != big && part[k] > 1) {
+        sds_mkqs(a + off[k], part[k], depth + (k == 1));
+      }
+    }
+
+    a += off[big];
+    n = part[big];
+    depth += (big == 1);
+  }
+}
+
+// MSD radix sort: one counting pass over the byte at 'depth', cached in
+// 'oracle' so each string is touched once, then a distribution through
+// 'tmp'. Every bucket but the largest recurses, the largest loops.
+static void
+sds_msd(sds *a, size_t n, size_t depth, sds *tmp, uint16_t *oracle)
+{
+  size_t count[257], start[257], i, sum;
+  unsigned c, big;
+
+  for (;;) {
+    if (n < SDS_MSD_THRESHOLD) {
+      sds_mkqs(a, n, depth);
+      return;
+    }
+
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++) {
+      c = sds_char(a[i], depth);
+      oracle[i] = (uint16_t)c;
+      count[c]++;
+    }
+
+    // A common byte: nothing to distribute
+    if (count[oracle[0]] == n) {
+      if (oracle[0] == 0) {
+        return;
+      }
+      depth++;
+      continue;
+    }
+
+    for (c = 0, sum = 0; c < 257; c++) {
+      start[c] = sum;
+      sum += count[c];
+    }
+
+    for (i = 0; i < n; i++) {
+      tmp[start[oracle[i]]++] = a[i];
+    }
+    memcpy(a, tmp, n * sizeof(sds));
+
+    // start[c] now is the end of bucket c
+    for (c = 1, big = 1; c < 257; c++) {
+      if (count[c] > count[big]) {
+        big = c;
+      }
+    }
+
+    for (c = 1; c < 257; c++) {
+      if (c != big && count[c] > 1) {
+        sds_msd(a + start[c] - count[c], count[c], depth + 1, tmp, oracle);
+      }
+    }
+
+    a += start[big] - count[big];
+    n = count[big];
+    depth++;
+  }
+}
+
+// Sorts sds strings in byte order (as sdscmp() orders them). Not stable.
+// Uses MSD radix sort with a scratch buffer of n pointers and n 16-bit
+// bytes, or multikey quicksort alone if that can't be allocated; neither
+// re-compares the prefix two strings are already known to share.
+void
+nc_sort_sds(sds *base, size_t n)
+{
+  u_char *scratch;
+
+  if (n < SDS_MSD_THRESHOLD) {
+    sds_mkqs(base, n, 0);
+    return;
+  }
+
+  scratch = nc_alloc(n * (sizeof(sds) + sizeof(uint16_t)));
+  if (scratch == NULL) {
+    sds_mkqs(base, n, 0);
+    return;
+  }
+
+  sds_msd(base, n, 0, (sds *)scratch, (uint16_t *)(scratch + n * sizeof(sds)));
+
+  nc_free(scratch);
+}
@@ -0,0 +1,228 @@
+#include "nc_strtab.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#define STRTAB_MIN_SLOTS 16
+
+// FNV-1a, folded to 32 bits
+static uint32_t
+strtab_hash(const char *s, size_t len)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    h = (h ^ (u_char)s[i]) * 0x100000001b3ULL;
+  }
+
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+static inline struct nc_strtab_entry *
+strtab_entry(const struct nc_strtab *t, int id)
+{
+  return (struct nc_strtab_entry *)t->index.elems + id;
+}
+
+// Returns the id of the string, or -1. *slot is set to the slot holding it
+// or the empty slot it would go to.
+static int
+strtab_lookup(const struct nc_strtab *t, const char *s, size_t len,
+              uint32_t hash, uint32_t *slot)
+{
+  const struct nc_strtab_entry *e;
+  uint32_t i, v;
+
+  for (i = hash & t->mask; (v = t->slots[i]) != 0; i = (i + 1) & t->mask) {
+    e = strtab_entry(t, (int)v - 1);
+    if (e->hash == hash && e->len == len &&
+        memcmp((const u_char *)t->bytes.elems + e->offset, s, len) == 0) {
+      *slot = i;
+      return (int)v - 1;
+    }
+  }
+
+  *slot = i;
+
+  return -1;
+}
+
+// Rebuilds the dedup table with twice the slots from the stored hashes.
+static int
+strtab_grow_slots(struct nc_strtab *t)
+{
+  uint32_t *slots, mask, i;
+  int id;
+
+  mask = 2 * (t->mask + 1) - 1;
+  slots = nc_calloc((size_t)mask + 1, sizeof(uint32_t));
+  if (slots == NULL) {
+    return NC_ENOMEM;
+  }
+
+  for (id = 0; id < t->index.nelem; id++) {
+    for (i = strtab_entry(t, id)->hash & mask; slots[i] != 0;
+         i = (i + 1) & mask) {
+      /* void */
+    }
+    slots[i] = (uint32_t)id + 1;
+  }
+
+  nc_free(t->slots);
+  t->slots = slots;
+  t->mask = mask;
+
+  return NC_OK;
+}
+
+// Creates a table with room for n strings before the index grows. With
+// NC_STRTAB_DEDUP in flags equal strings are stored once.
+struct nc_strtab *
+nc_strtab_create(int n, unsigned flags)
+{
+  struct nc_strtab *t;
+
+  NC_ASSERT(n > 0);
+
+  t = nc_alloc(sizeof(*t));
+  if (t == NULL) {
+    return NULL;
+  }
+
+  t->slots = NULL;
+  t->mask = 0;
+  t->flags = flags;
+
+  if (nc_array_init(&t->bytes, 16 * n, 1) != NC_OK) {
+    nc_free(t);
+    return NULL;
+  }
+
+  if (nc_array_init(&t->index, n, sizeof(struct nc_strtab_entry)) != NC_OK) {
+    nc_array_deinit(&t->bytes);
+    nc_free(t);
+    return NULL;
+  }
+
+  if (flags & NC_STRTAB_DEDUP) {
+    t->slots = nc_calloc(STRTAB_MIN_SLOTS, sizeof(uint32_t));
+    if (t->slots == NULL) {
+      nc_strtab_destroy(t);
+      return NULL;
+    }
+    t->mask = STRTAB_MIN_SLOTS - 1;
+  }
+
+  return t;
+}
+
+void
+nc_strtab_destroy(struct nc_strtab *t)
+{
+  nc_array_deinit(&t->bytes);
+  nc_array_deinit(&t->index);
+  if (t->slots != NULL) {
+    nc_free(t->slots);
+  }
+  nc_free(t);
+}
+
+// Appends 'len' bytes at 's' (which may contain NULs) and returns the id of
+// the new string, or of the equal string already in a dedup table.
+//
+// Returns NC_ENOMEM, or NC_ERROR once the table holds 2GB of bytes.
+int
+nc_strtab_append(struct nc_strtab *t, const char *s, size_t len)
+{
+  struct nc_strtab_entry *e;
+  uint32_t hash, slot = 0;
+  uintptr_t base;
+  u_char *p;
+  int id, inside;
+
+  if (len >= (size_t)(INT_MAX - t->bytes.nelem)) {
+    return NC_ERROR;
+  }
+
+  hash = strtab_hash(s, len);
+
+  if (t->flags & NC_STRTAB_DEDUP) {
+    // Keep the table at most half full
+    if (2 * ((uint32_t)t->index.nelem + 1) > t->mask + 1 &&
+        strtab_grow_slots(t) != NC_OK) {
+      return NC_ENOMEM;
+    }
+
+    id = strtab_lookup(t, s, len, hash, &slot);
+    if (id >= 0) {
+      return id;
+    }
+  }
+
+  if (nc_array_reserve(&t->index, 1) != NC_OK) {
+    return NC_ENOMEM;
+  }
+
+  // 's' may be one of our own strings, which the push below can move
+  base = (uintptr_t)t->bytes.elems;
+  inside = (uintptr_t)s - base < (size_t)t->bytes.nelem;
+
+  p = nc_array_push_n(&t->bytes, (int)len + 1);
+  if (p == NULL) {
+    return NC_ENOMEM;
+  }
+  if (inside) {
+    s = (char *)t->bytes.elems + ((uintptr_t)s - base);
+  }
+  memcpy(p, s, len);
+  p[len] = '\0';
+
+  id = t->index.nelem;
+  e = nc_array_push(&t->index);
+  e->offset = (uint32_t)(p - (u_char *)t->bytes.elems);
+  e->len = (uint32_t)len;
+  e->hash = hash;
+
+  if (t->flags & NC_STRTAB_DEDUP) {
+    t->slots[slot] = (uint32_t)id + 1;
+  }
+
+  return id;
+}
+
+// Returns the id of the string equal to 's', or -1. Only tables created
+// with NC_STRTAB_DEDUP can be searched.
+int
+nc_strtab_find(const struct nc_strtab *t, const char *s, size_t len)
+{
+  uint32_t slot;
+
+  NC_ASSERT(t->flags & NC_STRTAB_DEDUP);
+
+  if (t->slots == NULL) {
+    return -1;
+  }
+
+  return strtab_lookup(t, s, len, strtab_hash(s, len), &slot);
+}
+
+// Calls fn for every string in id order until it returns non-zero. Returns
+// the non-zero value that stopped the iteration, or 0.
+int
+nc_strtab_iterate(const struct nc_strtab *t, nc_strtab_iter_pt fn, void *ctx)
+{
+  const struct nc_strtab_entry *e = t->index.elems;
+  const char *bytes = t->bytes.elems;
+  int id, rc;
+
+  for (id = 0; id < t->index.nelem; id++) {
+    rc = fn(id, bytes + e[id].offset, e[id].len, ctx);
+    if (rc != 0) {
+      return rc;
+    }
+  }
+
+  return 0;
+}
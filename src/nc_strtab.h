@@ -0,0 +1,65 @@
+#ifndef LIBNC_NC_STRTAB_H_
+#define LIBNC_NC_STRTAB_H_
+
+#include <stdint.h>
+
+#include "nc_array.h"
+
+// nc_strtab_create() flags
+#define NC_STRTAB_DEDUP 0x0001 /* appending a string already present
+                                  returns its id */
+
+// Packed string table: strings are stored back to back, each followed by
+// a NUL, in one byte array, and addressed by a dense id (0, 1, 2, ...)
+// through an index of (offset, length) entries. Appending may move the
+// bytes, so pointers from nc_strtab_get() are valid until the next append;
+// ids stay valid for the life of the table.
+struct nc_strtab_entry {
+  uint32_t offset;
+  uint32_t len;
+  uint32_t hash;
+};
+
+struct nc_strtab {
+  struct nc_array bytes; /* u_char, the packed strings */
+  struct nc_array index; /* struct nc_strtab_entry, by id */
+  uint32_t *slots;       /* dedup hash table of id + 1, 0 is empty */
+  uint32_t mask;         /* slots in the table - 1 */
+  unsigned flags;
+};
+
+// Return non-zero to stop the iteration.
+typedef int (*nc_strtab_iter_pt)(int id, const char *s, size_t len,
+                                 void *ctx);
+
+struct nc_strtab *nc_strtab_create(int n, unsigned flags);
+void nc_strtab_destroy(struct nc_strtab *t);
+int nc_strtab_append(struct nc_strtab *t, const char *s, size_t len);
+int nc_strtab_find(const struct nc_strtab *t, const char *s, size_t len);
+int nc_strtab_iterate(const struct nc_strtab *t, nc_strtab_iter_pt fn,
+                      void *ctx);
+
+static inline int
+nc_strtab_count(const struct nc_strtab *t)
+{
+  return t->index.nelem;
+}
+
+// Returns the NUL-terminated string with 'id', and its length in *len if
+// len is not NULL.
+static inline const char *
+nc_strtab_get(const struct nc_strtab *t, int id, size_t *len)
+{
+  const struct nc_strtab_entry *e;
+
+  NC_ASSERT(id >= 0 && id < t->index.nelem);
+
+  e = (const struct nc_strtab_entry *)t->index.elems + id;
+  if (len != NULL) {
+    *len = e->len;
+  }
+
+  return (const char *)t->bytes.elems + e->offset;
+}
+
+#endif  // LIBNC_NC_STRTAB_H_
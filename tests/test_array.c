@@ -1,4 +1,13 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "nc_array.h"
+#include "nc_cpu.h"
+#include "nc_palloc.h"
+#include "nc_scan.h"
 #include "greatest.h"
 
 struct t_pos {
@@ -6,6 +15,48 @@ struct t_pos {
   int y;
 };
 
+struct t_rec {
+  uint64_t key;
+  uint64_t seq;
+};
+
+#define t_rec_less(a, b) ((a)->key < (b)->key)
+
+NC_ARRAY_SORT_DEFINE(rec, struct t_rec, t_rec_less)
+
+static int t_rec_cmp(const void *a, const void *b) {
+  const struct t_rec *ra = a, *rb = b;
+
+  if (ra->key != rb->key) {
+    return ra->key < rb->key ? -1 : 1;
+  }
+  return 0;
+}
+
+static int t_pos_cmp(const void *a, const void *b) {
+  const struct t_pos *pa = a, *pb = b;
+
+  return pa->x - pb->x;
+}
+
+static struct nc_array *t_rec_fill(int n, uint64_t mod) {
+  struct nc_array *arr;
+  struct t_rec *r;
+  uint64_t x = 88172645463325252ULL;
+  int i;
+
+  arr = nc_array_create(n, sizeof(struct t_rec));
+  for (i = 0; i < n; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    r = (struct t_rec *)nc_array_push(arr);
+    r->key = x % mod;
+    r->seq = (uint64_t)i;
+  }
+  return arr;
+}
+
 TEST basic(void) {
   struct t_pos *p;
   int i;
@@ -37,6 +88,386 @@ TEST basic(void) {
   PASS();
 }
 
+TEST grow_large(void) {
+  struct nc_array *arr;
+  uint64_t *p;
+  int i, n;
+
+  n = 4 * NC_ARRAY_MMAP_THRESHOLD / sizeof(uint64_t);
+  arr = nc_array_create(16, sizeof(uint64_t));
+  for (i = 0; i < n; i++) {
+    p = (uint64_t *)nc_array_push(arr);
+    ASSERT(p != NULL);
+    *p = (uint64_t)i * 3;
+  }
+  ASSERT_EQ(NC_OK, nc_array_reserve(arr, n));
+  ASSERT(arr->nalloc >= 2 * n);
+
+  // Past INT_MAX elements reserve fails without touching the array
+  ASSERT_EQ(NC_ERROR, nc_array_reserve(arr, INT_MAX - n + 1));
+  ASSERT_EQ(n, arr->nelem);
+
+  p = (uint64_t *)arr->elems;
+  for (i = 0; i < n; i++) {
+    ASSERT_EQ((uint64_t)i * 3, p[i]);
+  }
+#if defined(__linux__)
+  ASSERT(arr->flags & NC_ARRAY_MMAP);
+#endif
+
+  nc_array_destroy(arr);
+  PASS();
+}
+
+TEST pool(void) {
+  struct nc_pool *pool;
+  struct nc_array *arr;
+  uint32_t *p, *first;
+  int i;
+
+  pool = nc_pool_create(NC_DEFAULT_POOL_SIZE);
+  arr = nc_array_pcreate(pool, 4, sizeof(uint32_t));
+  ASSERT(arr != NULL);
+
+  // The buffer is the last allocation in its block, it grows in place
+  first = (uint32_t *)arr->elems;
+  for (i = 0; i < 64; i++) {
+    p = (uint32_t *)nc_array_push(arr);
+    ASSERT(p != NULL);
+    *p = (uint32_t)i;
+  }
+  ASSERT(arr->elems == first);
+
+  // Past the block size it moves, to a large allocation in the end
+  for (; i < 10000; i++) {
+    p = (uint32_t *)nc_array_push(arr);
+    ASSERT(p != NULL);
+    *p = (uint32_t)i;
+  }
+  p = (uint32_t *)arr->elems;
+  for (i = 0; i < arr->nelem; i++) {
+    ASSERT_EQ((uint32_t)i, p[i]);
+  }
+
+  nc_array_destroy(arr);
+  nc_pool_destroy(pool);
+  PASS();
+}
+
+TEST save_map(void) {
+  struct nc_array *arr, *m, *arr2, *m2;
+  const char *path = "test_array.bin";
+
+  arr = t_rec_fill(1000, 1000);
+  ASSERT_EQ(NC_OK, nc_array_save(arr, path));
+
+  m = nc_array_map(path);
+  ASSERT(m != NULL);
+  ASSERT_EQ(arr->nelem, m->nelem);
+  ASSERT_EQ(arr->size, m->size);
+  ASSERT_EQ(0, memcmp(arr->elems, m->elems, arr->nelem * arr->size));
+  ASSERT_EQ(NC_OK, nc_array_map_verify(m));
+  ASSERT(nc_array_push(m) == NULL);
+
+  // Saving over a mapped file replaces it, the old mapping is untouched
+  arr2 = t_rec_fill(500, 7);
+  ASSERT_EQ(NC_OK, nc_array_save(arr2, path));
+  ASSERT_EQ(0, memcmp(arr->elems, m->elems, arr->nelem * arr->size));
+  m2 = nc_array_map(path);
+  ASSERT(m2 != NULL);
+  ASSERT_EQ(arr2->nelem, m2->nelem);
+  ASSERT_EQ(0, memcmp(arr2->elems, m2->elems, arr2->nelem * arr2->size));
+
+  nc_array_destroy(m2);
+  nc_array_destroy(arr2);
+  nc_array_destroy(m);
+  nc_array_destroy(arr);
+  remove(path);
+  PASS();
+}
+
+TEST sort(void) {
+  struct nc_array *arr;
+  struct t_rec *r;
+  struct t_pos *p;
+  int i;
+
+  arr = t_rec_fill(10000, 1000);
+  nc_array_sort(arr, t_rec_cmp);
+  r = (struct t_rec *)arr->elems;
+  for (i = 1; i < arr->nelem; i++) {
+    ASSERT(r[i - 1].key <= r[i].key);
+  }
+  nc_array_destroy(arr);
+
+  arr = t_rec_fill(10000, 1ULL << 40);
+  nc_array_sort_rec(arr);
+  r = (struct t_rec *)arr->elems;
+  for (i = 1; i < arr->nelem; i++) {
+    ASSERT(r[i - 1].key <= r[i].key);
+  }
+  nc_array_destroy(arr);
+
+  // 8-byte elements, descending input
+  arr = nc_array_create(4, sizeof(struct t_pos));
+  for (i = 0; i < 1000; i++) {
+    p = (struct t_pos *)nc_array_push(arr);
+    p->x = 1000 - i;
+    p->y = 0;
+  }
+  nc_array_sort(arr, t_pos_cmp);
+  p = (struct t_pos *)arr->elems;
+  for (i = 0; i < arr->nelem; i++) {
+    ASSERT_EQ(i + 1, p[i].x);
+  }
+  nc_array_destroy(arr);
+
+  PASS();
+}
+
+TEST radix_sort(void) {
+  struct nc_array *arr;
+  struct t_rec *r;
+  int i;
+
+  arr = t_rec_fill(10000, 100);
+  ASSERT_EQ(NC_OK, nc_array_radix_sort(arr, offsetof(struct t_rec, key),
+                                       sizeof(uint64_t)));
+  r = (struct t_rec *)arr->elems;
+  for (i = 1; i < arr->nelem; i++) {
+    ASSERT(r[i - 1].key <= r[i].key);
+    // stable
+    if (r[i - 1].key == r[i].key) {
+      ASSERT(r[i - 1].seq < r[i].seq);
+    }
+  }
+  nc_array_destroy(arr);
+
+  PASS();
+}
+
+TEST parallel_sort(void) {
+  struct nc_array *arr, *ref;
+
+  arr = t_rec_fill(200000, 1ULL << 40);
+  ref = t_rec_fill(200000, 1ULL << 40);
+
+  nc_array_sort(ref, t_rec_cmp);
+  ASSERT_EQ(NC_OK, nc_array_parallel_sort(arr, t_rec_cmp, 4));
+  ASSERT_EQ(0, memcmp(arr->elems, ref->elems, arr->nelem * arr->size));
+
+  nc_array_destroy(arr);
+  nc_array_destroy(ref);
+  PASS();
+}
+
+// With few distinct keys the cuts have to go inside the equal ranges for
+// every merge partition to get its share
+TEST parallel_sort_split(void) {
+  static const uint64_t mods[] = {1, 2, 3, 1ULL << 40};
+  struct nc_array *arr, *ref;
+  size_t sizes[8], sum;
+  int m, r, j, n = 200000;
+
+  for (m = 0; m < (int)NELEMS(mods); m++) {
+    arr = t_rec_fill(n, mods[m]);
+    for (r = 0; r < 8; r++) {
+      nc_sort((struct t_rec *)arr->elems + n * r / 8,
+              (size_t)(n * (r + 1) / 8 - n * r / 8), arr->size, t_rec_cmp);
+    }
+    ASSERT_EQ(NC_OK, nc_parallel_sort_split(arr->elems, (size_t)n, arr->size,
+                                            t_rec_cmp, 8, sizes));
+    for (j = 0, sum = 0; j < 8; j++) {
+      ASSERT(sizes[j] < (size_t)n / 4);
+      if (mods[m] < 8) {
+        ASSERT(sizes[j] <= (size_t)n / 8 + 1);
+      }
+      sum += sizes[j];
+    }
+    ASSERT_EQ((size_t)n, sum);
+    nc_array_destroy(arr);
+
+    arr = t_rec_fill(n, mods[m]);
+    ref = t_rec_fill(n, mods[m]);
+    nc_array_sort(ref, t_rec_cmp);
+    ASSERT_EQ(NC_OK, nc_array_parallel_sort(arr, t_rec_cmp, 8));
+    for (j = 0; j < n; j++) {
+      ASSERT_EQ(((struct t_rec *)ref->elems)[j].key,
+                ((struct t_rec *)arr->elems)[j].key);
+    }
+    nc_array_destroy(arr);
+    nc_array_destroy(ref);
+  }
+
+  PASS();
+}
+
+static int t_sds_cmp(const void *a, const void *b) {
+  return sdscmp(*(const sds *)a, *(const sds *)b);
+}
+
+// Random strings of one of a few shapes: any bytes (NULs and 0xff
+// included), a shared long prefix with a short tail over an alphabet of
+// extremes, or the empty string.
+static sds t_sds_rand(uint64_t *x) {
+  static const char tail_chars[] = {'\0', '\x01', 'a', '\x7f', '\x80',
+                                    '\xff'};
+  char buf[300];
+  size_t len, i;
+  uint64_t r;
+
+  *x ^= *x << 13;
+  *x ^= *x >> 7;
+  *x ^= *x << 17;
+  r = *x;
+
+  switch (r % 8) {
+  case 0:
+    return sdsempty();
+
+  case 1:
+  case 2:
+  case 3:
+    len = (r >> 8) % 24;
+    for (i = 0; i < len; i++) {
+      buf[i] = (char)((r >> (i % 7 * 8)) ^ (i * 151));
+    }
+    break;
+
+  default:
+    len = 200 + (r >> 8) % 5;
+    memset(buf, 'p', 200);
+    for (i = 200; i < len; i++) {
+      buf[i] = tail_chars[(r >> (i * 3 % 48)) % sizeof(tail_chars)];
+    }
+  }
+
+  return sdsnewlen(buf, len);
+}
+
+// Sizes on both sides of the switch from radix sort to multikey
+// quicksort, checked against qsort() with sdscmp().
+TEST sort_sds(void) {
+  static const int sizes[] = {0, 1, 2, 7, 8, 9, 63, 64, 65, 1000, 20000};
+  struct nc_array *arr;
+  sds *ref, *a;
+  uint64_t x = 88172645463325252ULL;
+  int k, i, n;
+
+  for (k = 0; k < (int)NELEMS(sizes); k++) {
+    n = sizes[k];
+    arr = nc_array_create(n > 0 ? n : 1, sizeof(sds));
+    ref = malloc((size_t)(n > 0 ? n : 1) * sizeof(sds));
+    ASSERT(arr != NULL && ref != NULL);
+
+    for (i = 0; i < n; i++) {
+      a = nc_array_push(arr);
+      *a = t_sds_rand(&x);
+      ref[i] = *a;
+    }
+
+    qsort(ref, (size_t)n, sizeof(sds), t_sds_cmp);
+    nc_array_sort_sds(arr);
+
+    a = arr->elems;
+    for (i = 0; i < n; i++) {
+      ASSERT_EQ(sdslen(ref[i]), sdslen(a[i]));
+      ASSERT_EQ(0, memcmp(ref[i], a[i], sdslen(a[i])));
+    }
+
+    for (i = 0; i < n; i++) {
+      sdsfree(a[i]);
+    }
+    free(ref);
+    nc_array_destroy(arr);
+  }
+
+  PASS();
+}
+
+static enum greatest_test_res t_scan_check(void) {
+  struct nc_array *a32, *a64;
+  int32_t *p32, v32;
+  int64_t *p64, v64;
+  uint32_t u32;
+  uint64_t u64;
+  int64_t sum;
+  int i;
+
+  a32 = nc_array_create(16, sizeof(int32_t));
+  a64 = nc_array_create(16, sizeof(int64_t));
+  for (i = 0, sum = 0; i < 1003; i++) {
+    p32 = (int32_t *)nc_array_push(a32);
+    p64 = (int64_t *)nc_array_push(a64);
+    *p32 = (i % 7 == 3) ? -i : i;
+    *p64 = (int64_t)*p32 * 100000;
+    sum += *p32;
+  }
+
+  ASSERT_EQ(501, nc_array_find_i32(a32, 501));
+  ASSERT_EQ(-1, nc_array_find_i32(a32, 3));
+  ASSERT_EQ(1001, nc_array_find_i64(a64, 100100000));
+  ASSERT_EQ(1, nc_array_count_i32(a32, 1));
+  ASSERT_EQ(0, nc_array_count_u64(a64, 3));
+
+  ASSERT_EQ(997, nc_array_min_i32(a32, &v32));
+  ASSERT_EQ(-997, v32);
+  ASSERT_EQ(1002, nc_array_max_i32(a32, &v32));
+  ASSERT_EQ(1002, v32);
+  ASSERT_EQ(997, nc_array_min_i64(a64, &v64));
+  ASSERT_EQ(-99700000, v64);
+
+  // negative values are the largest ones as unsigned
+  ASSERT_EQ(0, nc_array_min_u32(a32, &u32));
+  ASSERT_EQ(0, u32);
+  ASSERT_EQ(3, nc_array_max_u32(a32, &u32));
+  ASSERT_EQ((uint32_t)-3, u32);
+  ASSERT_EQ(3, nc_array_max_u64(a64, &u64));
+
+  ASSERT_EQ(sum, nc_array_sum_i32(a32));
+  ASSERT_EQ(sum * 100000, nc_array_sum_i64(a64));
+  ASSERT_EQ((uint64_t)(sum + 143 * 4294967296LL), nc_array_sum_u32(a32));
+
+  ASSERT(nc_array_all_lt_i32(a32, 1003));
+  ASSERT_FALSE(nc_array_all_lt_i32(a32, 1002));
+  ASSERT_FALSE(nc_array_all_lt_u32(a32, 1003));
+  ASSERT(nc_array_all_lt_i64(a64, 100200001));
+  ASSERT_FALSE(nc_array_all_lt_u64(a64, 100200001));
+
+  // the 64-bit ordered compares of the SSE2 tier are the scalar ones
+  ASSERT_EQ(0, nc_array_min_u64(a64, &u64));
+  ASSERT_EQ(0, u64);
+  ASSERT_EQ(1002, nc_array_max_i64(a64, &v64));
+  ASSERT_EQ(100200000, v64);
+
+  nc_array_destroy(a32);
+  nc_array_destroy(a64);
+  PASS();
+}
+
+// Every kernel tier the cpu has, not just the best one
+TEST scan(void) {
+  static const unsigned tiers[] = {0, NC_CPU_SSE2, NC_CPU_SSE2 | NC_CPU_AVX2};
+  int t;
+
+  for (t = 0; t < (int)NELEMS(tiers); t++) {
+    nc_scan_use_features(tiers[t]);
+    CHECK_CALL(t_scan_check());
+  }
+  nc_scan_use_features(~0U);
+
+  PASS();
+}
+
 SUITE(array) {
   RUN_TEST(basic);
+  RUN_TEST(grow_large);
+  RUN_TEST(pool);
+  RUN_TEST(save_map);
+  RUN_TEST(sort);
+  RUN_TEST(radix_sort);
+  RUN_TEST(parallel_sort);
+  RUN_TEST(parallel_sort_split);
+  RUN_TEST(sort_sds);
+  RUN_TEST(scan);
 }
@@ -0,0 +1,384 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "nc_bitmap.h"
+#include "greatest.h"
+
+// Every bitmap is checked against a plain bitset over the values of the
+// first T_KEYS containers.
+#define T_KEYS 4
+#define T_BITS (T_KEYS * 65536)
+#define T_WORDS (T_BITS / 64)
+
+#define T_OP_AND 0
+#define T_OP_OR 1
+#define T_OP_XOR 2
+#define T_OP_ANDNOT 3
+
+struct t_iter {
+  const uint64_t *ref;
+  int64_t prev;
+  uint64_t count;
+  int ok;
+};
+
+static uint64_t t_rand(uint64_t *x) {
+  *x ^= *x << 13;
+  *x ^= *x >> 7;
+  *x ^= *x << 17;
+  return *x;
+}
+
+static int t_ref_test(const uint64_t *ref, uint32_t v) {
+  return (int)((ref[v >> 6] >> (v & 63)) & 1);
+}
+
+static int t_set(struct nc_bitmap *b, uint64_t *ref, uint32_t v) {
+  ref[v >> 6] |= (uint64_t)1 << (v & 63);
+  return nc_bitmap_set(b, v);
+}
+
+static int t_clear(struct nc_bitmap *b, uint64_t *ref, uint32_t v) {
+  ref[v >> 6] &= ~((uint64_t)1 << (v & 63));
+  return nc_bitmap_clear(b, v);
+}
+
+static int t_iter_fn(uint32_t value, void *ctx) {
+  struct t_iter *it = ctx;
+
+  if ((int64_t)value <= it->prev || value >= T_BITS ||
+      !t_ref_test(it->ref, value))
+    it->ok = 0;
+  it->prev = value;
+  it->count++;
+  return 0;
+}
+
+static int t_stop_fn(uint32_t value, void *ctx) {
+  uint64_t *left = ctx;
+
+  (void)value;
+  return --*left == 0 ? 7 : 0;
+}
+
+// Returns the type of the container for key, 0 if there is none
+static int t_type(const struct nc_bitmap *b, uint16_t key) {
+  const struct nc_bitmap_container *c = b->containers.elems;
+  int i;
+
+  for (i = 0; i < b->containers.nelem; i++) {
+    if (c[i].key == key)
+      return c[i].type;
+  }
+  return 0;
+}
+
+static enum greatest_test_res t_check(const struct nc_bitmap *b,
+                                      const uint64_t *ref) {
+  const struct nc_bitmap_container *c = b->containers.elems;
+  struct t_iter it;
+  uint64_t card = 0;
+  uint32_t v;
+  int i;
+
+  for (i = 0; i < T_WORDS; i++) {
+    card += (uint64_t)__builtin_popcountll(ref[i]);
+  }
+  ASSERT_EQ(card, nc_bitmap_cardinality(b));
+
+  // Containers are sorted, non-empty and within the reference's range
+  for (i = 0; i < b->containers.nelem; i++) {
+    ASSERT(c[i].card > 0);
+    ASSERT(c[i].key < T_KEYS);
+    ASSERT(i == 0 || c[i - 1].key < c[i].key);
+  }
+
+  for (v = 0; v < T_BITS; v++) {
+    if (nc_bitmap_test(b, v) != t_ref_test(ref, v))
+      FAILm("test() disagrees with the reference");
+  }
+  ASSERT_EQ(0, nc_bitmap_test(b, T_BITS));
+  ASSERT_EQ(0, nc_bitmap_test(b, UINT32_MAX));
+
+  it.ref = ref;
+  it.prev = -1;
+  it.count = 0;
+  it.ok = 1;
+  ASSERT_EQ(0, nc_bitmap_iterate(b, t_iter_fn, &it));
+  ASSERT(it.ok);
+  ASSERT_EQ(card, it.count);
+
+  PASS();
+}
+
+// Fills the container for key so that it ends up with the given type once
+// the bitmap is optimized.
+static int t_fill(struct nc_bitmap *b, uint64_t *ref, uint16_t key, int type,
+                  uint64_t *x) {
+  uint32_t high = (uint32_t)key << 16, start, len, v;
+  int i, status = NC_OK;
+
+  switch (type) {
+  case NC_BITMAP_ARRAY:
+    // Sparse, a run encoding would be larger
+    for (i = 0; i < 3000; i++) {
+      status |= t_set(b, ref, high | (uint32_t)(t_rand(x) & 0xffff));
+    }
+    break;
+
+  case NC_BITMAP_BITSET:
+    for (i = 0; i < 10000; i++) {
+      status |= t_set(b, ref, high | (uint32_t)(t_rand(x) & 0xffff));
+    }
+    break;
+
+  default:
+    // A few long runs, one of them ending at the top of the container
+    for (i = 0; i < 20; i++) {
+      start = (uint32_t)(t_rand(x) & 0xffff);
+      len = (uint32_t)(t_rand(x) % 2000);
+      for (v = start; v <= start + len && v <= 0xffff; v++) {
+        status |= t_set(b, ref, high | v);
+      }
+    }
+    for (v = 65000; v <= 0xffff; v++) {
+      status |= t_set(b, ref, high | v);
+    }
+  }
+
+  return status;
+}
+
+static struct nc_bitmap *t_op(const struct nc_bitmap *a,
+                              const struct nc_bitmap *b, int op) {
+  switch (op) {
+  case T_OP_AND:
+    return nc_bitmap_and(a, b);
+  case T_OP_OR:
+    return nc_bitmap_or(a, b);
+  case T_OP_XOR:
+    return nc_bitmap_xor(a, b);
+  default:
+    return nc_bitmap_andnot(a, b);
+  }
+}
+
+static void t_ref_op(uint64_t *dst, const uint64_t *a, const uint64_t *b,
+                     int op) {
+  int i;
+
+  for (i = 0; i < T_WORDS; i++) {
+    switch (op) {
+    case T_OP_AND:
+      dst[i] = a[i] & b[i];
+      break;
+    case T_OP_OR:
+      dst[i] = a[i] | b[i];
+      break;
+    case T_OP_XOR:
+      dst[i] = a[i] ^ b[i];
+      break;
+    default:
+      dst[i] = a[i] & ~b[i];
+    }
+  }
+}
+
+static uint64_t t_ref_a[T_WORDS], t_ref_b[T_WORDS], t_ref_r[T_WORDS];
+
+TEST set_clear_threshold(void) {
+  struct nc_bitmap *b;
+  uint64_t x = 88172645463325252ULL;
+  uint32_t v, high = 1 << 16;
+  int i;
+
+  memset(t_ref_a, 0, sizeof(t_ref_a));
+  b = nc_bitmap_create();
+  ASSERT(b != NULL);
+  CHECK_CALL(t_check(b, t_ref_a));
+
+  // Clearing what isn't there is fine
+  ASSERT_EQ(NC_OK, t_clear(b, t_ref_a, 5));
+
+  // Up to the switch point, an array
+  for (v = 0; v < NC_BITMAP_ARRAY_MAX; v++) {
+    ASSERT_EQ(NC_OK, t_set(b, t_ref_a, high | (v * 13 % 65536)));
+  }
+  ASSERT_EQ(NC_OK, t_set(b, t_ref_a, high | 13));
+  ASSERT_EQ(NC_BITMAP_ARRAY, t_type(b, 1));
+  ASSERT_EQ(NC_BITMAP_ARRAY_MAX, nc_bitmap_cardinality(b));
+
+  // One more value makes it a bitset
+  ASSERT_EQ(NC_OK, t_set(b, t_ref_a, high | 1));
+  ASSERT_EQ(NC_BITMAP_BITSET, t_type(b, 1));
+  CHECK_CALL(t_check(b, t_ref_a));
+
+  // It stays a bitset down to half the switch point, then turns back
+  for (v = 0; v < NC_BITMAP_ARRAY_MAX / 2; v++) {
+    ASSERT_EQ(NC_OK, t_clear(b, t_ref_a, high | (v * 13 % 65536)));
+  }
+  ASSERT_EQ(NC_BITMAP_BITSET, t_type(b, 1));
+  ASSERT_EQ(NC_OK, t_clear(b, t_ref_a, high | 1));
+  ASSERT_EQ(NC_BITMAP_ARRAY, t_type(b, 1));
+  CHECK_CALL(t_check(b, t_ref_a));
+
+  // Random churn over all containers, including the extremes
+  for (i = 0; i < 200000; i++) {
+    v = (uint32_t)(t_rand(&x) % T_BITS);
+    if (t_rand(&x) % 3 == 0)
+      ASSERT_EQ(NC_OK, t_clear(b, t_ref_a, v));
+    else
+      ASSERT_EQ(NC_OK, t_set(b, t_ref_a, v));
+  }
+  ASSERT_EQ(NC_OK, t_set(b, t_ref_a, 0));
+  ASSERT_EQ(NC_OK, t_set(b, t_ref_a, T_BITS - 1));
+  CHECK_CALL(t_check(b, t_ref_a));
+
+  // Emptying a container drops it
+  for (v = 0; v < 65536; v++) {
+    ASSERT_EQ(NC_OK, t_clear(b, t_ref_a, (2 << 16) | v));
+  }
+  ASSERT_EQ(0, t_type(b, 2));
+  CHECK_CALL(t_check(b, t_ref_a));
+
+  nc_bitmap_destroy(b);
+  PASS();
+}
+
+TEST optimize_runs(void) {
+  struct nc_bitmap *b;
+  uint64_t x = 88172645463325252ULL, left;
+  uint32_t v;
+  int i;
+
+  memset(t_ref_a, 0, sizeof(t_ref_a));
+  b = nc_bitmap_create();
+  ASSERT(b != NULL);
+
+  ASSERT_EQ(NC_OK, t_fill(b, t_ref_a, 0, NC_BITMAP_ARRAY, &x));
+  ASSERT_EQ(NC_OK, t_fill(b, t_ref_a, 1, NC_BITMAP_BITSET, &x));
+  ASSERT_EQ(NC_OK, t_fill(b, t_ref_a, 2, NC_BITMAP_RUN, &x));
+  // A short run in an array container, also smaller as runs
+  for (v = 100; v < 200; v++) {
+    ASSERT_EQ(NC_OK, t_set(b, t_ref_a, (3 << 16) | v));
+  }
+  ASSERT_EQ(NC_BITMAP_BITSET, t_type(b, 2));
+  ASSERT_EQ(NC_BITMAP_ARRAY, t_type(b, 3));
+
+  ASSERT_EQ(NC_OK, nc_bitmap_optimize(b));
+  ASSERT_EQ(NC_BITMAP_ARRAY, t_type(b, 0));
+  ASSERT_EQ(NC_BITMAP_BITSET, t_type(b, 1));
+  ASSERT_EQ(NC_BITMAP_RUN, t_type(b, 2));
+  ASSERT_EQ(NC_BITMAP_RUN, t_type(b, 3));
+  CHECK_CALL(t_check(b, t_ref_a));
+
+  // Optimizing twice changes nothing
+  ASSERT_EQ(NC_OK, nc_bitmap_optimize(b));
+  CHECK_CALL(t_check(b, t_ref_a));
+
+  // Iteration stops where the callback says so
+  left = 150;
+  ASSERT_EQ(7, nc_bitmap_iterate(b, t_stop_fn, &left));
+  ASSERT_EQ(0, left);
+
+  // Writes into run containers, inside, between and next to the runs
+  for (i = 0; i < 20000; i++) {
+    v = (uint32_t)((2 + t_rand(&x) % 2) << 16 | (t_rand(&x) & 0xffff));
+    if (i % 2)
+      ASSERT_EQ(NC_OK, t_clear(b, t_ref_a, v));
+    else
+      ASSERT_EQ(NC_OK, t_set(b, t_ref_a, v));
+  }
+  ASSERT_EQ(NC_OK, t_set(b, t_ref_a, (3 << 16) | 99));
+  ASSERT_EQ(NC_OK, t_clear(b, t_ref_a, (3 << 16) | 150));
+  CHECK_CALL(t_check(b, t_ref_a));
+
+  nc_bitmap_destroy(b);
+  PASS();
+}
+
+// Every operation for every pair of container types, with containers
+// that only one side has on both sides
+TEST ops_all_types(void) {
+  static const int types[] = {NC_BITMAP_ARRAY, NC_BITMAP_BITSET,
+                              NC_BITMAP_RUN};
+  struct nc_bitmap *a, *b, *r, *empty;
+  uint64_t x = 88172645463325252ULL;
+  int ta, tb, op;
+
+  empty = nc_bitmap_create();
+  ASSERT(empty != NULL);
+
+  for (ta = 0; ta < 3; ta++) {
+    for (tb = 0; tb < 3; tb++) {
+      memset(t_ref_a, 0, sizeof(t_ref_a));
+      memset(t_ref_b, 0, sizeof(t_ref_b));
+      a = nc_bitmap_create();
+      b = nc_bitmap_create();
+      ASSERT(a != NULL && b != NULL);
+
+      ASSERT_EQ(NC_OK, t_fill(a, t_ref_a, 0, types[ta], &x));
+      ASSERT_EQ(NC_OK, t_fill(a, t_ref_a, 1, types[tb], &x));
+      ASSERT_EQ(NC_OK, t_fill(a, t_ref_a, 2, types[ta], &x));
+      ASSERT_EQ(NC_OK, t_fill(b, t_ref_b, 0, types[tb], &x));
+      ASSERT_EQ(NC_OK, t_fill(b, t_ref_b, 1, types[ta], &x));
+      ASSERT_EQ(NC_OK, t_fill(b, t_ref_b, 3, types[tb], &x));
+      ASSERT_EQ(NC_OK, nc_bitmap_optimize(a));
+      ASSERT_EQ(NC_OK, nc_bitmap_optimize(b));
+      ASSERT_EQ(types[ta], t_type(a, 0));
+      ASSERT_EQ(types[tb], t_type(b, 0));
+
+      for (op = T_OP_AND; op <= T_OP_ANDNOT; op++) {
+        r = t_op(a, b, op);
+        ASSERT(r != NULL);
+        t_ref_op(t_ref_r, t_ref_a, t_ref_b, op);
+        CHECK_CALL(t_check(r, t_ref_r));
+        nc_bitmap_destroy(r);
+
+        r = t_op(b, a, op);
+        ASSERT(r != NULL);
+        t_ref_op(t_ref_r, t_ref_b, t_ref_a, op);
+        CHECK_CALL(t_check(r, t_ref_r));
+
+        // Results are ordinary bitmaps that can be written to
+        ASSERT_EQ(NC_OK, t_set(r, t_ref_r, 12345));
+        ASSERT_EQ(NC_OK, t_clear(r, t_ref_r, (1 << 16) | 7));
+        CHECK_CALL(t_check(r, t_ref_r));
+        nc_bitmap_destroy(r);
+      }
+
+      // Against itself and against an empty bitmap
+      r = nc_bitmap_and(a, a);
+      ASSERT(r != NULL);
+      CHECK_CALL(t_check(r, t_ref_a));
+      nc_bitmap_destroy(r);
+
+      r = nc_bitmap_xor(a, a);
+      ASSERT(r != NULL);
+      ASSERT_EQ(0, nc_bitmap_cardinality(r));
+      nc_bitmap_destroy(r);
+
+      r = nc_bitmap_or(empty, a);
+      ASSERT(r != NULL);
+      CHECK_CALL(t_check(r, t_ref_a));
+      nc_bitmap_destroy(r);
+
+      r = nc_bitmap_andnot(a, empty);
+      ASSERT(r != NULL);
+      CHECK_CALL(t_check(r, t_ref_a));
+      nc_bitmap_destroy(r);
+
+      nc_bitmap_destroy(a);
+      nc_bitmap_destroy(b);
+    }
+  }
+
+  nc_bitmap_destroy(empty);
+  PASS();
+}
+
+SUITE(bitmap) {
+  RUN_TEST(set_clear_threshold);
+  RUN_TEST(optimize_runs);
+  RUN_TEST(ops_all_types);
+}
@@ -0,0 +1,298 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nc_codec.h"
+#include "greatest.h"
+
+struct t_codec {
+  int codec;
+  size_t width;
+};
+
+static const struct t_codec t_codecs[] = {
+    {NC_CODEC_VARINT, 4},
+    {NC_CODEC_VARINT, 8},
+    {NC_CODEC_VARINT | NC_CODEC_DELTA, 4},
+    {NC_CODEC_VARINT | NC_CODEC_DELTA, 8},
+    {NC_CODEC_FOR, 4},
+    {NC_CODEC_FOR, 8},
+    {NC_CODEC_FOR | NC_CODEC_DELTA, 4},
+    {NC_CODEC_FOR | NC_CODEC_DELTA, 8},
+    {NC_CODEC_STREAMVBYTE, 4},
+    {NC_CODEC_STREAMVBYTE | NC_CODEC_DELTA, 4},
+};
+
+static uint64_t t_rand(uint64_t *x) {
+  *x ^= *x << 13;
+  *x ^= *x >> 7;
+  *x ^= *x << 17;
+  return *x;
+}
+
+static struct nc_array *t_array(size_t width, int n) {
+  struct nc_array *a;
+
+  a = nc_array_create(n > 0 ? n : 1, width);
+  if (a != NULL && n > 0 && nc_array_push_n(a, n) == NULL) {
+    nc_array_destroy(a);
+    return NULL;
+  }
+  return a;
+}
+
+static void t_put(struct nc_array *a, int i, uint64_t v) {
+  if (a->size == 4)
+    ((uint32_t *)a->elems)[i] = (uint32_t)v;
+  else
+    ((uint64_t *)a->elems)[i] = v;
+}
+
+// Decodes from an exact copy of the first len bytes, so reading past them
+// is caught by the sanitizers
+static struct nc_array *t_decode(const void *buf, size_t len, size_t *used) {
+  struct nc_array *a;
+  void *copy;
+
+  copy = malloc(len > 0 ? len : 1);
+  if (copy == NULL)
+    return NULL;
+  memcpy(copy, buf, len);
+  a = nc_array_decode(copy, len, used);
+  free(copy);
+  return a;
+}
+
+static enum greatest_test_res t_roundtrip(const struct nc_array *a,
+                                          int codec) {
+  struct nc_array *b;
+  sds s;
+  size_t used, len;
+
+  // After some unrelated bytes, followed by more
+  s = sdsnewlen("head", 4);
+  ASSERT(s != NULL);
+  ASSERT_EQ(NC_OK, nc_array_encode(a, codec, &s));
+  len = sdslen(s) - 4;
+  s = sdscatlen(s, "tail", 4);
+  ASSERT(s != NULL);
+
+  b = t_decode(s + 4, len + 4, &used);
+  ASSERT(b != NULL);
+  ASSERT_EQ(len, used);
+  ASSERT_EQ(a->size, b->size);
+  ASSERT_EQ(a->nelem, b->nelem);
+  ASSERT_MEM_EQ(a->elems, b->elems, (size_t)a->nelem * a->size);
+  nc_array_destroy(b);
+
+  // Truncations fail cleanly: all of them near both ends, a sample of
+  // the middle of long encodings
+  for (used = 0; used < len;
+       used += used >= 256 && used + 256 < len ? 97 : 1) {
+    b = t_decode(s + 4, used, NULL);
+    if (b != NULL) {
+      nc_array_destroy(b);
+      sdsfree(s);
+      FAILm("decoded a truncated encoding");
+    }
+  }
+
+  sdsfree(s);
+  PASS();
+}
+
+// The values where varint lengths change and the largest of each width,
+// alone, repeated, and alternating so deltas span the whole range
+TEST roundtrip_edges(void) {
+  static const uint64_t edges[] = {0, 127, 128, UINT32_MAX, UINT64_MAX};
+  struct nc_array *a;
+  const struct t_codec *c;
+  int k, e, i, n, nedges;
+
+  for (k = 0; k < (int)NELEMS(t_codecs); k++) {
+    c = &t_codecs[k];
+    nedges = c->width == 4 ? 4 : 5;
+
+    for (e = 0; e < nedges; e++) {
+      a = t_array(c->width, 1);
+      ASSERT(a != NULL);
+      t_put(a, 0, edges[e]);
+      CHECK_CALL(t_roundtrip(a, c->codec));
+      nc_array_destroy(a);
+
+      a = t_array(c->width, 300);
+      ASSERT(a != NULL);
+      for (i = 0; i < 300; i++) {
+        t_put(a, i, edges[e]);
+      }
+      CHECK_CALL(t_roundtrip(a, c->codec));
+      nc_array_destroy(a);
+    }
+
+    n = 1000;
+    a = t_array(c->width, n);
+    ASSERT(a != NULL);
+    for (i = 0; i < n; i++) {
+      t_put(a, i, i % 2 ? edges[nedges - 1] : edges[(i / 2) % nedges]);
+    }
+    CHECK_CALL(t_roundtrip(a, c->codec));
+    nc_array_destroy(a);
+  }
+
+  PASS();
+}
+
+// Counts around the Stream VByte groups of 4 and its 16 byte loads and
+// around the frame of reference blocks, with values of every byte length
+TEST roundtrip_lengths(void) {
+  static const int sizes[] = {0,  1,  2,   3,   4,   5,   7,   8,   15,
+                              16, 17, 31,  33,  127, 128, 129, 255, 256,
+                              257, 1000, 4099};
+  struct nc_array *a;
+  const struct t_codec *c;
+  uint64_t x = 88172645463325252ULL, v, sum;
+  int k, s, i, n;
+
+  for (k = 0; k < (int)NELEMS(t_codecs); k++) {
+    c = &t_codecs[k];
+
+    for (s = 0; s < (int)NELEMS(sizes); s++) {
+      n = sizes[s];
+      a = t_array(c->width, n);
+      ASSERT(a != NULL);
+
+      // Random widths, then a sorted run for the delta codecs
+      for (i = 0; i < n; i++) {
+        v = t_rand(&x);
+        t_put(a, i, v >> (v % (c->width * 8)));
+      }
+      CHECK_CALL(t_roundtrip(a, c->codec));
+
+      for (i = 0, sum = 0; i < n; i++) {
+        sum += t_rand(&x) % 300;
+        t_put(a, i, sum);
+      }
+      CHECK_CALL(t_roundtrip(a, c->codec));
+
+      nc_array_destroy(a);
+    }
+  }
+
+  PASS();
+}
+
+TEST malformed(void) {
+  // codec, width, count, payload
+  static const struct {
+    const char *buf;
+    size_t len;
+  } bad[] = {
+      {"", 0},
+      {"\x01", 1},
+      {"\x00\x04\x01\x05", 4},             /* no codec */
+      {"\x04\x04\x01\x05", 4},             /* unknown codec */
+      {"\x21\x04\x01\x05", 4},             /* unknown flag */
+      {"\x01\x03\x01\x05", 4},             /* element size */
+      {"\x01\x10\x01\x05", 4},             /* element size */
+      {"\x03\x08\x01\x00\x05", 5},         /* streamvbyte of uint64_t */
+      {"\x01\x04\x80\x80\x80\x80\x08", 7}, /* count past INT_MAX */
+      {"\x01\x04\x05\x01\x02", 5},         /* count past the input */
+      {"\x01\x04\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 13},
+      {"\x01\x04\x01\x80\x80\x80\x80\x10", 8}, /* value past UINT32_MAX */
+      {"\x01\x08\x01\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 14},
+      {"\x02\x04\x01\x00\x41\x00", 6},         /* bit width 65 */
+      {"\x02\x04\x01\xff\xff\xff\xff\x0f\x01\x01", 10}, /* past UINT32_MAX */
+      {"\x02\x04\x02\x00\x08\x01", 6},         /* packed bits cut short */
+      {"\x03\x04\x05\xff\x01\x01\x01\x01", 8}, /* data bytes cut short */
+  };
+  struct nc_array *a;
+  int i;
+
+  for (i = 0; i < (int)NELEMS(bad); i++) {
+    a = t_decode(bad[i].buf, bad[i].len, NULL);
+    if (a != NULL) {
+      nc_array_destroy(a);
+      FAILm("decoded a malformed encoding");
+    }
+  }
+
+  // The shortest valid encodings, for contrast
+  a = t_decode("\x01\x04\x00", 3, NULL);
+  ASSERT(a != NULL);
+  ASSERT_EQ(0, a->nelem);
+  nc_array_destroy(a);
+  a = t_decode("\x02\x08\x01\x07\x00", 5, NULL);
+  ASSERT(a != NULL);
+  ASSERT_EQ(7, ((uint64_t *)a->elems)[0]);
+  nc_array_destroy(a);
+
+  PASS();
+}
+
+// Random damage to valid encodings must never read out of bounds
+TEST corrupted(void) {
+  struct nc_array *a, *b;
+  const struct t_codec *c;
+  uint64_t x = 88172645463325252ULL;
+  size_t len, used;
+  sds s;
+  int k, i, round;
+
+  for (k = 0; k < (int)NELEMS(t_codecs); k++) {
+    c = &t_codecs[k];
+    a = t_array(c->width, 200);
+    ASSERT(a != NULL);
+    for (i = 0; i < 200; i++) {
+      t_put(a, i, t_rand(&x) >> (t_rand(&x) % 64));
+    }
+    s = sdsempty();
+    ASSERT_EQ(NC_OK, nc_array_encode(a, c->codec, &s));
+    len = sdslen(s);
+
+    for (round = 0; round < 500; round++) {
+      for (i = 0; i < 3; i++) {
+        s[t_rand(&x) % len] ^= (char)(1 << (t_rand(&x) % 8));
+      }
+      b = t_decode(s, len, &used);
+      if (b != NULL) {
+        ASSERT(used <= len);
+        nc_array_destroy(b);
+      }
+    }
+
+    sdsfree(s);
+    nc_array_destroy(a);
+  }
+
+  PASS();
+}
+
+TEST encode_errors(void) {
+  struct nc_array *a;
+  sds s;
+
+  s = sdsempty();
+  a = t_array(8, 4);
+  ASSERT(a != NULL);
+  ASSERT_EQ(NC_ERROR, nc_array_encode(a, NC_CODEC_STREAMVBYTE, &s));
+  ASSERT_EQ(NC_ERROR, nc_array_encode(a, 0x04, &s));
+  ASSERT_EQ(NC_ERROR, nc_array_encode(a, NC_CODEC_VARINT | 0x20, &s));
+  nc_array_destroy(a);
+
+  a = t_array(2, 4);
+  ASSERT(a != NULL);
+  ASSERT_EQ(NC_ERROR, nc_array_encode(a, NC_CODEC_VARINT, &s));
+  nc_array_destroy(a);
+
+  ASSERT_EQ(0, sdslen(s));
+  sdsfree(s);
+  PASS();
+}
+
+SUITE(codec) {
+  RUN_TEST(roundtrip_edges);
+  RUN_TEST(roundtrip_lengths);
+  RUN_TEST(malformed);
+  RUN_TEST(corrupted);
+  RUN_TEST(encode_errors);
+}
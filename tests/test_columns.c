@@ -0,0 +1,129 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nc_columns.h"
+#include "greatest.h"
+
+struct t_row {
+  uint64_t id;
+  uint8_t flag;
+  double score;
+};
+
+static const size_t t_sizes[] = {sizeof(uint64_t), sizeof(uint8_t),
+                                 sizeof(double)};
+static const size_t t_offsets[] = {offsetof(struct t_row, id),
+                                   offsetof(struct t_row, flag),
+                                   offsetof(struct t_row, score)};
+
+static int t_check_rows(struct nc_columns *c, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if (NC_COLUMNS_COL(c, 0, uint64_t)[i] != (uint64_t)i * 7 ||
+        NC_COLUMNS_COL(c, 1, uint8_t)[i] != (uint8_t)i ||
+        NC_COLUMNS_COL(c, 2, double)[i] != i * 0.5)
+      return 0;
+  }
+  return 1;
+}
+
+TEST push_get_set(void) {
+  struct nc_columns *c;
+  struct t_row row;
+  uint64_t id;
+  uint8_t flag;
+  double score;
+  const void *fields[3] = {&id, &flag, &score};
+  int i, n = 1000;
+
+  c = nc_columns_create(3, t_sizes, 2);
+  ASSERT(c != NULL);
+  ASSERT_EQ(3, c->ncols);
+  ASSERT_EQ(0, c->nrows);
+
+  // Three ways in, starting from room for 2 rows
+  for (i = 0; i < n; i++) {
+    id = (uint64_t)i * 7;
+    flag = (uint8_t)i;
+    score = i * 0.5;
+    if (i % 3 == 0) {
+      ASSERT_EQ(NC_OK, nc_columns_append(c, fields));
+    } else if (i % 3 == 1) {
+      row.id = id;
+      row.flag = flag;
+      row.score = score;
+      ASSERT_EQ(NC_OK, nc_columns_append_struct(c, &row, t_offsets));
+    } else {
+      ASSERT_EQ(NC_OK, nc_columns_push(c));
+      *(uint64_t *)nc_columns_at(c, 0, i) = id;
+      *(uint8_t *)nc_columns_at(c, 1, i) = flag;
+      *(double *)nc_columns_at(c, 2, i) = score;
+    }
+  }
+
+  ASSERT_EQ(n, c->nrows);
+  for (i = 0; i < 3; i++) {
+    ASSERT_EQ(n, c->cols[i].nelem);
+    ASSERT(c->cols[i].nalloc >= n);
+  }
+  ASSERT(t_check_rows(c, n));
+
+  *(double *)nc_columns_at(c, 2, 10) = -1.0;
+  ASSERT_EQ(-1.0, NC_COLUMNS_COL(c, 2, double)[10]);
+  ASSERT_EQ(70, NC_COLUMNS_COL(c, 0, uint64_t)[10]);
+
+  // reserve() adds room, not rows
+  ASSERT_EQ(NC_OK, nc_columns_reserve(c, 5000));
+  ASSERT_EQ(n, c->nrows);
+  for (i = 0; i < 3; i++) {
+    ASSERT(c->cols[i].nalloc >= n + 5000);
+  }
+
+  nc_columns_destroy(c);
+  PASS();
+}
+
+// A column that can't grow (a read-only mapping refuses to) fails the push
+// after the columns before it grew: no row is added and the data stays.
+TEST grow_fails(void) {
+  struct nc_columns *c;
+  int i, nalloc0, nalloc1;
+
+  c = nc_columns_create(3, t_sizes, 4);
+  ASSERT(c != NULL);
+
+  for (i = 0; i < 4; i++) {
+    ASSERT_EQ(NC_OK, nc_columns_push(c));
+    NC_COLUMNS_COL(c, 0, uint64_t)[i] = (uint64_t)i * 7;
+    NC_COLUMNS_COL(c, 1, uint8_t)[i] = (uint8_t)i;
+    NC_COLUMNS_COL(c, 2, double)[i] = i * 0.5;
+  }
+  nalloc0 = c->cols[0].nalloc;
+  nalloc1 = c->cols[1].nalloc;
+
+  c->cols[1].flags |= NC_ARRAY_MAPFILE;
+  ASSERT(nc_columns_push(c) != NC_OK);
+  c->cols[1].flags &= ~NC_ARRAY_MAPFILE;
+
+  ASSERT_EQ(4, c->nrows);
+  for (i = 0; i < 3; i++) {
+    ASSERT_EQ(4, c->cols[i].nelem);
+  }
+  ASSERT(c->cols[0].nalloc > nalloc0);
+  ASSERT_EQ(nalloc1, c->cols[1].nalloc);
+  ASSERT(t_check_rows(c, 4));
+
+  // And the table keeps working
+  ASSERT_EQ(NC_OK, nc_columns_push(c));
+  ASSERT_EQ(5, c->nrows);
+  ASSERT(t_check_rows(c, 4));
+
+  nc_columns_destroy(c);
+  PASS();
+}
+
+SUITE(columns) {
+  RUN_TEST(push_get_set);
+  RUN_TEST(grow_fails);
+}
@@ -0,0 +1,691 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "nc_epoch.h"
+#include "nc_hash.h"
+#include "nc_hashmap.h"
+#include "nc_hashtable.h"
+#include "nc_sds.h"
+#include "greatest.h"
+
+static size_t t_int_hash(const void *key) {
+  return (size_t)(uintptr_t)key;
+}
+
+static int t_int_cmp(const void *a, const void *b) {
+  return a == b;
+}
+
+static int t_freed;
+
+static void t_free_value(void *value) {
+  (void)value;
+  t_freed++;
+}
+
+#define t_key(i) ((void *)(uintptr_t)((i) + 1))
+#define t_val(i) ((void *)(uintptr_t)((i) * 3 + 1))
+
+// Deletes the pairs of even i while iterating, each right after stepping
+// past it; every pair must still be visited exactly once
+static enum greatest_test_res t_del_iterating(struct nc_hashtable *ht) {
+  void *it, *next, *key;
+  size_t size = ht->size, visited = 0, deleted = 0;
+
+  for (it = nc_hashtable_iter(ht); it; it = next) {
+    next = nc_hashtable_iter_next(ht, it);
+    key = nc_hashtable_iter_key(it);
+    visited++;
+    if (((uintptr_t)key - 1) % 2 == 0) {
+      ASSERT_EQ(0, nc_hashtable_del(ht, key));
+      deleted++;
+    }
+  }
+  ASSERT_EQ(size, visited);
+  ASSERT_EQ(size - deleted, ht->size);
+  PASS();
+}
+
+TEST basic(unsigned flags) {
+  struct nc_hashtable *ht;
+  uintptr_t sum;
+  void *it, *keys[300], *values[300];
+  int i, n = 20000;
+
+  ht = nc_hashtable_create_ex(t_int_hash, t_int_cmp, NULL, t_free_value,
+                              flags);
+  ASSERT(ht != NULL);
+
+  for (i = 0; i < n; i++) {
+    ASSERT_EQ(0, nc_hashtable_set(ht, t_key(i), t_val(i)));
+  }
+  ASSERT_EQ(n, ht->size);
+
+  // Replacing frees the old value
+  t_freed = 0;
+  ASSERT_EQ(0, nc_hashtable_set(ht, t_key(7), t_val(8)));
+  ASSERT_EQ(1, t_freed);
+  ASSERT_EQ(t_val(8), nc_hashtable_get(ht, t_key(7)));
+  ASSERT_EQ(0, nc_hashtable_set(ht, t_key(7), t_val(7)));
+
+  for (i = 0; i < n; i += 2) {
+    ASSERT_EQ(0, nc_hashtable_del(ht, t_key(i)));
+  }
+  ASSERT_EQ(-1, nc_hashtable_del(ht, t_key(0)));
+  ASSERT_EQ(n / 2, ht->size);
+
+  for (i = 0; i < n; i++) {
+    if (i % 2)
+      ASSERT_EQ(t_val(i), nc_hashtable_get(ht, t_key(i)));
+    else
+      ASSERT_EQ(NULL, nc_hashtable_get(ht, t_key(i)));
+  }
+
+  // Reinserting into the deleted slots
+  for (i = 0; i < n; i += 2) {
+    ASSERT_EQ(0, nc_hashtable_set(ht, t_key(i), t_val(i)));
+  }
+  ASSERT_EQ(n, ht->size);
+
+  sum = 0;
+  for (it = nc_hashtable_iter(ht); it; it = nc_hashtable_iter_next(ht, it)) {
+    ASSERT_EQ((uintptr_t)nc_hashtable_iter_value(it),
+              ((uintptr_t)nc_hashtable_iter_key(it) - 1) * 3 + 1);
+    sum += (uintptr_t)nc_hashtable_iter_key(it);
+  }
+  ASSERT_EQ((uintptr_t)n * (n + 1) / 2, sum);
+
+  // Batched lookups, a third of them misses
+  for (i = 0; i < 300; i++) {
+    keys[i] = t_key(i % 3 ? i : n + i);
+  }
+  ASSERT_EQ(200, nc_hashtable_get_many(ht, keys, 300, values));
+  for (i = 0; i < 300; i++) {
+    ASSERT_EQ(i % 3 ? t_val(i) : NULL, values[i]);
+  }
+
+  it = nc_hashtable_iter_at(ht, t_key(5));
+  ASSERT(it != NULL);
+  nc_hashtable_iter_set(ht, it, t_val(6));
+  ASSERT_EQ(t_val(6), nc_hashtable_get(ht, t_key(5)));
+  nc_hashtable_iter_set(ht, it, t_val(5));
+
+  t_freed = 0;
+  CHECK_CALL(t_del_iterating(ht));
+  ASSERT_EQ(n / 2, ht->size);
+  for (i = 0; i < n; i++) {
+    ASSERT_EQ(i % 2 ? t_val(i) : NULL, nc_hashtable_get(ht, t_key(i)));
+  }
+
+  nc_hashtable_clear(ht);
+  ASSERT_EQ(0, ht->size);
+  ASSERT_EQ(n, t_freed);
+  ASSERT_EQ(NULL, nc_hashtable_iter(ht));
+  ASSERT_EQ(NULL, nc_hashtable_get(ht, t_key(1)));
+
+  nc_hashtable_destroy(ht);
+  PASS();
+}
+
+// Inserting and deleting without growing leaves only tombstones behind;
+// the open table must clean them up instead of filling up.
+TEST churn(unsigned flags) {
+  struct nc_hashtable *ht;
+  int i;
+
+  ht = nc_hashtable_create_ex(t_int_hash, t_int_cmp, NULL, NULL, flags);
+  ASSERT(ht != NULL);
+
+  for (i = 0; i < 100000; i++) {
+    ASSERT_EQ(0, nc_hashtable_set(ht, t_key(i), t_val(i)));
+    if (i >= 10)
+      ASSERT_EQ(0, nc_hashtable_del(ht, t_key(i - 10)));
+  }
+  ASSERT_EQ(10, ht->size);
+  ASSERT(nc_hashtable_num_buckets(ht) < 1024);
+
+  for (i = 0; i < 100000; i++) {
+    ASSERT_EQ(i >= 99990 ? t_val(i) : NULL, nc_hashtable_get(ht, t_key(i)));
+  }
+
+  nc_hashtable_destroy(ht);
+  PASS();
+}
+
+static void t_count(void *key, void *value, void *ctx) {
+  (void)key;
+  (void)value;
+  (*(int *)ctx)++;
+}
+
+// Growing moves pairs a bucket at a time; they must stay reachable from
+// both bucket arrays until nc_hashtable_rehash_step() finishes the move.
+TEST rehash(unsigned flags) {
+  struct nc_hashtable *ht;
+  int i, n, count;
+
+  ht = nc_hashtable_create_ex(t_int_hash, t_int_cmp, NULL, NULL, flags);
+  ASSERT(ht != NULL);
+
+  for (n = 0; n < 20000 || ht->old_buckets == NULL; n++) {
+    ASSERT_EQ(0, nc_hashtable_set(ht, t_key(n), t_val(n)));
+  }
+  for (i = 0; i < 100; i++, n++) {
+    ASSERT_EQ(0, nc_hashtable_set(ht, t_key(n), t_val(n)));
+  }
+  ASSERT(ht->old_buckets != NULL);
+  ASSERT_EQ(0, nc_hashtable_del(ht, t_key(0)));
+
+  for (i = 1; i < n; i++) {
+    ASSERT_EQ(t_val(i), nc_hashtable_get(ht, t_key(i)));
+  }
+
+  count = 0;
+  nc_hashtable_foreach_buckets(ht, 0, nc_hashtable_num_buckets(ht), t_count,
+                               &count);
+  ASSERT_EQ(n - 1, count);
+
+  // Deleting does not move pairs, so it is safe while iterating
+  CHECK_CALL(t_del_iterating(ht));
+  ASSERT(ht->old_buckets != NULL);
+
+  while (nc_hashtable_rehash_step(ht, 1000)) {
+  }
+  ASSERT_EQ(NULL, ht->old_buckets);
+
+  for (i = 1; i < n; i++) {
+    ASSERT_EQ(i % 2 ? t_val(i) : NULL, nc_hashtable_get(ht, t_key(i)));
+  }
+
+  nc_hashtable_destroy(ht);
+  PASS();
+}
+
+TEST build(unsigned flags) {
+  struct nc_hashtable ht;
+  void *keys[3000], *values[3000];
+  size_t buckets;
+  int i;
+
+  ASSERT_EQ(0, nc_hashtable_init_capacity(&ht, t_int_hash, t_int_cmp, NULL,
+                                          t_free_value, flags, 1000));
+  buckets = nc_hashtable_num_buckets(&ht);
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(0, nc_hashtable_set(&ht, t_key(i), t_val(i)));
+  }
+  ASSERT_EQ(buckets, nc_hashtable_num_buckets(&ht));
+
+  // Keys 500..2999, then 500 of them again with new values
+  for (i = 0; i < 3000; i++) {
+    keys[i] = t_key(i < 2500 ? i + 500 : i - 2000);
+    values[i] = t_val(i < 2500 ? i + 500 : i);
+  }
+  t_freed = 0;
+  ASSERT_EQ(0, nc_hashtable_build(&ht, keys, values, 3000));
+  ASSERT_EQ(1000, t_freed);
+  ASSERT_EQ(3000, ht.size);
+
+  for (i = 0; i < 3000; i++) {
+    ASSERT_EQ(i >= 500 && i < 1000 ? t_val(i + 2000) : t_val(i),
+              nc_hashtable_get(&ht, t_key(i)));
+  }
+
+  for (i = 0; i < 3000; i += 3) {
+    ASSERT_EQ(0, nc_hashtable_del(&ht, t_key(i)));
+  }
+  ASSERT_EQ(2000, ht.size);
+
+  ASSERT_EQ(0, nc_hashtable_reserve(&ht, 100000));
+  buckets = nc_hashtable_num_buckets(&ht);
+  for (i = 1; i < 3000; i += 3) {
+    ASSERT(nc_hashtable_get(&ht, t_key(i)) != NULL);
+    ASSERT_EQ(NULL, nc_hashtable_get(&ht, t_key(i - 1)));
+  }
+  for (i = 3000; i < 100000; i++) {
+    ASSERT_EQ(0, nc_hashtable_set(&ht, t_key(i), t_val(i)));
+  }
+  ASSERT_EQ(buckets, nc_hashtable_num_buckets(&ht));
+
+  nc_hashtable_deinit(&ht);
+  PASS();
+}
+
+static void t_sdsfree(void *s) {
+  sdsfree(s);
+}
+
+TEST builtin_hashes(void) {
+  struct nc_hashtable *ht;
+  uint8_t key[16], msg[15];
+  int64_t a = 42, b = 42;
+  sds s;
+  int i;
+
+  // Reference vectors of wyhash (final 4) and SipHash-2-4
+  ASSERT_EQ(0xa97f2f7b1d9b3314ULL, nc_hash_bytes("abc", 3, 2));
+  ASSERT_EQ(0x6cc5eab49a92d617ULL,
+            nc_hash_bytes("1234567890123456789012345678901234567890"
+                          "1234567890123456789012345678901234567890",
+                          80, 6));
+  for (i = 0; i < 16; i++) {
+    key[i] = (uint8_t)i;
+  }
+  for (i = 0; i < 15; i++) {
+    msg[i] = (uint8_t)i;
+  }
+  ASSERT_EQ(0xa129ca6149be45e5ULL, nc_siphash(msg, 15, key));
+
+  ASSERT_EQ(nc_hash_int64p(&a), nc_hash_int64p(&b));
+  ASSERT(nc_hash_int64p_eq(&a, &b));
+  ASSERT_EQ(nc_hash_str("abc"), nc_hash_bytes("abc", 3, 0));
+
+  // sds keys may hold NULs; the hash and compare go by sdslen()
+  ht = nc_hashtable_create(nc_hash_sds, nc_hash_sds_eq, t_sdsfree, NULL);
+  ASSERT(ht != NULL);
+  ASSERT_EQ(0, nc_hashtable_set(ht, sdsnewlen("a\0b", 3), t_val(1)));
+  ASSERT_EQ(0, nc_hashtable_set(ht, sdsnewlen("a\0c", 3), t_val(2)));
+  ASSERT_EQ(0, nc_hashtable_set(ht, sdsnew("a"), t_val(3)));
+  ASSERT_EQ(3, ht->size);
+
+  s = sdsnewlen("a\0c", 3);
+  ASSERT_EQ(t_val(2), nc_hashtable_get(ht, s));
+  sdsfree(s);
+
+  nc_hashtable_destroy(ht);
+  PASS();
+}
+
+struct t_point {
+  int64_t x;
+  int64_t y;
+};
+
+// Keys and values are copied into the pairs; deleted pairs are reused.
+TEST embed(void) {
+  struct nc_hashtable *ht;
+  struct t_point p, *v, *last;
+  int64_t key;
+  int i, round;
+
+  ht = nc_hashtable_create_embed(nc_hash_int64p, nc_hash_int64p_eq,
+                                 sizeof(int64_t), sizeof(struct t_point), 0);
+  ASSERT(ht != NULL);
+
+  for (round = 0; round < 3; round++) {
+    for (i = 0; i < 5000; i++) {
+      key = i;
+      p.x = i + round;
+      p.y = -i;
+      ASSERT_EQ(0, nc_hashtable_set(ht, &key, &p));
+    }
+    ASSERT_EQ(5000, ht->size);
+
+    for (i = 0; i < 5000; i++) {
+      key = i;
+      v = nc_hashtable_get(ht, &key);
+      ASSERT(v != NULL);
+      ASSERT_EQ(i + round, v->x);
+      ASSERT_EQ(-i, v->y);
+    }
+
+    key = 4999;
+    last = nc_hashtable_get(ht, &key);
+    for (i = 0; i < 5000; i++) {
+      key = i;
+      ASSERT_EQ(0, nc_hashtable_del(ht, &key));
+    }
+    ASSERT_EQ(0, ht->size);
+
+    // The last pair deleted is the first one reused
+    key = -1;
+    ASSERT_EQ(0, nc_hashtable_set(ht, &key, &p));
+    ASSERT_EQ(last, nc_hashtable_get(ht, &key));
+    ASSERT_EQ(0, nc_hashtable_del(ht, &key));
+  }
+
+  nc_hashtable_destroy(ht);
+  PASS();
+}
+
+#define T_STABLE 20000  /* keys only read */
+#define T_CHURN 20000   /* keys deleted and set again by the writers */
+#define T_WRITERS 2
+#define T_READERS 4
+
+static atomic_int t_conc_freed;
+
+static void t_conc_free(void *value) {
+  (void)value;
+  atomic_fetch_add(&t_conc_freed, 1);
+}
+
+struct t_conc {
+  struct nc_hashtable *ht;
+  int id;
+  int errors;
+};
+
+// Writers own every T_WRITERS-th churn key and add new keys, so the table
+// grows under the readers.
+static void *t_conc_writer(void *arg) {
+  struct t_conc *t = arg;
+  int i, j, base = T_STABLE + T_CHURN;
+
+  for (j = 0; j < 5; j++) {
+    for (i = T_STABLE + t->id; i < T_STABLE + T_CHURN; i += T_WRITERS) {
+      t->errors += nc_hashtable_del(t->ht, t_key(i)) != 0;
+      t->errors += nc_hashtable_set(t->ht, t_key(i), t_val(i)) != 0;
+    }
+    for (i = t->id; i < 20000; i += T_WRITERS) {
+      t->errors += nc_hashtable_set(t->ht, t_key(base + j * 20000 + i),
+                                    t_val(base + j * 20000 + i)) != 0;
+    }
+  }
+  return NULL;
+}
+
+static void *t_conc_reader(void *arg) {
+  struct t_conc *t = arg;
+  void *keys[64], *values[64];
+  void *v;
+  int i, j, k;
+
+  for (j = 0; j < 10; j++) {
+    for (i = 0; i < T_STABLE + T_CHURN; i++) {
+      v = nc_hashtable_get(t->ht, t_key(i));
+      if (i < T_STABLE)
+        t->errors += v != t_val(i);
+      else
+        t->errors += v != NULL && v != t_val(i);
+    }
+    for (i = 0; i + 64 <= T_STABLE; i += 64) {
+      for (k = 0; k < 64; k++) {
+        keys[k] = t_key(i + k);
+      }
+      t->errors += nc_hashtable_get_many(t->ht, keys, 64, values) != 64;
+    }
+  }
+  return NULL;
+}
+
+TEST concurrent(void) {
+  struct t_conc t[T_WRITERS + T_READERS];
+  pthread_t tid[T_WRITERS + T_READERS];
+  struct nc_hashtable *ht;
+  size_t n, buckets;
+  void *it, *first;
+  int i, count;
+
+  ht = nc_hashtable_create_ex(t_int_hash, t_int_cmp, NULL, t_conc_free,
+                              NC_HASHTABLE_CONCURRENT);
+  ASSERT(ht != NULL);
+
+  // Growing never moves a pair
+  ASSERT_EQ(0, nc_hashtable_set(ht, t_key(0), t_val(0)));
+  first = nc_hashtable_iter_at(ht, t_key(0));
+  buckets = nc_hashtable_num_buckets(ht);
+  for (i = 1; i < T_STABLE + T_CHURN; i++) {
+    ASSERT_EQ(0, nc_hashtable_set(ht, t_key(i), t_val(i)));
+  }
+  ASSERT_EQ(T_STABLE + T_CHURN, nc_hashtable_size(ht));
+  ASSERT(nc_hashtable_num_buckets(ht) > buckets);
+  ASSERT_EQ(first, nc_hashtable_iter_at(ht, t_key(0)));
+
+  count = 0;
+  nc_hashtable_foreach_buckets(ht, 0, nc_hashtable_num_buckets(ht), t_count,
+                               &count);
+  ASSERT_EQ(T_STABLE + T_CHURN, count);
+
+  // Replaced and deleted values are freed later, at the latest by destroy
+  atomic_init(&t_conc_freed, 0);
+  ASSERT_EQ(0, nc_hashtable_set(ht, t_key(7), t_val(8)));
+  ASSERT_EQ(t_val(8), nc_hashtable_get(ht, t_key(7)));
+  ASSERT_EQ(0, nc_hashtable_set(ht, t_key(7), t_val(7)));
+  ASSERT_EQ(-1, nc_hashtable_del(ht, t_key(-2)));
+
+  nc_epoch_enter();
+  n = 0;
+  for (it = nc_hashtable_iter(ht); it; it = nc_hashtable_iter_next(ht, it)) {
+    ASSERT_EQ((uintptr_t)nc_hashtable_iter_value(it),
+              ((uintptr_t)nc_hashtable_iter_key(it) - 1) * 3 + 1);
+    n++;
+  }
+  nc_epoch_exit();
+  ASSERT_EQ(T_STABLE + T_CHURN, n);
+
+  for (i = 0; i < T_WRITERS + T_READERS; i++) {
+    t[i].ht = ht;
+    t[i].id = i;
+    t[i].errors = 0;
+    pthread_create(&tid[i], NULL,
+                   i < T_WRITERS ? t_conc_writer : t_conc_reader, &t[i]);
+  }
+  for (i = 0; i < T_WRITERS + T_READERS; i++) {
+    pthread_join(tid[i], NULL);
+    ASSERT_EQ(0, t[i].errors);
+  }
+
+  ASSERT_EQ(T_STABLE + T_CHURN + 5 * 20000, nc_hashtable_size(ht));
+  for (i = 0; i < T_STABLE + T_CHURN + 5 * 20000; i++) {
+    ASSERT_EQ(t_val(i), nc_hashtable_get(ht, t_key(i)));
+  }
+
+  nc_hashtable_clear(ht);
+  ASSERT_EQ(0, nc_hashtable_size(ht));
+  ASSERT_EQ(NULL, nc_hashtable_get(ht, t_key(1)));
+
+  nc_hashtable_destroy(ht);
+  ASSERT_EQ(2 + 5 * T_CHURN + T_STABLE + T_CHURN + 5 * 20000,
+            atomic_load(&t_conc_freed));
+  PASS();
+}
+
+// Setting and deleting while iterating inside a section must not wait for
+// the section to end
+TEST concurrent_in_section(void) {
+  struct nc_hashtable *ht;
+  void *it, *key;
+  int i, n = 5000, count = 0;
+
+  ht = nc_hashtable_create_ex(t_int_hash, t_int_cmp, NULL, t_conc_free,
+                              NC_HASHTABLE_CONCURRENT);
+  ASSERT(ht != NULL);
+  for (i = 0; i < n; i++) {
+    ASSERT_EQ(0, nc_hashtable_set(ht, t_key(i), t_val(i)));
+  }
+
+  atomic_init(&t_conc_freed, 0);
+  nc_epoch_enter();
+  for (it = nc_hashtable_iter(ht); it; it = nc_hashtable_iter_next(ht, it)) {
+    key = nc_hashtable_iter_key(it);
+    if (((uintptr_t)key - 1) % 2 == 0) {
+      ASSERT_EQ(0, nc_hashtable_del(ht, key));
+    } else {
+      ASSERT_EQ(0, nc_hashtable_set(ht, key, t_val(n)));
+      nc_hashtable_iter_set(ht, it, nc_hashtable_get(ht, key) == t_val(n)
+                                        ? t_val((uintptr_t)key - 1)
+                                        : NULL);
+    }
+    count++;
+  }
+  nc_epoch_exit();
+  ASSERT_EQ(n, count);
+  ASSERT_EQ(n / 2, nc_hashtable_size(ht));
+
+  for (i = 0; i < n; i++) {
+    ASSERT_EQ(i % 2 ? t_val(i) : NULL, nc_hashtable_get(ht, t_key(i)));
+  }
+
+  nc_hashtable_destroy(ht);
+  ASSERT_EQ(n / 2 + n / 2 * 2 + n / 2, atomic_load(&t_conc_freed));
+  PASS();
+}
+
+#define T_MANY_THREADS (NC_EPOCH_MAX_THREADS + 64)
+
+struct t_many {
+  struct nc_hashtable *ht;
+  pthread_barrier_t *barrier;
+  atomic_int errors;
+};
+
+// Every thread holds its epoch record until all of them have one
+static void *t_many_reader(void *arg) {
+  struct t_many *m = arg;
+
+  if (nc_hashtable_get(m->ht, t_key(1)) != t_val(1))
+    atomic_fetch_add(&m->errors, 1);
+  pthread_barrier_wait(m->barrier);
+  if (nc_hashtable_get(m->ht, t_key(2)) != t_val(2))
+    atomic_fetch_add(&m->errors, 1);
+  return NULL;
+}
+
+static void t_limbo_free(void *ptr, void *ctx) {
+  (void)ctx;
+  t_conc_free(ptr);
+}
+
+// More readers than nc_epoch has records for share an overflow record
+TEST epoch_overflow(void) {
+  static pthread_t tid[T_MANY_THREADS];
+  pthread_barrier_t barrier;
+  pthread_attr_t attr;
+  struct nc_epoch_limbo limbo;
+  struct t_many m;
+  int i, n = 0;
+
+  m.ht = nc_hashtable_create_ex(t_int_hash, t_int_cmp, NULL, t_conc_free,
+                                NC_HASHTABLE_CONCURRENT);
+  ASSERT(m.ht != NULL);
+  for (i = 0; i < 100; i++) {
+    ASSERT_EQ(0, nc_hashtable_set(m.ht, t_key(i), t_val(i)));
+  }
+  m.barrier = &barrier;
+  atomic_init(&m.errors, 0);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 64 * 1024);
+  pthread_barrier_init(&barrier, NULL, T_MANY_THREADS);
+  for (i = 0; i < T_MANY_THREADS; i++) {
+    if (pthread_create(&tid[i], &attr, t_many_reader, &m) != 0)
+      break;
+  }
+  n = i;
+  if (n < T_MANY_THREADS) {
+    // Not allowed that many threads; let the ones running finish
+    for (; i < T_MANY_THREADS; i++) {
+      pthread_barrier_wait(&barrier);
+    }
+  }
+  for (i = 0; i < n; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  pthread_barrier_destroy(&barrier);
+  pthread_attr_destroy(&attr);
+  ASSERT_EQ(0, atomic_load(&m.errors));
+
+  // The epoch still advances once the overflow threads are gone
+  nc_epoch_limbo_init(&limbo);
+  atomic_init(&t_conc_freed, 0);
+  nc_epoch_retire(&limbo, t_val(1), t_limbo_free, NULL);
+  for (i = 0; i < 3 && atomic_load(&t_conc_freed) == 0; i++) {
+    nc_epoch_reclaim(&limbo);
+  }
+  ASSERT_EQ(1, atomic_load(&t_conc_freed));
+  nc_epoch_drain(&limbo);
+
+  nc_hashtable_destroy(m.ht);
+  if (n < T_MANY_THREADS)
+    SKIPm("could not start enough threads");
+  PASS();
+}
+
+#define t_i64_hash(k) ((uint64_t)(k))
+#define t_i64_eq(a, b) ((a) == (b))
+
+NC_HASHMAP_DEFINE(i64, int64_t, void *, t_i64_hash, t_i64_eq)
+
+TEST hashmap(void) {
+  struct nc_hashmap_i64 m;
+  void **v;
+  int64_t i, n = 20000, sum;
+  size_t s;
+  int inserted;
+
+  ASSERT_EQ(NC_OK, nc_hashmap_i64_init(&m, 0));
+
+  for (i = 0; i < n; i++) {
+    ASSERT_EQ(NC_OK, nc_hashmap_i64_put(&m, i, t_val(i)));
+  }
+  ASSERT_EQ(n, m.size);
+  ASSERT_EQ(NC_OK, nc_hashmap_i64_put(&m, 7, t_val(8)));
+  ASSERT_EQ(n, m.size);
+  ASSERT_EQ(t_val(8), *nc_hashmap_i64_get(&m, 7));
+
+  for (i = 0; i < n; i += 2) {
+    ASSERT_EQ(NC_OK, nc_hashmap_i64_del(&m, i));
+  }
+  ASSERT_EQ(NC_ERROR, nc_hashmap_i64_del(&m, 0));
+  ASSERT_EQ(n / 2, m.size);
+
+  for (i = 0; i < n; i++) {
+    v = nc_hashmap_i64_get(&m, i);
+    if (i % 2 == 0)
+      ASSERT_EQ(NULL, v);
+    else
+      ASSERT_EQ(i == 7 ? t_val(8) : t_val(i), *v);
+  }
+
+  // insert() adds missing keys only
+  v = nc_hashmap_i64_insert(&m, 3, &inserted);
+  ASSERT(v != NULL && !inserted);
+  v = nc_hashmap_i64_insert(&m, 4, &inserted);
+  ASSERT(v != NULL && inserted);
+  *v = t_val(4);
+
+  sum = 0;
+  for (s = nc_hashmap_i64_next(&m, 0); s < m.capacity;
+       s = nc_hashmap_i64_next(&m, s + 1)) {
+    sum += m.entries[s].key;
+  }
+  ASSERT_EQ(n * n / 4 + 4, sum);
+
+  nc_hashmap_i64_clear(&m);
+  ASSERT_EQ(0, m.size);
+  ASSERT_EQ(NULL, nc_hashmap_i64_get(&m, 1));
+  nc_hashmap_i64_deinit(&m);
+
+  // Deleting as much as is inserted reuses the slots
+  ASSERT_EQ(NC_OK, nc_hashmap_i64_init(&m, 10));
+  for (i = 0; i < 100000; i++) {
+    ASSERT_EQ(NC_OK, nc_hashmap_i64_put(&m, i, t_val(i)));
+    if (i >= 10)
+      ASSERT_EQ(NC_OK, nc_hashmap_i64_del(&m, i - 10));
+  }
+  ASSERT_EQ(10, m.size);
+  ASSERT(m.capacity < 1024);
+  nc_hashmap_i64_deinit(&m);
+
+  PASS();
+}
+
+SUITE(hashtable) {
+  RUN_TESTp(basic, 0);
+  RUN_TESTp(basic, NC_HASHTABLE_POW2);
+  RUN_TESTp(basic, NC_HASHTABLE_OPEN);
+  RUN_TESTp(churn, 0);
+  RUN_TESTp(churn, NC_HASHTABLE_OPEN);
+  RUN_TESTp(rehash, 0);
+  RUN_TESTp(rehash, NC_HASHTABLE_POW2);
+  RUN_TESTp(build, 0);
+  RUN_TESTp(build, NC_HASHTABLE_OPEN);
+  RUN_TEST(builtin_hashes);
+  RUN_TEST(embed);
+  RUN_TEST(concurrent);
+  RUN_TEST(concurrent_in_section);
+  RUN_TEST(epoch_overflow);
+  RUN_TEST(hashmap);
+}
@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "nc_heap.h"
+#include "greatest.h"
+
+#define T_HEAP_OPS 20000
+
+// id makes keys unique, so the heap order is a total order and the
+// reference can be compared element by element
+struct t_item {
+  uint32_t key;
+  uint32_t id;
+};
+
+static int t_item_cmp(const void *a, const void *b) {
+  const struct t_item *pa = a, *pb = b;
+
+  if (pa->key != pb->key)
+    return pa->key < pb->key ? -1 : 1;
+  if (pa->id != pb->id)
+    return pa->id < pb->id ? -1 : 1;
+  return 0;
+}
+
+static uint64_t t_rand(uint64_t *x) {
+  *x ^= *x << 13;
+  *x ^= *x >> 7;
+  *x ^= *x << 17;
+  return *x;
+}
+
+// Sorted reference, smallest first
+static struct t_item t_ref[T_HEAP_OPS];
+static int t_nref;
+static int t_handle_of[T_HEAP_OPS]; /* handle of each item id, -1 if gone */
+
+static void t_ref_insert(const struct t_item *it) {
+  int i;
+
+  for (i = t_nref; i > 0 && t_item_cmp(&t_ref[i - 1], it) > 0; i--) {
+    t_ref[i] = t_ref[i - 1];
+  }
+  t_ref[i] = *it;
+  t_nref++;
+}
+
+static void t_ref_delete(int i) {
+  memmove(&t_ref[i], &t_ref[i + 1], (t_nref - i - 1) * sizeof(t_ref[0]));
+  t_nref--;
+}
+
+// Every live handle still leads to its own element
+static int t_check_handles(struct nc_heap *h) {
+  struct t_item *it;
+  int i;
+
+  if (nc_heap_nelem(h) != t_nref)
+    return 0;
+  for (i = 0; i < t_nref; i++) {
+    it = nc_heap_get(h, t_handle_of[t_ref[i].id]);
+    if (t_item_cmp(it, &t_ref[i]) != 0)
+      return 0;
+  }
+  return 1;
+}
+
+static enum greatest_test_res t_random_ops(int arity) {
+  struct nc_heap *h;
+  struct t_item it, out;
+  uint64_t x = 88172645463325252ULL + (uint64_t)arity;
+  uint32_t nid = 0;
+  int op, i, handle;
+
+  h = nc_heap_create(4, sizeof(struct t_item), arity, t_item_cmp);
+  ASSERT(h != NULL);
+  t_nref = 0;
+
+  ASSERT(nc_heap_peek(h) == NULL);
+  ASSERT_EQ(NC_ERROR, nc_heap_pop(h, &out));
+
+  for (op = 0; op < T_HEAP_OPS; op++) {
+    switch (t_rand(&x) % 8) {
+    case 0:
+    case 1:
+    case 2:
+      it.key = (uint32_t)(t_rand(&x) % 1000);
+      it.id = nid++;
+      handle = nc_heap_push(h, &it);
+      ASSERT(handle >= 0);
+      t_handle_of[it.id] = handle;
+      t_ref_insert(&it);
+      break;
+
+    case 3:
+      if (t_nref == 0) {
+        ASSERT_EQ(NC_ERROR, nc_heap_pop(h, &out));
+        break;
+      }
+      ASSERT_EQ(NC_OK, nc_heap_pop(h, &out));
+      ASSERT_EQ(0, t_item_cmp(&out, &t_ref[0]));
+      t_handle_of[out.id] = -1;
+      t_ref_delete(0);
+      break;
+
+    case 4:
+    case 5:
+      if (t_nref == 0)
+        break;
+      i = (int)(t_rand(&x) % t_nref);
+      it = t_ref[i];
+      it.key = (uint32_t)(t_rand(&x) % 1000);
+      ASSERT_EQ(NC_OK, nc_heap_update(h, t_handle_of[it.id], &it));
+      t_ref_delete(i);
+      t_ref_insert(&it);
+      break;
+
+    default:
+      if (t_nref == 0)
+        break;
+      i = (int)(t_rand(&x) % t_nref);
+      ASSERT_EQ(NC_OK, nc_heap_remove(h, t_handle_of[t_ref[i].id], &out));
+      ASSERT_EQ(0, t_item_cmp(&out, &t_ref[i]));
+      t_handle_of[out.id] = -1;
+      t_ref_delete(i);
+      break;
+    }
+
+    ASSERT_EQ(t_nref, nc_heap_nelem(h));
+    if (t_nref > 0) {
+      ASSERT_EQ(0, t_item_cmp(nc_heap_peek(h), &t_ref[0]));
+    }
+    if (op % 16 == 0) {
+      ASSERT(t_check_handles(h));
+    }
+  }
+
+  ASSERT(t_check_handles(h));
+
+  // Draining yields the reference in order
+  for (i = 0; i < t_nref; i++) {
+    ASSERT_EQ(NC_OK, nc_heap_pop(h, &out));
+    ASSERT_EQ(0, t_item_cmp(&out, &t_ref[i]));
+  }
+  ASSERT_EQ(0, nc_heap_nelem(h));
+
+  nc_heap_destroy(h);
+  PASS();
+}
+
+TEST random_ops_binary(void) {
+  return t_random_ops(2);
+}
+
+TEST random_ops_quaternary(void) {
+  return t_random_ops(4);
+}
+
+TEST heapify(void) {
+  struct nc_heap *h;
+  struct t_item items[1000], out;
+  uint64_t x = 88172645463325252ULL;
+  int i, n = 1000;
+
+  h = nc_heap_create(1, sizeof(struct t_item), 4, t_item_cmp);
+  ASSERT(h != NULL);
+
+  t_nref = 0;
+  for (i = 0; i < n; i++) {
+    items[i].key = (uint32_t)(t_rand(&x) % 100);
+    items[i].id = (uint32_t)i;
+    t_handle_of[i] = i;
+    t_ref_insert(&items[i]);
+  }
+
+  ASSERT_EQ(NC_OK, nc_heap_heapify(h, items, n));
+  ASSERT(t_check_handles(h));
+
+  // Remove every third element by its handle, then drain in order
+  for (i = 0; i < n; i += 3) {
+    ASSERT_EQ(NC_OK, nc_heap_remove(h, i, &out));
+    ASSERT_EQ(0, t_item_cmp(&out, &items[i]));
+  }
+
+  // The handles are dead now
+  ASSERT_EQ(NC_ERROR, nc_heap_remove(h, 0, &out));
+  ASSERT_EQ(NC_ERROR, nc_heap_update(h, 3, &items[3]));
+  t_nref = 0;
+  for (i = 0; i < n; i++) {
+    if (i % 3 != 0)
+      t_ref_insert(&items[i]);
+  }
+  ASSERT(t_check_handles(h));
+
+  for (i = 0; i < t_nref; i++) {
+    ASSERT_EQ(NC_OK, nc_heap_pop(h, &out));
+    ASSERT_EQ(0, t_item_cmp(&out, &t_ref[i]));
+  }
+  ASSERT_EQ(NC_ERROR, nc_heap_pop(h, &out));
+
+  nc_heap_destroy(h);
+  PASS();
+}
+
+SUITE(heap) {
+  RUN_TEST(random_ops_binary);
+  RUN_TEST(random_ops_quaternary);
+  RUN_TEST(heapify);
+}
@@ -0,0 +1,178 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nc_index.h"
+#include "greatest.h"
+
+// Elements carry the key at T_KEY_OFFSET, with bytes on both sides
+#define T_ELEM_SIZE 16
+#define T_KEY_OFFSET 4
+#define T_MAX_N 4097
+
+static uint64_t t_keys[T_MAX_N];
+
+static uint64_t t_rand(uint64_t *x) {
+  *x ^= *x << 13;
+  *x ^= *x >> 7;
+  *x ^= *x << 17;
+  return *x;
+}
+
+static int t_u64_cmp(const void *a, const void *b) {
+  uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+
+  return ka < kb ? -1 : ka > kb;
+}
+
+// Stores key as a native 'width' byte integer
+static void t_store(u_char *p, uint64_t key, size_t width) {
+  uint8_t k1 = (uint8_t)key;
+  uint16_t k2 = (uint16_t)key;
+  uint32_t k4 = (uint32_t)key;
+
+  switch (width) {
+  case 1:
+    memcpy(p, &k1, 1);
+    break;
+  case 2:
+    memcpy(p, &k2, 2);
+    break;
+  case 4:
+    memcpy(p, &k4, 4);
+    break;
+  default:
+    memcpy(p, &key, 8);
+  }
+}
+
+// The reference: plain binary search over the sorted keys
+static int t_lower_bound(const uint64_t *keys, int n, uint64_t key) {
+  int lo = 0, hi = n, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (keys[mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static enum greatest_test_res t_query(const struct nc_array_index *ix, int n,
+                                      uint64_t key) {
+  int lb = t_lower_bound(t_keys, n, key);
+
+  ASSERT_EQ(lb, nc_array_index_lower_bound(ix, key));
+  ASSERT_EQ(lb < n && t_keys[lb] == key ? lb : -1,
+            nc_array_index_find(ix, key));
+  PASS();
+}
+
+// Sorted keys of 'width' bytes, roughly a third of them duplicates, built
+// into an array and indexed, then queried at every key, its neighbours
+// and past both ends.
+static enum greatest_test_res t_check(int n, size_t width, uint64_t *x) {
+  struct nc_array *a;
+  struct nc_array_index *ix;
+  uint64_t mask = width == 8 ? UINT64_MAX : (1ULL << (8 * width)) - 1;
+  u_char *e;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    t_keys[i] = t_rand(x) & mask;
+  }
+  qsort(t_keys, (size_t)n, sizeof(t_keys[0]), t_u64_cmp);
+  for (i = 1; i < n; i++) {
+    if (t_rand(x) % 3 == 0)
+      t_keys[i] = t_keys[i - 1];
+  }
+
+  a = nc_array_create(n > 0 ? n : 1, T_ELEM_SIZE);
+  ASSERT(a != NULL);
+  for (i = 0; i < n; i++) {
+    e = nc_array_push(a);
+    ASSERT(e != NULL);
+    memset(e, 0xa5, T_ELEM_SIZE);
+    t_store(e + T_KEY_OFFSET, t_keys[i], width);
+  }
+
+  ix = nc_array_freeze_index(a, T_KEY_OFFSET, width);
+  ASSERT(ix != NULL);
+  ASSERT_EQ(n, ix->nelem);
+  ASSERT_EQ(0, (uintptr_t)ix->keys % NC_CACHELINE_SIZE);
+
+  for (i = 0; i < n; i++) {
+    CHECK_CALL(t_query(ix, n, t_keys[i]));
+    CHECK_CALL(t_query(ix, n, t_keys[i] - 1));
+    CHECK_CALL(t_query(ix, n, t_keys[i] + 1));
+  }
+  CHECK_CALL(t_query(ix, n, 0));
+  CHECK_CALL(t_query(ix, n, 1));
+  CHECK_CALL(t_query(ix, n, mask));
+  CHECK_CALL(t_query(ix, n, mask - 1));
+  CHECK_CALL(t_query(ix, n, UINT64_MAX));
+  if (width < 8) {
+    CHECK_CALL(t_query(ix, n, mask + 1));
+  }
+  for (i = 0; i < 100; i++) {
+    CHECK_CALL(t_query(ix, n, t_rand(x) & mask));
+  }
+
+  nc_array_index_destroy(ix);
+  nc_array_destroy(a);
+  PASS();
+}
+
+TEST lower_bound_sizes(void) {
+  static const size_t widths[] = {1, 2, 4, 8};
+  uint64_t x = 88172645463325252ULL;
+  int w, k, n;
+
+  for (w = 0; w < 4; w++) {
+    CHECK_CALL(t_check(0, widths[w], &x));
+    CHECK_CALL(t_check(1, widths[w], &x));
+    for (k = 1; k <= 12; k++) {
+      for (n = (1 << k) - 1; n <= (1 << k) + 1; n++) {
+        CHECK_CALL(t_check(n, widths[w], &x));
+      }
+    }
+  }
+
+  PASS();
+}
+
+// Two runs of equal keys, the second one at the largest key
+TEST lower_bound_edges(void) {
+  struct nc_array *a;
+  struct nc_array_index *ix;
+  uint64_t *e;
+  int i, n = 1000;
+
+  a = nc_array_create(n, sizeof(uint64_t));
+  ASSERT(a != NULL);
+  for (i = 0; i < n; i++) {
+    e = nc_array_push(a);
+    *e = i < n / 2 ? 42 : UINT64_MAX;
+  }
+
+  ix = nc_array_freeze_index(a, 0, sizeof(uint64_t));
+  ASSERT(ix != NULL);
+  ASSERT_EQ(0, nc_array_index_lower_bound(ix, 0));
+  ASSERT_EQ(0, nc_array_index_lower_bound(ix, 42));
+  ASSERT_EQ(0, nc_array_index_find(ix, 42));
+  ASSERT_EQ(n / 2, nc_array_index_lower_bound(ix, 43));
+  ASSERT_EQ(-1, nc_array_index_find(ix, 43));
+  ASSERT_EQ(n / 2, nc_array_index_lower_bound(ix, UINT64_MAX));
+  ASSERT_EQ(n / 2, nc_array_index_find(ix, UINT64_MAX));
+
+  nc_array_index_destroy(ix);
+  nc_array_destroy(a);
+  PASS();
+}
+
+SUITE(array_index) {
+  RUN_TEST(lower_bound_sizes);
+  RUN_TEST(lower_bound_edges);
+}
@@ -1,6 +1,16 @@
 #include "greatest.h"
 
 SUITE_EXTERN(array);
+SUITE_EXTERN(array_index);
+SUITE_EXTERN(bitmap);
+SUITE_EXTERN(codec);
+SUITE_EXTERN(columns);
+SUITE_EXTERN(hashtable);
+SUITE_EXTERN(heap);
+SUITE_EXTERN(parallel);
+SUITE_EXTERN(ring);
+SUITE_EXTERN(segarray);
+SUITE_EXTERN(strtab);
 
 GREATEST_MAIN_DEFS();
 
@@ -8,6 +18,16 @@ int main(int argc, char **argv) {
     GREATEST_MAIN_BEGIN();
     
     RUN_SUITE(array);
+    RUN_SUITE(array_index);
+    RUN_SUITE(bitmap);
+    RUN_SUITE(codec);
+    RUN_SUITE(columns);
+    RUN_SUITE(hashtable);
+    RUN_SUITE(heap);
+    RUN_SUITE(parallel);
+    RUN_SUITE(ring);
+    RUN_SUITE(segarray);
+    RUN_SUITE(strtab);
     
     GREATEST_MAIN_END();
 }
@@ -0,0 +1,327 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "nc_parallel.h"
+#include "greatest.h"
+
+struct t_cover {
+  atomic_int *hits;
+  atomic_int bad; /* ranges outside the array */
+  int n;
+};
+
+struct t_nested {
+  struct nc_array *inner;
+  atomic_int inner_calls;
+  atomic_int other_thread; /* inner bodies run off the calling thread */
+  atomic_int inner_bad;    /* inner loops that missed elements */
+};
+
+struct t_nested_inner {
+  pthread_t self;
+  int count;
+  int other_thread;
+};
+
+// Accumulator that checks chunks are combined in order
+struct t_span {
+  int lo, hi;
+  int ok;
+  double sum;
+};
+
+static size_t t_int_hash(const void *key) {
+  return (size_t)(uintptr_t)key;
+}
+
+static int t_int_cmp(const void *a, const void *b) {
+  return a == b;
+}
+
+static void t_cover_fn(struct nc_array *a, int lo, int hi, void *ctx) {
+  struct t_cover *c = ctx;
+  int i;
+
+  if (lo < 0 || lo >= hi || hi > a->nelem)
+    atomic_fetch_add(&c->bad, 1);
+  for (i = lo; i < hi && i < c->n; i++) {
+    atomic_fetch_add(&c->hits[i], 1);
+  }
+}
+
+static void t_cover_pair(void *key, void *value, void *ctx) {
+  struct t_cover *c = ctx;
+
+  (void)value;
+  atomic_fetch_add(&c->hits[(uintptr_t)key - 1], 1);
+}
+
+static void t_inner_fn(struct nc_array *a, int lo, int hi, void *ctx) {
+  struct t_nested_inner *in = ctx;
+
+  (void)a;
+  if (!pthread_equal(in->self, pthread_self()))
+    in->other_thread = 1;
+  in->count += hi - lo;
+}
+
+static void t_outer_fn(struct nc_array *a, int lo, int hi, void *ctx) {
+  struct t_nested *nest = ctx;
+  struct t_nested_inner in;
+  int i;
+
+  (void)a;
+  for (i = lo; i < hi; i++) {
+    // The pool is busy with this loop, so the inner one runs right here
+    in.self = pthread_self();
+    in.count = 0;
+    in.other_thread = 0;
+    nc_parallel_for(nest->inner, t_inner_fn, &in, 1);
+    if (in.other_thread)
+      atomic_fetch_add(&nest->other_thread, 1);
+    if (in.count != nest->inner->nelem)
+      atomic_fetch_add(&nest->inner_bad, 1);
+    atomic_fetch_add(&nest->inner_calls, 1);
+  }
+}
+
+static void t_span_fn(struct nc_array *a, int lo, int hi, void *acc,
+                      void *ctx) {
+  struct t_span *s = acc;
+  const double *v = a->elems;
+  int i;
+
+  (void)ctx;
+  s->lo = lo;
+  s->hi = hi;
+  for (i = lo; i < hi; i++) {
+    s->sum += v[i];
+  }
+}
+
+static void t_span_combine(void *acc, const void *other, void *ctx) {
+  struct t_span *s = acc;
+  const struct t_span *o = other;
+
+  (void)ctx;
+  if (s->hi != o->lo)
+    s->ok = 0;
+  s->hi = o->hi;
+  s->sum += o->sum;
+}
+
+static void t_sum_pair(void *key, void *value, void *acc, void *ctx) {
+  (void)key;
+  (void)ctx;
+  *(uint64_t *)acc += (uintptr_t)value;
+}
+
+static void t_sum_combine(void *acc, const void *other, void *ctx) {
+  (void)ctx;
+  *(uint64_t *)acc += *(const uint64_t *)other;
+}
+
+// Workers are needed even on a single cpu machine
+static void t_parallel_setup(void) {
+  nc_parallel_init(4);
+}
+
+TEST for_covers_once(void) {
+  static const int sizes[] = {1, 2, 1023, 1024, 1025, 100003};
+  static const int grains[] = {0, 1, 7, 1000, 200000};
+  struct nc_array *a;
+  struct t_cover c;
+  int s, g, i, n;
+
+  for (s = 0; s < (int)NELEMS(sizes); s++) {
+    n = sizes[s];
+    a = nc_array_create(n, sizeof(uint32_t));
+    ASSERT(a != NULL);
+    ASSERT(nc_array_push_n(a, n) != NULL);
+    c.hits = calloc((size_t)n, sizeof(atomic_int));
+    ASSERT(c.hits != NULL);
+    c.n = n;
+
+    for (g = 0; g < (int)NELEMS(grains); g++) {
+      for (i = 0; i < n; i++) {
+        atomic_init(&c.hits[i], 0);
+      }
+      atomic_init(&c.bad, 0);
+      ASSERT_EQ(NC_OK, nc_parallel_for(a, t_cover_fn, &c, grains[g]));
+      ASSERT_EQ(0, atomic_load(&c.bad));
+      for (i = 0; i < n; i++) {
+        if (atomic_load(&c.hits[i]) != 1)
+          FAILm("element not visited exactly once");
+      }
+    }
+
+    free(c.hits);
+    nc_array_destroy(a);
+  }
+
+  // An empty array runs nothing
+  a = nc_array_create(1, sizeof(uint32_t));
+  ASSERT(a != NULL);
+  c.hits = NULL;
+  c.n = 0;
+  atomic_init(&c.bad, 0);
+  ASSERT_EQ(NC_OK, nc_parallel_for(a, t_cover_fn, &c, 0));
+  ASSERT_EQ(0, atomic_load(&c.bad));
+  nc_array_destroy(a);
+
+  PASS();
+}
+
+TEST hashtable_covers_once(void) {
+  struct nc_hashtable *ht;
+  struct t_cover c;
+  uint64_t sum, expect;
+  int i, n = 50000;
+
+  ht = nc_hashtable_create(t_int_hash, t_int_cmp, NULL, NULL);
+  ASSERT(ht != NULL);
+  expect = 0;
+  for (i = 0; i < n; i++) {
+    ASSERT_EQ(0, nc_hashtable_set(ht, (void *)(uintptr_t)(i + 1),
+                                  (void *)(uintptr_t)(i * 3)));
+    expect += (uint64_t)i * 3;
+  }
+
+  c.hits = calloc((size_t)n, sizeof(atomic_int));
+  ASSERT(c.hits != NULL);
+  c.n = n;
+  ASSERT_EQ(NC_OK, nc_hashtable_parallel_for(ht, t_cover_pair, &c, 16));
+  for (i = 0; i < n; i++) {
+    if (atomic_load(&c.hits[i]) != 1)
+      FAILm("pair not visited exactly once");
+  }
+  free(c.hits);
+
+  sum = 0;
+  ASSERT_EQ(NC_OK, nc_hashtable_parallel_reduce(ht, t_sum_pair, t_sum_combine,
+                                                &sum, sizeof(sum), NULL, 16));
+  ASSERT_EQ(expect, sum);
+
+  nc_hashtable_destroy(ht);
+  PASS();
+}
+
+TEST nested_runs_inline(void) {
+  struct nc_array *outer;
+  struct t_nested nest;
+  int n = 64;
+
+  outer = nc_array_create(n, sizeof(uint32_t));
+  nest.inner = nc_array_create(5000, sizeof(uint32_t));
+  ASSERT(outer != NULL && nest.inner != NULL);
+  ASSERT(nc_array_push_n(outer, n) != NULL);
+  ASSERT(nc_array_push_n(nest.inner, 5000) != NULL);
+  atomic_init(&nest.inner_calls, 0);
+  atomic_init(&nest.other_thread, 0);
+  atomic_init(&nest.inner_bad, 0);
+
+  ASSERT_EQ(NC_OK, nc_parallel_for(outer, t_outer_fn, &nest, 1));
+
+  ASSERT_EQ(n, atomic_load(&nest.inner_calls));
+  ASSERT_EQ(0, atomic_load(&nest.other_thread));
+  ASSERT_EQ(0, atomic_load(&nest.inner_bad));
+
+  nc_array_destroy(nest.inner);
+  nc_array_destroy(outer);
+  PASS();
+}
+
+struct t_reduce_ctx {
+  struct nc_array *a;
+  int grain;
+  struct t_span result;
+};
+
+static void t_reduce_inline(struct nc_array *a, int lo, int hi, void *ctx) {
+  struct t_reduce_ctx *r = ctx;
+  struct t_span s = {0, 0, 1, 0.0};
+
+  (void)a;
+  if (lo == 0 && hi > 0) {
+    nc_parallel_reduce(r->a, t_span_fn, t_span_combine, &s, sizeof(s), NULL,
+                       r->grain);
+    r->result = s;
+  }
+}
+
+// With grain at least n / 8, the most chunks a single thread would cut,
+// the chunking only depends on n and grain. Chunks combine in order, so a
+// floating point sum then comes out bit for bit the same whatever the
+// number of threads.
+TEST reduce_deterministic(void) {
+  struct nc_array *a, *one;
+  struct t_reduce_ctx r;
+  struct t_span s, expect, chunk;
+  double *v;
+  uint64_t x = 88172645463325252ULL;
+  int i, lo, round, n = 100000, grain = 12500;
+
+  a = nc_array_create(n, sizeof(double));
+  ASSERT(a != NULL);
+  v = nc_array_push_n(a, n);
+  ASSERT(v != NULL);
+  for (i = 0; i < n; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    // Magnitudes far apart, so the order of the additions shows
+    v[i] = (double)(x % 1000000) * (i % 3 == 0 ? 1e12 : 1e-3);
+  }
+
+  // Serial reference: chunks of 'grain' summed and combined in order
+  expect.lo = 0;
+  expect.hi = 0;
+  expect.ok = 1;
+  expect.sum = 0.0;
+  for (lo = 0; lo < n; lo += grain) {
+    chunk.sum = 0.0;
+    for (i = lo; i < lo + grain && i < n; i++) {
+      chunk.sum += v[i];
+    }
+    expect.sum += chunk.sum;
+  }
+
+  for (round = 0; round < 5; round++) {
+    s.lo = 0;
+    s.hi = 0;
+    s.ok = 1;
+    s.sum = 0.0;
+    ASSERT_EQ(NC_OK, nc_parallel_reduce(a, t_span_fn, t_span_combine, &s,
+                                        sizeof(s), NULL, grain));
+    ASSERT(s.ok);
+    ASSERT_EQ(n, s.hi);
+    ASSERT(s.sum == expect.sum);
+  }
+
+  // Again from inside a loop on the pool, where it runs on one thread
+  one = nc_array_create(2, sizeof(uint32_t));
+  ASSERT(one != NULL);
+  ASSERT(nc_array_push_n(one, 2) != NULL);
+  r.a = a;
+  r.grain = grain;
+  r.result.ok = 0;
+  ASSERT_EQ(NC_OK, nc_parallel_for(one, t_reduce_inline, &r, 1));
+  ASSERT(r.result.ok);
+  ASSERT_EQ(n, r.result.hi);
+  ASSERT(r.result.sum == expect.sum);
+
+  nc_array_destroy(one);
+  nc_array_destroy(a);
+  PASS();
+}
+
+SUITE(parallel) {
+  t_parallel_setup();
+
+  RUN_TEST(for_covers_once);
+  RUN_TEST(hashtable_covers_once);
+  RUN_TEST(nested_runs_inline);
+  RUN_TEST(reduce_deterministic);
+}
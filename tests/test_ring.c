@@ -0,0 +1,133 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include "nc_ring.h"
+#include "greatest.h"
+
+#define T_RING_SLOTS 64
+#define T_RING_COUNT 1000000
+
+TEST full_empty(void) {
+  struct nc_ring *r;
+  uint64_t v, buf[100];
+  uint64_t i, next = 0, expect = 0;
+  int round;
+  size_t n;
+
+  // Rounded up to 8 slots
+  r = nc_ring_create(5, sizeof(uint64_t));
+  ASSERT(r != NULL);
+  ASSERT_EQ(7, r->mask);
+  ASSERT_EQ(0, (uintptr_t)r % NC_CACHELINE_SIZE);
+  ASSERT_EQ(0, (uintptr_t)r->elems % NC_CACHELINE_SIZE);
+
+  ASSERT_EQ(NC_EAGAIN, nc_ring_pop(r, &v));
+  ASSERT_EQ(0, nc_ring_pop_n(r, buf, 4));
+
+  // Fill, overflow, drain: many times so the indices wrap the slots
+  for (round = 0; round < 10; round++) {
+    for (i = 0; i < 8; i++) {
+      v = next++;
+      ASSERT_EQ(NC_OK, nc_ring_push(r, &v));
+    }
+    ASSERT_EQ(8, nc_ring_count(r));
+    ASSERT_EQ(NC_EAGAIN, nc_ring_push(r, &v));
+    ASSERT_EQ(0, nc_ring_push_n(r, buf, 3));
+
+    for (i = 0; i < 8; i++) {
+      ASSERT_EQ(NC_OK, nc_ring_pop(r, &v));
+      ASSERT_EQ(expect++, v);
+    }
+    ASSERT_EQ(0, nc_ring_count(r));
+    ASSERT_EQ(NC_EAGAIN, nc_ring_pop(r, &v));
+
+    // Partial batches that straddle the end of the slots
+    for (i = 0; i < 5; i++) {
+      buf[i] = next++;
+    }
+    ASSERT_EQ(5, nc_ring_push_n(r, buf, 5));
+    for (i = 0; i < 100; i++) {
+      buf[i] = next + i;
+    }
+    n = nc_ring_push_n(r, buf, 100);
+    ASSERT_EQ(3, n);
+    next += n;
+
+    n = nc_ring_pop_n(r, buf, 100);
+    ASSERT_EQ(8, n);
+    for (i = 0; i < n; i++) {
+      ASSERT_EQ(expect++, buf[i]);
+    }
+  }
+
+  nc_ring_destroy(r);
+  PASS();
+}
+
+static void *t_producer(void *arg) {
+  struct nc_ring *r = arg;
+  uint64_t buf[T_RING_SLOTS + 7];
+  uint64_t next = 0, want, i;
+  size_t n;
+
+  while (next < T_RING_COUNT) {
+    // Batches of 1 to 71 elements, sometimes more than the ring holds
+    want = 1 + next % (T_RING_SLOTS + 7);
+    if (want > T_RING_COUNT - next)
+      want = T_RING_COUNT - next;
+    for (i = 0; i < want; i++) {
+      buf[i] = next + i;
+    }
+    n = nc_ring_push_n(r, buf, want);
+    next += n;
+    if (n == 0)
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+TEST two_threads(void) {
+  struct nc_ring *r;
+  pthread_t tid;
+  uint64_t buf[T_RING_SLOTS];
+  uint64_t expect = 0, i;
+  size_t n, want = 1;
+
+  r = nc_ring_create(T_RING_SLOTS, sizeof(uint64_t));
+  ASSERT(r != NULL);
+
+  ASSERT_EQ(0, pthread_create(&tid, NULL, t_producer, r));
+
+  while (expect < T_RING_COUNT) {
+    n = nc_ring_pop_n(r, buf, want);
+    ASSERT(n <= want);
+    for (i = 0; i < n; i++) {
+      if (buf[i] != expect + i)
+        break;
+    }
+    if (i != n) {
+      pthread_join(tid, NULL);
+      FAILm("out of order");
+    }
+    expect += n;
+    want = want % T_RING_SLOTS + 1;
+    if (n == 0)
+      sched_yield();
+  }
+
+  pthread_join(tid, NULL);
+
+  ASSERT_EQ(T_RING_COUNT, expect);
+  ASSERT_EQ(0, nc_ring_count(r));
+  ASSERT_EQ(0, nc_ring_pop_n(r, buf, T_RING_SLOTS));
+
+  nc_ring_destroy(r);
+  PASS();
+}
+
+SUITE(ring) {
+  RUN_TEST(full_empty);
+  RUN_TEST(two_threads);
+}
@@ -0,0 +1,114 @@
+#include <stdint.h>
+
+#include "nc_segarray.h"
+#include "greatest.h"
+
+// Elements are pushed at both ends so that element i holds i - nfront,
+// which makes the expected value of any slot easy to compute.
+TEST grow_both_ends(void) {
+  struct nc_segarray *s;
+  int64_t *p, v;
+  int64_t i, n = 1000, nfront = 300;
+
+  s = nc_segarray_create(sizeof(int64_t), 4);
+  ASSERT(s != NULL);
+  ASSERT_EQ(0, s->nelem);
+  ASSERT_EQ(NC_ERROR, nc_segarray_pop(s, &v));
+  ASSERT_EQ(NC_ERROR, nc_segarray_pop_front(s, &v));
+
+  // Chunks of 4 elements: every 4th push crosses a segment boundary
+  for (i = 0; i < n; i++) {
+    p = nc_segarray_push(s);
+    ASSERT(p != NULL);
+    *p = i;
+  }
+  for (i = 1; i <= nfront; i++) {
+    p = nc_segarray_push_front(s);
+    ASSERT(p != NULL);
+    *p = -i;
+  }
+
+  ASSERT_EQ((size_t)(n + nfront), s->nelem);
+  for (i = 0; i < n + nfront; i++) {
+    ASSERT_EQ(i - nfront, *(int64_t *)nc_segarray_get(s, i));
+  }
+
+  // Pop across boundaries from both ends
+  for (i = n - 1; i >= n / 2; i--) {
+    ASSERT_EQ(NC_OK, nc_segarray_pop(s, &v));
+    ASSERT_EQ(i, v);
+  }
+  for (i = nfront; i >= 1; i--) {
+    ASSERT_EQ(NC_OK, nc_segarray_pop_front(s, &v));
+    ASSERT_EQ(-i, v);
+  }
+  ASSERT_EQ((size_t)(n / 2), s->nelem);
+  for (i = 0; i < n / 2; i++) {
+    ASSERT_EQ(i, *(int64_t *)nc_segarray_get(s, i));
+  }
+
+  // Drain completely, then grow again from empty
+  while (nc_segarray_pop_front(s, NULL) == NC_OK) {
+    /* void */
+  }
+  ASSERT_EQ(0, s->nelem);
+  for (i = 0; i < 9; i++) {
+    p = i % 2 ? nc_segarray_push(s) : nc_segarray_push_front(s);
+    ASSERT(p != NULL);
+    *p = i;
+  }
+  ASSERT_EQ(8, *(int64_t *)nc_segarray_get(s, 0));
+  ASSERT_EQ(7, *(int64_t *)nc_segarray_get(s, 8));
+
+  nc_segarray_destroy(s);
+  PASS();
+}
+
+// Addresses handed out by push stay valid while the array grows at
+// either end, including when the chunk directory is reallocated.
+TEST stable_pointers(void) {
+  struct nc_segarray *s;
+  int64_t *ptrs[512];
+  int64_t *p;
+  int64_t i, n = 512;
+
+  s = nc_segarray_create(sizeof(int64_t), 8);
+  ASSERT(s != NULL);
+
+  for (i = 0; i < n; i++) {
+    p = nc_segarray_push(s);
+    ASSERT(p != NULL);
+    *p = i;
+    ptrs[i] = p;
+  }
+
+  for (i = 0; i < 20000; i++) {
+    p = i % 2 ? nc_segarray_push(s) : nc_segarray_push_front(s);
+    ASSERT(p != NULL);
+    *p = -1;
+  }
+
+  for (i = 0; i < n; i++) {
+    ASSERT_EQ(i, *ptrs[i]);
+    ASSERT_EQ((void *)ptrs[i], nc_segarray_get(s, 10000 + i));
+  }
+
+  // Popping other elements doesn't move the survivors either
+  for (i = 0; i < 10000; i++) {
+    ASSERT_EQ(NC_OK, nc_segarray_pop_front(s, NULL));
+    ASSERT_EQ(NC_OK, nc_segarray_pop(s, NULL));
+  }
+  ASSERT_EQ((size_t)n, s->nelem);
+  for (i = 0; i < n; i++) {
+    ASSERT_EQ((void *)ptrs[i], nc_segarray_get(s, i));
+    ASSERT_EQ(i, *ptrs[i]);
+  }
+
+  nc_segarray_destroy(s);
+  PASS();
+}
+
+SUITE(segarray) {
+  RUN_TEST(grow_both_ends);
+  RUN_TEST(stable_pointers);
+}
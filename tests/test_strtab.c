@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "nc_strtab.h"
+#include "greatest.h"
+
+#define T_STRTAB_N 20000
+
+static int t_count_fn(int id, const char *s, size_t len, void *ctx) {
+  int *next = ctx;
+
+  if (id != *next || s[len] != '\0')
+    return -1;
+  (*next)++;
+  return 0;
+}
+
+static int t_stop_fn(int id, const char *s, size_t len, void *ctx) {
+  (void)s;
+  (void)len;
+  (void)ctx;
+  return id == 3 ? 42 : 0;
+}
+
+TEST intern_dedup(void) {
+  struct nc_strtab *t;
+  char buf[32];
+  const char *s;
+  size_t len;
+  int i, id, next;
+
+  t = nc_strtab_create(1, NC_STRTAB_DEDUP);
+  ASSERT(t != NULL);
+  ASSERT_EQ(-1, nc_strtab_find(t, "a", 1));
+
+  ASSERT_EQ(0, nc_strtab_append(t, "hello", 5));
+  ASSERT_EQ(1, nc_strtab_append(t, "world", 5));
+  ASSERT_EQ(0, nc_strtab_append(t, "hello", 5));
+  ASSERT_EQ(2, nc_strtab_append(t, "hell", 4));
+  ASSERT_EQ(3, nc_strtab_append(t, "", 0));
+  ASSERT_EQ(3, nc_strtab_append(t, "", 0));
+  ASSERT_EQ(4, nc_strtab_count(t));
+
+  ASSERT_EQ(0, nc_strtab_find(t, "hello", 5));
+  ASSERT_EQ(2, nc_strtab_find(t, "hello", 4));
+  ASSERT_EQ(3, nc_strtab_find(t, "", 0));
+  ASSERT_EQ(-1, nc_strtab_find(t, "hello!", 6));
+
+  s = nc_strtab_get(t, 1, &len);
+  ASSERT_EQ(5, len);
+  ASSERT_STR_EQ("world", s);
+  ASSERT_STR_EQ("", nc_strtab_get(t, 3, NULL));
+
+  // Enough strings to grow the bytes, the index and the dedup slots
+  // many times over
+  for (i = 0; i < T_STRTAB_N; i++) {
+    len = (size_t)snprintf(buf, sizeof(buf), "key:%d", i);
+    ASSERT_EQ(4 + i, nc_strtab_append(t, buf, len));
+  }
+  for (i = T_STRTAB_N - 1; i >= 0; i -= 7) {
+    len = (size_t)snprintf(buf, sizeof(buf), "key:%d", i);
+    ASSERT_EQ(4 + i, nc_strtab_append(t, buf, len));
+    ASSERT_EQ(4 + i, nc_strtab_find(t, buf, len));
+  }
+  ASSERT_EQ(4 + T_STRTAB_N, nc_strtab_count(t));
+
+  next = 0;
+  ASSERT_EQ(0, nc_strtab_iterate(t, t_count_fn, &next));
+  ASSERT_EQ(nc_strtab_count(t), next);
+  ASSERT_EQ(42, nc_strtab_iterate(t, t_stop_fn, NULL));
+
+  // Ids handed out before the growth still name the same strings
+  ASSERT_STR_EQ("hello", nc_strtab_get(t, 0, NULL));
+  ASSERT_STR_EQ("hell", nc_strtab_get(t, 2, NULL));
+  for (id = 4; id < nc_strtab_count(t); id += 997) {
+    len = (size_t)snprintf(buf, sizeof(buf), "key:%d", id - 4);
+    ASSERT_STR_EQ(buf, nc_strtab_get(t, id, NULL));
+  }
+
+  nc_strtab_destroy(t);
+  PASS();
+}
+
+// Strings are byte strings: NULs are part of the content and the length
+TEST embedded_nul(void) {
+  struct nc_strtab *t;
+  const char *s;
+  size_t len;
+  int a, b, c;
+
+  t = nc_strtab_create(4, NC_STRTAB_DEDUP);
+  ASSERT(t != NULL);
+
+  a = nc_strtab_append(t, "ab\0cd", 5);
+  b = nc_strtab_append(t, "ab\0ce", 5);
+  c = nc_strtab_append(t, "ab", 2);
+  ASSERT(a >= 0 && b >= 0 && c >= 0);
+  ASSERT(a != b && a != c && b != c);
+  ASSERT_EQ(a, nc_strtab_append(t, "ab\0cd", 5));
+  ASSERT_EQ(c, nc_strtab_find(t, "ab\0cd", 2));
+  ASSERT_EQ(-1, nc_strtab_find(t, "ab\0", 3));
+
+  s = nc_strtab_get(t, a, &len);
+  ASSERT_EQ(5, len);
+  ASSERT_MEM_EQ("ab\0cd", s, 6);
+
+  nc_strtab_destroy(t);
+  PASS();
+}
+
+// Without NC_STRTAB_DEDUP every append is a new string
+TEST no_dedup(void) {
+  struct nc_strtab *t;
+  int i;
+
+  t = nc_strtab_create(2, 0);
+  ASSERT(t != NULL);
+
+  for (i = 0; i < 1000; i++) {
+    ASSERT_EQ(i, nc_strtab_append(t, "same", 4));
+  }
+  ASSERT_EQ(1000, nc_strtab_count(t));
+  ASSERT_STR_EQ("same", nc_strtab_get(t, 999, NULL));
+
+  nc_strtab_destroy(t);
+  PASS();
+}
+
+// Appending a string that lives in the table itself, while the append
+// moves the bytes
+TEST append_own(void) {
+  struct nc_strtab *t;
+  const char *s;
+  size_t len;
+  int i;
+
+  t = nc_strtab_create(1, 0);
+  ASSERT(t != NULL);
+
+  ASSERT_EQ(0, nc_strtab_append(t, "abcdefgh", 8));
+  for (i = 1; i < 1000; i++) {
+    s = nc_strtab_get(t, i - 1, &len);
+    ASSERT_EQ(i, nc_strtab_append(t, s, len));
+  }
+  s = nc_strtab_get(t, 999, &len);
+  ASSERT_EQ(8, len);
+  ASSERT_STR_EQ("abcdefgh", s);
+
+  nc_strtab_destroy(t);
+  PASS();
+}
+
+SUITE(strtab) {
+  RUN_TEST(intern_dedup);
+  RUN_TEST(embedded_nul);
+  RUN_TEST(no_dedup);
+  RUN_TEST(append_own);
+}